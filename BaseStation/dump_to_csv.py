@@ -26,6 +26,10 @@ def read_and_process_data(ser, output_file):
                 line = ser.readline().decode('utf-8').strip()
                 if line.startswith("dump"):
                     continue
+                if line.startswith("#"):
+                    # file metadata (format version, time mapping)
+                    print(line)
+                    continue
                 if line:
                     print(line)
                     if not header_written:
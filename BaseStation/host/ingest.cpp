@@ -0,0 +1,636 @@
+// Host ingest daemon: reads the binary stream of the BaseStation from the serial port, decodes it with the schema the
+// BaseStation sends (logEntryDef of its firmware), publishes the decoded records into a memory mapped ring file for
+// any number of local readers (ring.h) and appends them to an archive log file (same format as the flash files).
+//
+//     ingest --port /dev/ttyACM0 --archive flights/          daemon
+//     ingest --follow                                        reader, prints the records of the ring as CSV
+//     ingest --bench flight.bin                              latency from serial byte to reader via a pseudo-terminal
+//     ingest --bench flight.bin --reset-after 500            same, the board resets in the middle of the stream
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include "logdecoder.h"
+#include "ring.h"
+
+typedef struct {
+    std::string port;
+    int baud = 115200;
+    std::string ring = "/dev/shm/rocket.ring";
+    uint32_t slots = 4096;
+    std::string archive;                // folder, empty: no archive
+    bool follow = false;
+    std::string bench;                  // recorded telemetry file
+    int benchRate = 100;                // records/s
+    int benchCount = 2000;
+    int benchResetAfter = -1;           // records before the simulated BaseStation reset, -1: none
+    bool verbose = false;
+} options_t;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static int64_t nowUs(clockid_t clock = CLOCK_REALTIME) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static speed_t baudConstant(int baud) {
+    switch (baud) {
+        case 9600:      return B9600;
+        case 57600:     return B57600;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        default:        return B115200;
+    }
+}
+
+// Raw mode, blocking reads (the USB CDC port of the ESP32-C3 ignores the baud rate)
+static bool setRaw(int fd, int baud) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        return false;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baudConstant(baud));
+    cfsetospeed(&tio, baudConstant(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+// Appends the records to a log file in the flash file format (version 2, CRC framed blocks), readable by the dump
+// tools and the simulator replay. Synced once per second, a crash loses at most that and leaves a torn tail that
+// readers skip.
+class Archive : public LogFormat {
+    public:
+    static const int SYNC_INTERVAL_MS = 1000;
+
+    ~Archive() { close(); }
+
+    bool begin(const std::string &folder, const flashEntryHeader_t &streamHeader, const logEntryDef_t *defs) {
+        close();
+        if (folder.empty()) {
+            return false;
+        }
+        char stamp[32], name[48];
+        time_t t = time(nullptr);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&t));
+        // never append to an existing archive (restart or schema change within the same second), a second
+        // header in the middle of a file makes it unreadable
+        for (int i = 0; i < 100; i++) {
+            snprintf(name, sizeof(name), i == 0 ? "/%s.bin" : "/%s-%d.bin", stamp, i);
+            _path = folder + name;
+            _fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (_fd >= 0 || errno != EEXIST) {
+                break;
+            }
+        }
+        if (_fd < 0) {
+            fprintf(stderr, "[Ingest] Archive: can't open %s: %s\n", _path.c_str(), strerror(errno));
+            return false;
+        }
+        flashEntryHeader_t header = streamHeader;
+        header.version = LOG_FILE_VERSION;
+        header.openTimeUs = 0;
+        size_t defsSize = header.numLogEntryDefs * sizeof(logEntryDef_t);
+        if (write(_fd, &header, sizeof(header)) != (ssize_t)sizeof(header) || write(_fd, defs, defsSize) != (ssize_t)defsSize) {
+            close();
+            return false;
+        }
+        _blockLen = 0;
+        _blockSeq = 0;
+        _lastSync = nowUs(CLOCK_MONOTONIC);
+        fprintf(stderr, "[Ingest] Archive: %s\n", _path.c_str());
+        return true;
+    }
+
+    void add(const uint8_t *record, size_t size) {
+        if (_fd < 0) {
+            return;
+        }
+        if (_blockLen + size > BLOCK_PAYLOAD) {
+            commitBlock();
+        }
+        memcpy(_block + sizeof(blockHeader_t) + _blockLen, record, size);
+        _blockLen += size;
+    }
+
+    // Call periodically, writes the pending block and syncs the file once per SYNC_INTERVAL_MS
+    void loop() {
+        if (_fd >= 0 && nowUs(CLOCK_MONOTONIC) - _lastSync >= SYNC_INTERVAL_MS * 1000) {
+            sync();
+        }
+    }
+
+    void sync() {
+        commitBlock();
+        fdatasync(_fd);
+        _lastSync = nowUs(CLOCK_MONOTONIC);
+    }
+
+    void close() {
+        if (_fd >= 0) {
+            sync();
+            ::close(_fd);
+        }
+        _fd = -1;
+    }
+
+    protected:
+    int _fd = -1;
+    std::string _path;
+    uint8_t _block[BLOCK_MAX];
+    size_t _blockLen = 0;
+    uint16_t _blockSeq = 0;
+    int64_t _lastSync = 0;
+
+    void commitBlock() {
+        if (_blockLen == 0) {
+            return;
+        }
+        size_t len = frameBlock(_block, BLOCK_RECORDS, _blockSeq++, _blockLen);
+        _blockLen = 0;
+        if (write(_fd, _block, len) != (ssize_t)len) {
+            fprintf(stderr, "[Ingest] Archive: write failed: %s\n", strerror(errno));
+        }
+    }
+};
+
+class Ingest {
+    public:
+    typedef struct {
+        uint64_t records;
+        uint64_t skippedBytes;
+        uint32_t headers;
+        uint32_t reconnects;
+        uint32_t handshakes;        // "binary" commands sent
+    } stats_t;
+
+    static const int POLL_INTERVAL_MS = 200;        // archive sync / handshake retry granularity
+    static const int HANDSHAKE_INTERVAL_MS = 1000;  // "binary" is sent again until the schema arrives
+    // data but no valid block for this long: the BaseStation was reset behind the open port (USB-UART bridge) and
+    // prints CSV again, the handshake is repeated
+    static const int STALE_MS = 2000;
+
+    Ingest(const options_t &opt) : _opt(opt) {}
+
+    // Reads the serial port until stop() (or the end of the stream for a pseudo-terminal / file)
+    void run() {
+        while (!stopRequested) {
+            _fd = ::open(_opt.port.c_str(), O_RDWR | O_NOCTTY);
+            if (_fd < 0) {
+                if (_stats.reconnects++ == 0) {
+                    fprintf(stderr, "[Ingest] Waiting for %s: %s\n", _opt.port.c_str(), strerror(errno));
+                }
+                sleep(1);
+                continue;
+            }
+            setRaw(_fd, _opt.baud);
+            fprintf(stderr, "[Ingest] Connected to %s\n", _opt.port.c_str());
+            _lastHandshake = 0;
+            _lastValidUs = nowUs(CLOCK_MONOTONIC);
+            _bytesSinceValid = 0;
+            _decoder.beginStream(readPort, this);
+            handshake();
+            while (LogDecoder::event_e event = _decoder.next()) {
+                handleEvent(event);
+            }
+            ::close(_fd);
+            _fd = -1;
+            fprintf(stderr, "[Ingest] Disconnected, %llu records, %llu bytes skipped\n",
+                (unsigned long long)_stats.records, (unsigned long long)_stats.skippedBytes);
+        }
+        _archive.close();
+        _ring.close();
+    }
+
+    const stats_t &stats() { return _stats; }
+
+    protected:
+    const options_t &_opt;
+    int _fd = -1;
+    LogDecoder _decoder;
+    RingWriter _ring;
+    Archive _archive;
+    stats_t _stats = {0};
+    int64_t _rxUs = 0;                      // time of the last read
+    int64_t _lastHandshake = 0;
+    int64_t _lastValidUs = 0;               // time of the last valid block
+    uint64_t _bytesSinceValid = 0;
+    bool _stale = false;
+    LogFormat::logEntryDef_t _ringDefs[LogDecoder::MAX_ENTRY_DEFS];
+    int _ringNumDefs = 0;
+    int _timeUsIdx = -1, _millisIdx = -1;
+
+    void handleEvent(LogDecoder::event_e event) {
+        if (event == LogDecoder::EV_HEADER || event == LogDecoder::EV_RECORD || event == LogDecoder::EV_TIME) {
+            _lastValidUs = nowUs(CLOCK_MONOTONIC);
+            _bytesSinceValid = 0;
+            _stale = false;
+        }
+        switch (event) {
+            case LogDecoder::EV_HEADER:
+                _stats.headers++;
+                schemaChanged();
+                break;
+            case LogDecoder::EV_RECORD:
+                publish(_decoder.record());
+                break;
+            case LogDecoder::EV_SKIPPED:
+                _stats.skippedBytes += _decoder.skipped();
+                if (_opt.verbose) {
+                    fprintf(stderr, "[Ingest] Skipped %u invalid bytes\n", _decoder.skipped());
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // The BaseStation sends the schema after every "binary" command, a new ring / archive file is only started if it
+    // differs from the current one (e.g. after a firmware update)
+    void schemaChanged() {
+        int num = _decoder.numDefs();
+        if (_ring.isOpen() && num == _ringNumDefs && memcmp(_ringDefs, _decoder.defs(), num * sizeof(_ringDefs[0])) == 0) {
+            return;
+        }
+        memcpy(_ringDefs, _decoder.defs(), num * sizeof(_ringDefs[0]));
+        _ringNumDefs = num;
+        _timeUsIdx = _decoder.fieldIndex("time_us");
+        _millisIdx = _decoder.fieldIndex("millis");
+        if (!_ring.create(_opt.ring.c_str(), _opt.slots, _ringDefs, num, _decoder.recordSize())) {
+            fprintf(stderr, "[Ingest] Can't create ring %s: %s\n", _opt.ring.c_str(), strerror(errno));
+        }
+        _archive.begin(_opt.archive, _decoder.header(), _ringDefs);
+        fprintf(stderr, "[Ingest] Schema: %d fields, %d bytes per record, %u values, ring %s\n",
+            num, _decoder.recordSize(), _ring.isOpen() ? _ring.header().numValues : 0, _opt.ring.c_str());
+    }
+
+    void publish(const uint8_t *record) {
+        _stats.records++;
+        _archive.add(record, _decoder.recordSize());
+        if (!_ring.isOpen()) {
+            return;
+        }
+        int64_t timeUs = 0;
+        if (_timeUsIdx >= 0) {
+            uint64_t t;     // raw, a float can't hold it
+            memcpy(&t, record + _ringDefs[_timeUsIdx]._offset, sizeof(t));
+            timeUs = t;
+        } else if (_millisIdx >= 0) {
+            uint32_t ms;
+            memcpy(&ms, record + _ringDefs[_millisIdx]._offset, sizeof(ms));
+            timeUs = (int64_t)ms * 1000;
+        }
+        // decoded straight into the slot
+        float *values = _ring.begin(_rxUs, timeUs);
+        for (int i = 0; i < _ringNumDefs; i++) {
+            values += _decoder.value(record, i, values);
+        }
+        _ring.publish();
+    }
+
+    // Sends "binary" until the schema arrives, and again if only invalid data arrives for STALE_MS (an idle link sends
+    // nothing, so it doesn't trigger it)
+    void handshake() {
+        int64_t now = nowUs(CLOCK_MONOTONIC);
+        bool stale = _bytesSinceValid > 0 && now - _lastValidUs >= STALE_MS * 1000;
+        if (stale && !_stale && _decoder.numDefs() != 0) {
+            fprintf(stderr, "[Ingest] No valid block for %d ms (BaseStation reset?), sending the handshake again\n", STALE_MS);
+        }
+        _stale = stale;
+        if ((_decoder.numDefs() == 0 || stale) && now - _lastHandshake >= HANDSHAKE_INTERVAL_MS * 1000) {
+            _lastHandshake = now;
+            _stats.handshakes++;
+            if (write(_fd, "binary\n", 7) != 7 && _opt.verbose) {
+                fprintf(stderr, "[Ingest] Handshake write failed: %s\n", strerror(errno));
+            }
+        }
+    }
+
+    // LogDecoder::readFn_t, blocks until data arrives, does the periodic work while waiting
+    static size_t readPort(void *ctx, uint8_t *buf, size_t len) {
+        Ingest *self = (Ingest*)ctx;
+        while (!stopRequested) {
+            struct pollfd pfd = { self->_fd, POLLIN, 0 };
+            int ret = poll(&pfd, 1, POLL_INTERVAL_MS);
+            self->_archive.loop();
+            self->handshake();
+            if (ret < 0 && errno != EINTR) {
+                return 0;
+            }
+            if (ret > 0) {
+                ssize_t n = read(self->_fd, buf, len);
+                self->_rxUs = nowUs();
+                self->_bytesSinceValid += n > 0 ? n : 0;
+                return n > 0 ? n : 0;       // error / hangup: end of the stream, reconnect
+            }
+        }
+        return 0;
+    }
+};
+
+// Prints the records of the ring as CSV, an example reader (any number can run at the same time)
+static int follow(const options_t &opt) {
+    RingReader reader;
+    while (!stopRequested) {
+        if (!reader.open(opt.ring.c_str()) || reader.closed()) {
+            sleep(1);       // daemon not running (yet)
+            continue;
+        }
+        const TelemetryRing::ringHeader_t &header = reader.header();
+        char line[4096];
+        size_t len = 0;
+        LogFormat::appendf(line, sizeof(line), &len, "rx_us,board_us");     // board_us: time_us / millis of the record, exact
+        for (int i = 0; i < header.numDefs; i++) {
+            int n = LogFormat::components(header.defs[i].type);
+            for (int j = 0; j < n; j++) {
+                LogFormat::appendf(line, sizeof(line), &len, n > 1 ? ",%s.%c" : ",%s", header.defs[i].name, (n == 3 ? "xyz" : "abcd")[j]);
+            }
+        }
+        printf("%s\n", line);
+        fflush(stdout);
+
+        while (!stopRequested && !reader.closed()) {
+            while (const TelemetryRing::ringSlot_t *slot = reader.next()) {
+                len = 0;
+                LogFormat::appendf(line, sizeof(line), &len, "%lld,%lld", (long long)slot->rxUs, (long long)slot->timeUs);
+                const float *values = TelemetryRing::values(slot);
+                for (uint32_t i = 0; i < header.numValues; i++) {
+                    LogFormat::appendf(line, sizeof(line), &len, ",%g", values[i]);
+                }
+                if (reader.valid()) {
+                    printf("%s\n", line);
+                }
+            }
+            fflush(stdout);
+            reader.wait(100);
+        }
+        if (reader.lost()) {
+            fprintf(stderr, "[Follow] %llu records lost (reader too slow)\n", (unsigned long long)reader.lost());
+        }
+    }
+    return 0;
+}
+
+// Latency from the serial byte to the reader: a thread plays the board on a pseudo-terminal (answers the handshake,
+// sends the schema and the records of a recorded file at a fixed rate), the daemon runs unchanged on the other side,
+// a reader thread follows the ring file. Percentiles of write() -> visible to the reader and rxUs -> visible.
+static int bench(options_t opt) {
+    std::vector<uint8_t> records;
+    LogDecoder file;
+    FILE *f = fopen(opt.bench.c_str(), "rb");
+    if (f && file.begin([](void *ctx, uint8_t *buf, size_t len) { return fread(buf, 1, len, (FILE*)ctx); }, f)) {
+        while (LogDecoder::event_e event = file.next()) {
+            if (event == LogDecoder::EV_RECORD) {
+                records.insert(records.end(), file.record(), file.record() + file.recordSize());
+            }
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    size_t recordSize = file.recordSize();
+    if (records.empty()) {
+        fprintf(stderr, "[Bench] No records in %s\n", opt.bench.c_str());
+        return 2;
+    }
+
+    int master, slave;
+    char slaveName[128];
+    if (openpty(&master, &slave, slaveName, nullptr, nullptr) != 0) {
+        perror("openpty");
+        return 2;
+    }
+    setRaw(master, opt.baud);
+    opt.port = slaveName;
+    opt.ring = "/dev/shm/rocket-bench-" + std::to_string(getpid()) + ".ring";
+    unlink(opt.ring.c_str());
+
+    const int count = opt.benchCount;
+    std::vector<int64_t> sentNs(count, 0), writeLat(count, -1), ringLat(count, -1);
+    std::atomic<bool> readerDone(false);
+
+    // the board: waits for "binary", sends the schema, then the records as single blocks like the BaseStation.
+    // With --reset-after it reboots after that many records behind the open port: boot text and CSV lines (the output
+    // mode after boot) until the daemon sends "binary" again, then the remaining records.
+    std::thread board([&]() {
+        uint8_t block[LogFormat::BLOCK_MAX];
+        uint8_t *payload = block + sizeof(LogFormat::blockHeader_t);
+        uint16_t seq = 0;
+        size_t len;
+
+        // reads the commands of the daemon until "binary" and sends the schema, with csv a CSV line every record
+        // interval meanwhile
+        auto waitBinary = [&](bool csv) {
+            char cmd[64];
+            size_t cmdLen = 0;
+            while (cmdLen < 7 || memcmp(cmd + cmdLen - 7, "binary\n", 7) != 0) {
+                struct pollfd pfd = { master, POLLIN, 0 };
+                int ret = poll(&pfd, 1, csv ? 1000 / opt.benchRate + 1 : 100);
+                if (stopRequested) {
+                    return false;
+                }
+                if (ret == 0 && csv) {
+                    const char *line = "20000000,1.25,0.5,-9.81,101325\n";
+                    if (write(master, line, strlen(line)) != (ssize_t)strlen(line)) {
+                        return false;
+                    }
+                }
+                if (ret <= 0) {
+                    continue;
+                }
+                ssize_t n = read(master, cmd + cmdLen, std::min(sizeof(cmd) - cmdLen, (size_t)1));
+                if (n <= 0) {
+                    return false;
+                }
+                cmdLen = (cmdLen + n) % (sizeof(cmd) - 1);
+            }
+            LogFormat::flashEntryHeader_t header = file.header();
+            header.version = LogFormat::LOG_FILE_VERSION;
+            memcpy(payload, &header, sizeof(header));
+            memcpy(payload + sizeof(header), file.defs(), header.headerSize - sizeof(header));
+            len = LogFormat::frameBlock(block, LogFormat::BLOCK_HEADER, seq++, header.headerSize);
+            return write(master, block, len) == (ssize_t)len;
+        };
+
+        if (!waitBinary(false)) {
+            return;
+        }
+        usleep(300000);     // daemon creates the ring
+
+        int64_t start = nowUs(CLOCK_MONOTONIC);
+        for (int i = 0; i < count; i++) {
+            if (i == opt.benchResetAfter) {
+                seq = 0;
+                const char *boot = "RocketControl Receiver\ntime_us,speed,accel,accel_z,pressure\n";
+                if (write(master, boot, strlen(boot)) != (ssize_t)strlen(boot) || !waitBinary(true)) {
+                    return;
+                }
+                start = nowUs(CLOCK_MONOTONIC) - (int64_t)i * 1000000 / opt.benchRate;    // no backlog burst
+            }
+            int64_t due = start + (int64_t)i * 1000000 / opt.benchRate;
+            int64_t wait = due - nowUs(CLOCK_MONOTONIC);
+            if (wait > 0) {
+                usleep(wait);
+            }
+            memcpy(payload, records.data() + (i % (records.size() / recordSize)) * recordSize, recordSize);
+            len = LogFormat::frameBlock(block, LogFormat::BLOCK_RECORDS, seq++, recordSize);
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            sentNs[i] = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            if (write(master, block, len) != (ssize_t)len) {
+                return;
+            }
+        }
+    });
+
+    // a local reader process would do the same, it only shares the ring file with the daemon
+    uint64_t lost = 0;
+    std::thread reader([&]() {
+        RingReader ring;
+        int64_t deadline = nowUs(CLOCK_MONOTONIC) + 5000000;
+        while (!ring.open(opt.ring.c_str(), true)) {
+            if (nowUs(CLOCK_MONOTONIC) > deadline) {
+                readerDone = true;
+                return;
+            }
+            usleep(1000);
+        }
+        int received = 0;
+        deadline = nowUs(CLOCK_MONOTONIC) + (int64_t)count * 1000000 / opt.benchRate + 5000000;
+        if (opt.benchResetAfter >= 0) {
+            deadline += (Ingest::STALE_MS + Ingest::HANDSHAKE_INTERVAL_MS) * 1000;     // until the handshake is repeated
+        }
+        while (received < count && nowUs(CLOCK_MONOTONIC) < deadline) {
+            while (const TelemetryRing::ringSlot_t *slot = ring.next()) {
+                struct timespec mono;
+                clock_gettime(CLOCK_MONOTONIC, &mono);
+                int64_t visibleUs = nowUs();
+                uint64_t idx = ring.position() - 1;
+                int64_t rxUs = slot->rxUs;
+                if (ring.valid() && idx < (uint64_t)count) {
+                    writeLat[idx] = (int64_t)mono.tv_sec * 1000000000 + mono.tv_nsec - sentNs[idx];
+                    ringLat[idx] = (visibleUs - rxUs) * 1000;
+                    received++;
+                }
+            }
+            ring.wait(100);
+        }
+        lost = ring.lost();
+        readerDone = true;
+    });
+
+    std::thread stopper([&]() {
+        while (!readerDone) {
+            usleep(10000);
+        }
+        stopRequested = 1;
+    });
+
+    Ingest ingest(opt);
+    ingest.run();
+    board.join();
+    reader.join();
+    stopper.join();
+    close(master);
+    close(slave);
+    unlink(opt.ring.c_str());
+
+    // percentiles of the received records
+    auto percentiles = [](std::vector<int64_t> v, double *p50, double *p99, double *max) {
+        v.erase(std::remove(v.begin(), v.end(), -1), v.end());
+        std::sort(v.begin(), v.end());
+        if (v.empty()) {
+            *p50 = *p99 = *max = 0;
+            return;
+        }
+        *p50 = v[v.size() / 2] / 1000.0;
+        *p99 = v[std::min(v.size() - 1, v.size() * 99 / 100)] / 1000.0;
+        *max = v.back() / 1000.0;
+    };
+    double p50, p99, max, ringP50, ringP99, ringMax;
+    percentiles(writeLat, &p50, &p99, &max);
+    percentiles(ringLat, &ringP50, &ringP99, &ringMax);
+    int received = count - std::count(writeLat.begin(), writeLat.end(), -1);
+    printf("{\"records\":%d,\"received\":%d,\"lost\":%llu,\"rate\":%d,\"record_bytes\":%zu,\"reset_after\":%d,\"handshakes\":%u,"
+           "\"latency_p50_us\":%.1f,\"latency_p99_us\":%.1f,\"latency_max_us\":%.1f,"
+           "\"ring_p50_us\":%.1f,\"ring_p99_us\":%.1f,\"ring_max_us\":%.1f}\n",
+        count, received, (unsigned long long)lost, opt.benchRate, recordSize, opt.benchResetAfter, ingest.stats().handshakes, p50, p99, max, ringP50, ringP99, ringMax);
+    return received == count ? 0 : 1;
+}
+
+static void printUsage() {
+    printf("Usage: ingest [options]\n"
+           "  --port <tty>          serial port of the BaseStation, e.g. /dev/ttyACM0\n"
+           "  --baud <n>            baud rate (default 115200, ignored by USB CDC ports)\n"
+           "  --ring <file>         ring file for the readers (default /dev/shm/rocket.ring)\n"
+           "  --slots <n>           records in the ring (default 4096)\n"
+           "  --archive <dir>       append the records to a log file in this folder (flash file format)\n"
+           "  --follow              print the records of the ring as CSV instead (reader)\n"
+           "  --bench <file.bin>    latency benchmark with the records of a telemetry file via a pseudo-terminal\n"
+           "  --rate <n>            records/s of the benchmark (default 100)\n"
+           "  --count <n>           records of the benchmark (default 2000)\n"
+           "  --reset-after <n>     the benchmark board resets after n records and prints CSV until the handshake\n"
+           "  --verbose             report every skipped invalid byte range\n");
+}
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+int main(int argc, char **argv) {
+    options_t opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--port" && hasValue)            opt.port = argv[++i];
+        else if (arg == "--baud" && hasValue)       opt.baud = atoi(argv[++i]);
+        else if (arg == "--ring" && hasValue)       opt.ring = argv[++i];
+        else if (arg == "--slots" && hasValue)      opt.slots = std::max(1, atoi(argv[++i]));
+        else if (arg == "--archive" && hasValue)    opt.archive = argv[++i];
+        else if (arg == "--follow")                 opt.follow = true;
+        else if (arg == "--bench" && hasValue)      opt.bench = argv[++i];
+        else if (arg == "--rate" && hasValue)       opt.benchRate = std::max(1, atoi(argv[++i]));
+        else if (arg == "--count" && hasValue)      opt.benchCount = std::max(1, atoi(argv[++i]));
+        else if (arg == "--reset-after" && hasValue) opt.benchResetAfter = atoi(argv[++i]);
+        else if (arg == "--verbose")                opt.verbose = true;
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = onSignal;       // no SA_RESTART, poll() / futex wait return early
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (opt.follow) {
+        return follow(opt);
+    }
+    if (!opt.bench.empty()) {
+        return bench(opt);
+    }
+    if (opt.port.empty()) {
+        printUsage();
+        return 2;
+    }
+    Ingest ingest(opt);
+    ingest.run();
+    return 0;
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "logformat.h"
+
+// Memory mapped ring file with the decoded telemetry records of the ingest daemon, one writer, any number of readers
+// in other processes. Readers map the file read-only and read the records in place, without locks: every slot has a
+// sequence number (seqlock) that is odd while the writer fills it. A reader that falls more than numSlots records
+// behind loses the overwritten ones (lost()), it never blocks the writer.
+//
+// File layout: ringHeader_t, then numSlots slots of slotSize bytes: ringSlot_t, float values[numValues]
+// values holds the components of every field in defs[] in order (multiplier applied, *_VEC types have 3 / 4).
+//
+// The writer replaces the file (rename) when the schema changes and marks the old one closed, readers open() again.
+// Linux only (futex on the shared mapping).
+class TelemetryRing {
+    public:
+    static const uint32_t RING_MAGIC = 0x474E5252;      // "RRNG"
+    static const uint16_t RING_VERSION = 1;
+    static const int MAX_DEFS = 32;
+
+    typedef struct {
+        uint32_t magic;                     // RING_MAGIC
+        uint16_t version;                   // RING_VERSION
+        uint16_t numDefs;
+        uint32_t numSlots;
+        uint32_t slotSize;                  // bytes, ringSlot_t + values, multiple of 8
+        uint32_t numValues;                 // floats per record
+        uint32_t recordSize;                // size of the raw records on the radio link
+        LogFormat::logEntryDef_t defs[MAX_DEFS];
+        alignas(64) std::atomic<uint64_t> head;     // records published
+        std::atomic<uint32_t> wake;                 // futex word, incremented after every publish
+        std::atomic<uint32_t> closed;               // the writer stopped or replaced the file
+    } ringHeader_t;
+
+    typedef struct {
+        std::atomic<uint64_t> seq;          // 2 * index + 1 while the writer fills the slot, 2 * index + 2 when published
+        int64_t rxUs;                       // host time the last byte of the record was read (us since Unix epoch)
+        int64_t timeUs;                     // time_us of the record (board timebase), millis * 1000 for older schemas
+        // float values[numValues];
+    } ringSlot_t;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring needs lock-free 64 bit atomics");
+
+    static const float *values(const ringSlot_t *slot) { return (const float*)(slot + 1); }
+
+    const ringHeader_t &header() { return *_header; }
+
+    // Index of the first value of the field with the given name in values(), -1 if the schema doesn't have it
+    int valueIndex(const char *name) {
+        int idx = 0;
+        for (int i = 0; i < _header->numDefs; i++) {
+            if (strncmp(_header->defs[i].name, name, sizeof(_header->defs[i].name)) == 0) {
+                return idx;
+            }
+            idx += LogFormat::components(_header->defs[i].type);
+        }
+        return -1;
+    }
+
+    protected:
+    ringHeader_t *_header = nullptr;
+    uint8_t *_slots = nullptr;
+    size_t _mapSize = 0;
+
+    ringSlot_t *slotAt(uint64_t index) {
+        return (ringSlot_t*)(_slots + (index % _header->numSlots) * _header->slotSize);
+    }
+
+    static size_t headerSize() {
+        return (sizeof(ringHeader_t) + 63) / 64 * 64;
+    }
+
+    static long futex(std::atomic<uint32_t> *addr, int op, uint32_t val, const struct timespec *timeout) {
+        return syscall(SYS_futex, (uint32_t*)addr, op, val, timeout, nullptr, 0);
+    }
+
+    void unmap() {
+        if (_header) {
+            munmap(_header, _mapSize);
+        }
+        _header = nullptr;
+        _slots = nullptr;
+    }
+};
+
+class RingWriter : public TelemetryRing {
+    public:
+    ~RingWriter() { close(); }
+
+    // Creates a new ring file for the schema (defs as validated by LogDecoder) and replaces the one at path
+    bool create(const char *path, uint32_t numSlots, const LogFormat::logEntryDef_t *defs, int numDefs, uint32_t recordSize) {
+        close();
+        closeStale(path);
+        if (numDefs <= 0 || numDefs > MAX_DEFS || numSlots == 0) {
+            return false;
+        }
+        uint32_t numValues = 0;
+        for (int i = 0; i < numDefs; i++) {
+            numValues += LogFormat::components(defs[i].type);
+        }
+        uint32_t slotSize = (sizeof(ringSlot_t) + numValues * sizeof(float) + 7) / 8 * 8;
+
+        char tmpPath[512];
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+        int fd = ::open(tmpPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        _mapSize = headerSize() + (size_t)numSlots * slotSize;
+        void *map = MAP_FAILED;
+        if (ftruncate(fd, _mapSize) == 0) {     // zero filled: seq 0, nothing published
+            map = mmap(nullptr, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            unlink(tmpPath);
+            return false;
+        }
+        _header = (ringHeader_t*)map;
+        _slots = (uint8_t*)map + headerSize();
+        _header->version = RING_VERSION;
+        _header->numDefs = numDefs;
+        _header->numSlots = numSlots;
+        _header->slotSize = slotSize;
+        _header->numValues = numValues;
+        _header->recordSize = recordSize;
+        memcpy(_header->defs, defs, numDefs * sizeof(LogFormat::logEntryDef_t));
+        std::atomic_thread_fence(std::memory_order_release);
+        _header->magic = RING_MAGIC;        // set last, readers check it
+        if (rename(tmpPath, path) != 0) {
+            unlink(tmpPath);
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpen() { return _header != nullptr; }
+
+    // Slot of the next record, fill in its values and call publish()
+    float *begin(int64_t rxUs, int64_t timeUs) {
+        uint64_t index = _header->head.load(std::memory_order_relaxed);
+        ringSlot_t *slot = slotAt(index);
+        slot->seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);     // odd seq is visible before the new values
+        slot->rxUs = rxUs;
+        slot->timeUs = timeUs;
+        return (float*)(slot + 1);
+    }
+
+    void publish() {
+        uint64_t index = _header->head.load(std::memory_order_relaxed);
+        slotAt(index)->seq.store(2 * index + 2, std::memory_order_release);
+        _header->head.store(index + 1, std::memory_order_release);
+        wakeReaders();
+    }
+
+    // Marks the ring closed (readers open() the path again) and unmaps it, the file stays for late readers
+    void close() {
+        if (!_header) {
+            return;
+        }
+        _header->closed.store(1, std::memory_order_release);
+        wakeReaders();
+        unmap();
+    }
+
+    protected:
+    // Always wakes, a syscall per record is cheap at telemetry rates and readers can map the file read-only
+    void wakeReaders() {
+        _header->wake.fetch_add(1, std::memory_order_release);
+        futex(&_header->wake, FUTEX_WAKE, INT32_MAX, nullptr);
+    }
+
+    // Ring left behind by a crashed writer, its readers would wait forever
+    void closeStale(const char *path) {
+        int fd = ::open(path, O_RDWR);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= headerSize()) {
+            void *map = mmap(nullptr, headerSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                ringHeader_t *header = (ringHeader_t*)map;
+                if (header->magic == RING_MAGIC && header->version == RING_VERSION) {
+                    header->closed.store(1, std::memory_order_release);
+                    header->wake.fetch_add(1, std::memory_order_release);
+                    futex(&header->wake, FUTEX_WAKE, INT32_MAX, nullptr);
+                }
+                munmap(map, headerSize());
+            }
+        }
+        ::close(fd);
+    }
+};
+
+// Follows the ring of the ingest daemon, e.g.
+//
+//     RingReader reader;
+//     reader.open("/dev/shm/rocket.ring");
+//     while (!reader.closed()) {
+//         while (const TelemetryRing::ringSlot_t *slot = reader.next()) {
+//             float height = TelemetryRing::values(slot)[heightIdx];
+//             if (reader.valid()) { ... }     // values were not overwritten while reading them
+//         }
+//         reader.wait(100);
+//     }
+class RingReader : public TelemetryRing {
+    public:
+    ~RingReader() { unmap(); }
+
+    // Maps the ring read-only, starts at the next record (fromOldest: at the oldest record still in the ring)
+    bool open(const char *path, bool fromOldest = false) {
+        unmap();
+        _current = nullptr;
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= headerSize()) {
+            map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        _header = (ringHeader_t*)map;
+        _mapSize = st.st_size;
+        if (_header->magic != RING_MAGIC || _header->version != RING_VERSION ||
+            _mapSize < headerSize() + (size_t)_header->numSlots * _header->slotSize) {
+            unmap();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        _slots = (uint8_t*)map + headerSize();
+        uint64_t head = _header->head.load(std::memory_order_acquire);
+        _next = fromOldest && head > _header->numSlots ? head - _header->numSlots : fromOldest ? 0 : head;
+        _lost = 0;
+        return true;
+    }
+
+    // Next record, nullptr if there is none yet. The slot is read in place, check valid() after reading the values.
+    const ringSlot_t *next() {
+        while (true) {
+            uint64_t head = _header->head.load(std::memory_order_acquire);
+            if (_next >= head) {
+                return nullptr;
+            }
+            if (head - _next > _header->numSlots) {     // overrun, skip to the oldest record still in the ring
+                _lost += head - _header->numSlots - _next;
+                _next = head - _header->numSlots;
+            }
+            ringSlot_t *slot = slotAt(_next);
+            uint64_t seq = slot->seq.load(std::memory_order_acquire);
+            if (seq == 2 * _next + 2) {
+                _current = slot;
+                _currentSeq = seq;
+                _next++;
+                return slot;
+            }
+            _lost++;        // overwritten since head was read
+            _next++;
+        }
+    }
+
+    // False if the writer started to overwrite the slot returned by next() while it was read (values may be torn)
+    bool valid() {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_current->seq.load(std::memory_order_relaxed) == _currentSeq) {
+            return true;
+        }
+        _lost++;
+        return false;
+    }
+
+    // Waits up to timeoutMs for a new record, returns true if one is available
+    bool wait(int timeoutMs) {
+        uint32_t wake = _header->wake.load(std::memory_order_acquire);
+        if (available() || closed()) {
+            return available();
+        }
+        struct timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+        futex((std::atomic<uint32_t>*)&_header->wake, FUTEX_WAIT, wake, &timeout);
+        return available();
+    }
+
+    bool available() { return _next < _header->head.load(std::memory_order_acquire); }
+    // The writer stopped or switched to a new file (schema change), open() again to follow it
+    bool closed() { return _header->closed.load(std::memory_order_acquire) != 0; }
+    uint64_t lost() { return _lost; }
+    uint64_t position() { return _next; }
+
+    protected:
+    uint64_t _next = 0;
+    uint64_t _lost = 0;
+    const ringSlot_t *_current = nullptr;
+    uint64_t _currentSeq = 0;
+};
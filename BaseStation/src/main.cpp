@@ -5,9 +5,65 @@
 #include <WiFi.h>
 
 #include "telemetry.h"
+#include "logdecoder.h"
 #include "radio.h"
 // #include "console.h"    // needs to be last file to be included
 
+LogDecoder decoder;
+char line[Telemetry::CSV_LINE_SIZE];
+
+// Output mode, CSV for the serial monitor, CRC framed blocks for the host ingest daemon (BaseStation/host)
+// Switched with the lines "binary" / "csv", the schema is sent as first block after "binary".
+bool binaryOutput = false;
+uint8_t block[LogFormat::BLOCK_MAX];
+uint16_t blockSeq = 0;
+char input[16];
+size_t inputLen = 0;
+
+void sendBlock(LogFormat::blockType_e type, const uint8_t *data, size_t len) {
+    memcpy(block + sizeof(LogFormat::blockHeader_t), data, len);
+    Serial.write(block, LogFormat::frameBlock(block, type, blockSeq++, len));
+}
+
+// Schema of the stream, same as the header of a log file
+void sendHeader() {
+    uint8_t buf[sizeof(LogFormat::flashEntryHeader_t) + sizeof(telemetry.logEntryDef)];
+    LogFormat::flashEntryHeader_t header = {
+        .magic = LogFormat::LOG_FILE_MAGIC,
+        .version = LogFormat::LOG_FILE_VERSION,
+        .headerSize = sizeof(buf),
+        .numLogEntryDefs = (uint16_t)telemetry.logEntryDef_num,
+    };
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), telemetry.logEntryDef, sizeof(telemetry.logEntryDef));
+    sendBlock(LogFormat::BLOCK_HEADER, buf, sizeof(buf));
+}
+
+void printCsvHeader() {
+    size_t len;
+    decoder.formatCsvHeader(line, sizeof(line), &len);
+    Serial.write((uint8_t*)line, len);
+}
+
+void handleInput() {
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == '\n') {
+            input[inputLen] = '\0';
+            if (strcmp(input, "binary") == 0) {
+                binaryOutput = true;
+                sendHeader();
+            } else if (strcmp(input, "csv") == 0) {
+                binaryOutput = false;
+                printCsvHeader();
+            }
+            inputLen = 0;
+        } else if (c != '\r' && inputLen < sizeof(input) - 1) {
+            input[inputLen++] = c;
+        }
+    }
+}
+
 
 void setup() {
 
@@ -20,10 +76,13 @@ void setup() {
     // for(int i = 0; i < sizeof(telemetry.logEntryDef)/sizeof(telemetry.logEntryDef[0]); i++) {
     //     Serial.println(telemetry.logEntryDef[i].multiplier == 0);
     // }
-    telemetry.printCsvHeader(telemetry.logEntryDef, telemetry.logEntryDef_num);
+    // received records are decoded with the schema of this firmware, same decoder as the dump command
+    decoder.setDefs(telemetry.logEntryDef, telemetry.logEntryDef_num);
+    printCsvHeader();
 }
 
 void loop() {
+    handleInput();
     while (radio.available()) {
         Radio::rcvPacket_t pkt = radio.getPacket();
         // TelemetryFS::printHex(pkt.data, pkt.dataLen);
@@ -35,7 +94,15 @@ void loop() {
         //     telemetry.get(pkt.data, "gps_lat"), 
         //     telemetry.get(pkt.data, "gps_lon")
         // );
-        if (pkt.dataLen == telemetry.logEntryBufSize)
-        telemetry.printCsvRecord(telemetry.logEntryDef, telemetry.logEntryDef_num, (char*)pkt.data);
+        if ((int)pkt.dataLen != decoder.recordSize()) {
+            continue;
+        }
+        if (binaryOutput) {
+            sendBlock(LogFormat::BLOCK_RECORDS, pkt.data, pkt.dataLen);     // one block per record, lowest latency
+        } else {
+            size_t len;
+            decoder.formatCsvRecord(line, sizeof(line), &len, pkt.data);
+            Serial.write((uint8_t*)line, len);
+        }
     }
 }
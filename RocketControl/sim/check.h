@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+// Helpers shared by the host checks (see checks.cpp)
+
+// Host time in seconds, for the throughput numbers of the benchmarks
+static double hostSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Deterministic pseudo random numbers (xorshift32), so every check sees the same data on every host
+class CheckRandom {
+    public:
+    CheckRandom(uint32_t seed) : _state(seed ? seed : 1) {}
+
+    uint32_t next() {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state;
+    }
+
+    // 0 .. n-1
+    uint32_t below(uint32_t n) {
+        return next() % n;
+    }
+
+    // 0 .. 1
+    double uniform() {
+        return next() / 4294967296.0;
+    }
+
+    protected:
+    uint32_t _state;
+};
+
+// Keeps the compiler from optimizing away the results of a benchmark loop
+template<typename T>
+static inline void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Number of heap allocations of the process (malloc, calloc, realloc, operator new), to check that code doesn't allocate
+// Not counted with the address sanitizer, it brings its own allocator.
+inline uint64_t checkAllocations = 0;
+
+#if defined(__SANITIZE_ADDRESS__)
+inline const bool checkAllocationsCounted = false;
+#else
+inline const bool checkAllocationsCounted = true;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t num, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size) {
+    checkAllocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t num, size_t size) {
+    checkAllocations++;
+    return __libc_calloc(num, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    checkAllocations++;
+    return __libc_realloc(ptr, size);
+}
+#endif
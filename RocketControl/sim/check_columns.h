@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vector>
+#include "check.h"
+#include "telemetry.h"
+#include "logdecoder.h"
+#include "check_decoder.h"
+
+// Batch columnar decoding (LogDecoder::decodeColumns() / decodeColumnRaw()): the columns of a generated flight have
+// to equal the per record decoding (LogDecoder::value(), Telemetry::get()) for every record and value, also with
+// a stride larger than the record and a record count that isn't a multiple of the chunk size.
+// Then benchmarks the columns against the per record access of the firmware.
+
+namespace columnsCheck {
+
+typedef struct {
+    uint32_t values;
+    uint32_t valueErrors;       // column differs from LogDecoder::value()
+    uint32_t getErrors;         // column differs from Telemetry::get(buf, idx, values)
+    uint32_t rawErrors;         // decodeColumnRaw<uint64_t>() of time_us differs from the stored bytes
+} counts_t;
+
+// Records of the flight packed stride bytes apart
+static std::vector<uint8_t> pack(const decoderCheck::log_t &log, size_t stride) {
+    std::vector<uint8_t> records(log.records.size() * stride, 0xa5);
+    for (size_t i = 0; i < log.records.size(); i++) {
+        memcpy(&records[i * stride], log.records[i].data(), log.recordSize);
+    }
+    return records;
+}
+
+static bool compare(LogDecoder &decoder, Telemetry &telem, const decoderCheck::log_t &log, size_t stride) {
+    size_t count = log.records.size();
+    std::vector<uint8_t> records = pack(log, stride);
+    int numColumns = decoder.numColumns();
+    std::vector<std::vector<float>> data(numColumns, std::vector<float>(count));
+    std::vector<float*> columns(numColumns);
+    for (int c = 0; c < numColumns; c++) {
+        columns[c] = data[c].data();
+    }
+    decoder.decodeColumns(records.data(), count, columns.data(), stride);
+
+    int timeColumn = decoder.columnIndex("time_us");
+    int timeField = decoder.fieldIndex("time_us");
+    std::vector<uint64_t> timeUs(count);
+    decoder.decodeColumnRaw(records.data(), count, timeColumn, timeUs.data(), stride);
+
+    counts_t counts = {0};
+    float values[4], telemValues[4];
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *record = &records[i * stride];
+        for (int c = 0; c < numColumns; c++) {
+            const LogDecoder::column_t &col = decoder.column(c);
+            int comp = c - decoder.columnIndex(decoder.defs()[col.field].name);
+            decoder.value(record, col.field, values);
+            telem.get(record, col.field, telemValues);
+            counts.values++;
+            // same conversion, so bit exact (NaN of a T_FLOAT field compares by its bits)
+            counts.valueErrors += memcmp(&data[c][i], &values[comp], sizeof(float)) != 0;
+            counts.getErrors += memcmp(&data[c][i], &telemValues[comp], sizeof(float)) != 0;
+        }
+        uint64_t raw;
+        memcpy(&raw, record + decoder.defs()[timeField]._offset, sizeof(raw));
+        counts.rawErrors += timeUs[i] != raw;
+    }
+
+    bool ok = timeColumn >= 0 && counts.valueErrors == 0 && counts.getErrors == 0 && counts.rawErrors == 0;
+    printf("{\"check\":\"columns\",\"records\":%zu,\"stride\":%zu,\"columns\":%d,\"values\":%u,\"value_errors\":%u,"
+           "\"get_errors\":%u,\"raw_errors\":%u,\"ok\":%s}\n",
+           count, stride, numColumns, counts.values, counts.valueErrors, counts.getErrors, counts.rawErrors,
+           ok ? "true" : "false");
+    return ok;
+}
+
+// Whole flight from memory: all columns at once against every field of every record via Telemetry::get()
+static void benchmark(LogDecoder &decoder, Telemetry &telem, const decoderCheck::log_t &log) {
+    const int rounds = 50;
+    size_t count = log.records.size();
+    std::vector<uint8_t> records = pack(log, log.recordSize);
+    int numColumns = decoder.numColumns();
+    std::vector<float> data(numColumns * count);
+    std::vector<float*> columns(numColumns);
+    for (int c = 0; c < numColumns; c++) {
+        columns[c] = &data[c * count];
+    }
+
+    double start = hostSeconds();
+    for (int r = 0; r < rounds; r++) {
+        decoder.decodeColumns(records.data(), count, columns.data());
+        keep(data[r]);
+    }
+    double columnsS = hostSeconds() - start;
+
+    // per record, first component only
+    std::vector<float> rows(numColumns * count);
+    start = hostSeconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            for (int idx = 0; idx < telem.logEntryDef_num; idx++) {
+                rows[i * numColumns + idx] = telem.get(&records[i * log.recordSize], idx);
+            }
+        }
+        keep(rows[r]);
+    }
+    double getS = hostSeconds() - start;
+
+    // per record, all components
+    start = hostSeconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            float *row = &rows[i * numColumns];
+            for (int idx = 0; idx < telem.logEntryDef_num; idx++) {
+                row += telem.get(&records[i * log.recordSize], idx, row);
+            }
+        }
+        keep(rows[r]);
+    }
+    double getValuesS = hostSeconds() - start;
+
+    double n = (double)count * rounds;
+    printf("{\"check\":\"columns_bench\",\"records\":%zu,\"values_per_record\":%d,\"columns_mrec_s\":%.1f,"
+           "\"get_mrec_s\":%.1f,\"get_values_mrec_s\":%.1f}\n",
+           count, numColumns, n / columnsS / 1e6, n / getS / 1e6, n / getValuesS / 1e6);
+}
+
+}
+
+static bool checkColumns() {
+    using namespace columnsCheck;
+    Telemetry *telem = &telemetry;
+    LogDecoder *decoder = new LogDecoder();
+    bool ok = decoder->setDefs(Telemetry::logEntryDef, telem->logEntryDef_num);
+    ok &= decoder->numColumns() == telem->numValues();
+
+    // a count that isn't a multiple of LogDecoder::COLUMN_CHUNK, then records with gaps between them
+    decoderCheck::log_t log = decoderCheck::makeFile(*telem, 5 * LogDecoder::COLUMN_CHUNK + 37);
+    ok &= compare(*decoder, *telem, log, log.recordSize);
+    ok &= compare(*decoder, *telem, log, log.recordSize + 5);
+
+    benchmark(*decoder, *telem, decoderCheck::makeFile(*telem, 20000));
+    delete decoder;
+    return ok;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "check.h"
+#include "console.h"
+
+// Console (console.h): feeds input lines through Serial into console.loop() and checks the dispatch, the argument
+// parsing, line editing, confirmations and jobs. Everything is run twice, the second pass must not allocate on the heap.
+
+namespace consoleCheck {
+
+static char output[1 << 16];
+static size_t outputPos = 0;
+static uint32_t argsCalls = 0, confirmCalls = 0, jobLines = 0;
+static bool argsOk = true;
+
+static void argsHandler(int argc, char **argv) {
+    int32_t i = 0;
+    float f = 0;
+    argsCalls++;
+    argsOk &= argc == 4 && Console::parseInt(argv[1], &i) && i == 12 && Console::parseFloat(argv[2], &f) && f == 3.5f &&
+              strcmp(argv[3], "quoted arg") == 0;
+    CONSOLE_UART.printf("args %d %d %.1f\n", argc, (int)i, f);
+}
+
+// One line per call, the virtual time advances so the job gets interrupted by the time budget of jobLoop()
+static bool job(char *line, size_t size, size_t *len) {
+    if (jobLines >= 200) {
+        return false;
+    }
+    *len = snprintf(line, size, "job line %u\n", (unsigned)jobLines++);
+    sim::kernel.advanceTo(sim::kernel.now() + 500);
+    return true;
+}
+
+static void registerCommands() {
+    console.addCommand({ "args", "<int> <float> <text>", "parses its arguments", 3, argsHandler });
+    console.addCommand({ "really", "", "asks for confirmation", 0, [](int argc, char **argv) {
+        console.confirm("Really?", []() { confirmCalls++; });
+    }});
+    console.addCommand({ "job", "", "prints 200 lines as job", 0, [](int argc, char **argv) {
+        jobLines = 0;
+        console.startJob(job);
+    }});
+}
+
+typedef struct {
+    const char *input;
+    const char *expect;     // in the output of the line
+    int loops;              // console.loop() calls after the input
+} step_t;
+
+static const step_t steps[] = {
+    { "help\n",                                 "prints this help", 1 },
+    { "nosuch\n",                               "Unknown command", 1 },
+    { "\n",                                     "", 1 },
+    { "args 12 3.5 \"quoted arg\"\n",           "args 4 12 3.5", 1 },
+    { "args\t12  3.5   \"quoted arg\"\r\n",     "args 4 12 3.5", 1 },
+    { "argx\b\bgs 12 0x\b3.5 \"quoted arg\"\n", "args 4 12 3.5", 1 },
+    { "args 12\n",                              "Usage: args <int> <float> <text>", 1 },
+    { "really\n",                               "Type \"yes\" to confirm", 1 },
+    { "yes\n",                                  "", 1 },
+    { "really\n",                               "Type \"yes\" to confirm", 1 },
+    { "no\n",                                   "Aborted.", 1 },
+    { "job\n",                                  "job line 0", 1 },
+    { "help\n",                                 "Busy", 1 },
+    { "",                                       "job line 199", 200 },
+    { "args 12 3.5 \"quoted arg\"\n",           "args 4 12 3.5", 1 },
+    { "job\n",                                  "job line 0", 1 },
+    { "cancel\n",                               "Cancelled.", 1 },
+    { "args 12 3.5 \"quoted arg\"\n",           "args 4 12 3.5", 1 },
+    { nullptr,                                  "Input line too long", 1 },      // 200 characters
+};
+
+// Runs all steps, returns the number of failed steps and the heap allocations during console.loop()
+static int runSteps(uint64_t *allocations) {
+    int failed = 0;
+    *allocations = 0;
+    for (const step_t &step : steps) {
+        if (step.input) {
+            sim::hw.consoleInput += step.input;
+        } else {
+            sim::hw.consoleInput.append(200, 'x');
+            sim::hw.consoleInput += "\n";
+        }
+        size_t start = outputPos;
+        for (int i = 0; i < step.loops; i++) {
+            uint64_t before = checkAllocations;
+            console.loop();
+            *allocations += checkAllocations - before;
+        }
+        fflush(sim::hw.console);
+        outputPos = ftell(sim::hw.console);
+        output[outputPos] = '\0';
+        if (!strstr(output + start, step.expect)) {
+            printf("{\"check\":\"console_step\",\"input\":\"%.20s\",\"expect\":\"%s\",\"ok\":false}\n",
+                   step.input ? step.input : "(long line)", step.expect);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+}
+
+static bool checkConsole() {
+    using namespace consoleCheck;
+    FILE *previous = sim::hw.console;
+    sim::hw.console = fmemopen(output, sizeof(output), "w");
+    sim::hw.consoleInput.reserve(1024);
+    registerCommands();
+
+    // first pass warms up the stdio buffers, only the second one has to be free of allocations
+    uint64_t warmupAllocations, allocations;
+    int failed = runSteps(&warmupAllocations);
+    fseek(sim::hw.console, 0, SEEK_SET);
+    outputPos = 0;
+    failed += runSteps(&allocations);
+
+    fclose(sim::hw.console);
+    sim::hw.console = previous;
+
+    bool ok = failed == 0 && allocations == 0 && argsOk && argsCalls == 10 && confirmCalls == 2;
+    printf("{\"check\":\"console\",\"steps\":%zu,\"failed_steps\":%d,\"allocations\":%llu,\"warmup_allocations\":%llu,"
+           "\"allocations_counted\":%s,\"handler_calls\":%u,\"confirmed\":%u,\"ok\":%s}\n",
+           sizeof(steps) / sizeof(steps[0]) * 2, failed, (unsigned long long)allocations,
+           (unsigned long long)warmupAllocations, checkAllocationsCounted ? "true" : "false", argsCalls, confirmCalls,
+           ok ? "true" : "false");
+    return ok;
+}
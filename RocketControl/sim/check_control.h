@@ -0,0 +1,184 @@
+#pragma once
+
+#include "check.h"
+#include "control.h"
+
+// Fin control (control.h) against a simulated plant: FinControl::step() runs at its rate on the virtual clock, gets
+// the attitude of the plant through imuPublishAttitude() and drives the plant with the commanded servo positions.
+// Plant per axis: angular acceleration = authority * fin deflection - damping * rate + disturbance,
+// the servos follow the commanded position with a first order lag, the IMU samples at 200 Hz with a latency.
+// Checks step response, disturbance rejection, roll damping, wrap around at +-180° and the fin mixing.
+
+namespace controlCheck {
+
+typedef struct {
+    float authority = 40;       // deg/s^2 per deg of fin deflection
+    float damping = 3;          // 1/s, aerodynamic damping
+    float servoLagS = 0.02;     // time constant of the servos
+    uint32_t imuIntervalUs = 5000;
+    uint32_t imuLatencyUs = 1000;   // sample to publish
+} plant_t;
+
+typedef struct {
+    const char *name;
+    float start[3];             // initial attitude (yaw, pitch, roll), deg
+    float startRate[3];         // deg/s
+    float setpoint[3];          // deg
+    float disturbance[3];       // deg/s^2, constant
+    int axis;                   // axis the metrics are taken from
+    float durationS;
+    // limits for a passing case
+    float maxOvershootPct;
+    float maxSettleS;           // error stays within the band after this time
+    float band;                 // deg
+    float maxOtherAxes;         // max deviation of the other axes from their setpoint, deg
+} case_t;
+
+typedef struct {
+    float overshootPct;
+    float settleS;
+    float finalError;           // max abs error in the last second
+    float otherAxes;
+    float finalRate;            // max abs rate of the axis in the last second
+} result_t;
+
+static float wrap(float deg) {
+    while (deg > 180) deg -= 360;
+    while (deg < -180) deg += 360;
+    return deg;
+}
+
+static result_t simulate(const case_t &c, const plant_t &plant) {
+    const uint32_t stepUs = 250;
+    const uint32_t controlUs = 1000000 / finControl.RATE_HZ;
+    float angle[3], rate[3], fin[FinControl::NUM_FINS];
+    for (int i = 0; i < 3; i++) {
+        angle[i] = c.start[i];
+        rate[i] = c.startRate[i];
+        finControl.setpoint[i] = c.setpoint[i];
+    }
+    for (int i = 0; i < FinControl::NUM_FINS; i++) {
+        fin[i] = 0;
+    }
+
+    // a sample in flight between the IMU and the control task
+    euler_t pending;
+    uint64_t pendingPublishUs = 0, pendingSampleUs = 0;
+    bool havePending = false;
+
+    uint64_t startUs = sim::kernel.now();
+    uint64_t endUs = startUs + (uint64_t)(c.durationS * 1e6);
+    uint64_t enableUs = startUs + 50000;        // a few cycles disabled, so the controller has seen the attitude
+    bool enabled = false;
+    float initialError = wrap(c.setpoint[c.axis] - c.start[c.axis]);
+    result_t result = {0, 0, 0, 0, 0};
+
+    finControl.enable(false);
+    for (uint64_t t = startUs; t < endUs; t += stepUs) {
+        sim::kernel.advanceTo(t);
+        uint64_t elapsed = t - startUs;
+
+        if (elapsed % plant.imuIntervalUs == 0 && !havePending) {
+            pending = { wrap(angle[0]), wrap(angle[1]), wrap(angle[2]) };
+            pendingSampleUs = t;
+            pendingPublishUs = t + plant.imuLatencyUs;
+            havePending = true;
+        }
+        if (havePending && t >= pendingPublishUs) {
+            imuPublishAttitude(&pending, (uint32_t)pendingSampleUs);
+            havePending = false;
+        }
+        if (!enabled && t >= enableUs) {
+            finControl.enable(true);
+            enabled = true;
+        }
+        if (elapsed % controlUs == 0) {
+            finControl.step();
+        }
+
+        // servos, then the effective deflection per axis (inverse of the mixing in FinControl::step())
+        uint8_t positions[FinControl::NUM_FINS];
+        finControl.getPositions(positions);
+        float dt = stepUs * 1e-6f;
+        for (int i = 0; i < FinControl::NUM_FINS; i++) {
+            fin[i] += ((positions[i] - finControl.FIN_CENTER) - fin[i]) * dt / (plant.servoLagS + dt);
+        }
+        float deflection[3] = {
+            (fin[0] - fin[2]) / 2,
+            (fin[1] - fin[3]) / 2,
+            (fin[0] + fin[1] + fin[2] + fin[3]) / 4,
+        };
+        for (int i = 0; i < 3; i++) {
+            rate[i] += (plant.authority * deflection[i] - plant.damping * rate[i] + c.disturbance[i]) * dt;
+            angle[i] += rate[i] * dt;
+        }
+
+        if (!enabled) {
+            continue;
+        }
+        float error = wrap(c.setpoint[c.axis] - angle[c.axis]);
+        if (initialError != 0 && error * initialError < 0) {
+            result.overshootPct = max(result.overshootPct, fabsf(error / initialError) * 100);
+        }
+        if (fabsf(error) > c.band) {
+            result.settleS = (t - enableUs) * 1e-6f;
+        }
+        if (t + 1000000 >= endUs) {
+            result.finalError = max(result.finalError, fabsf(error));
+            result.finalRate = max(result.finalRate, fabsf(rate[c.axis]));
+        }
+        for (int i = 0; i < 3; i++) {
+            if (i != c.axis) {
+                result.otherAxes = max(result.otherAxes, fabsf(wrap(c.setpoint[i] - angle[i])));
+            }
+        }
+    }
+    finControl.enable(false);
+    return result;
+}
+
+static bool run(const case_t &c, const plant_t &plant, const char *plantName) {
+    result_t r = simulate(c, plant);
+    bool ok = r.overshootPct <= c.maxOvershootPct && r.settleS <= c.maxSettleS && r.finalError <= c.band &&
+              r.otherAxes <= c.maxOtherAxes;
+    printf("{\"check\":\"control\",\"case\":\"%s\",\"plant\":\"%s\",\"overshoot_pct\":%.1f,\"settle_s\":%.2f,"
+           "\"final_error\":%.2f,\"final_rate\":%.2f,\"other_axes\":%.2f,\"ok\":%s}\n",
+           c.name, plantName, r.overshootPct, r.settleS, r.finalError, r.finalRate, r.otherAxes, ok ? "true" : "false");
+    return ok;
+}
+
+}
+
+static bool checkControl() {
+    using namespace controlCheck;
+    const case_t cases[] = {
+        // name              start         rate          setpoint      disturbance  axis  s   ovs%  settle band other
+        { "yaw-step",        {0, 0, 0},    {0, 0, 0},    {10, 0, 0},   {0, 0, 0},   0,    6,  40,   3,     0.5,  0.5 },
+        { "pitch-step",      {0, 0, 0},    {0, 0, 0},    {0, -10, 0},  {0, 0, 0},   1,    6,  40,   3,     0.5,  0.5 },
+        { "yaw-wrap",        {-170, 0, 0}, {0, 0, 0},    {170, 0, 0},  {0, 0, 0},   0,    6,  40,   3,     0.5,  0.5 },
+        { "pitch-gust",      {0, 0, 0},    {0, 0, 0},    {0, 0, 0},    {0, 20, 0},  1,    8,  100,  5,     0.5,  0.5 },
+        // roll has no integral part: servo positions are whole degrees, so errors below 0.5 / kp = 2.5° aren't corrected
+        { "roll-spin",       {0, 0, 0},    {0, 0, 180},  {0, 0, 0},    {0, 0, 0},   2,    6,  100,  4,     3,    0.5 },
+    };
+    plant_t nominal;
+    plant_t slow;                       // servos and IMU slower than expected
+    slow.servoLagS = 0.05;
+    slow.imuLatencyUs = 4000;
+    plant_t weak;                       // low airspeed
+    weak.authority = 10;
+    weak.damping = 1;
+
+    bool ok = true;
+    finControl.resetStats();
+    for (const case_t &c : cases) {
+        ok &= run(c, nominal, "nominal");
+        ok &= run(c, slow, "slow");
+    }
+    // at low airspeed the gains are too low for a fast response, it only has to stay stable
+    case_t weakStep = cases[0];
+    weakStep.maxOvershootPct = 60;
+    weakStep.maxSettleS = 10;
+    weakStep.durationS = 14;
+    ok &= run(weakStep, weak, "weak");
+    return ok;
+}
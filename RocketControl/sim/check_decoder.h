@@ -0,0 +1,316 @@
+#pragma once
+
+#include <vector>
+#include <unordered_set>
+#include <string>
+#include "check.h"
+#include "telemetry.h"
+#include "logdecoder.h"
+
+// Log decoder (logdecoder.h): fuzzes the file and the stream decoder with mutated and truncated flight logs,
+// read in random short pieces, and benchmarks the decoding of a whole flight.
+// The logs are generated with the schema of the firmware (Telemetry::logEntryDef[]) and the block layout of
+// the writer. Build with -fsanitize=address,undefined (env checks_asan) to catch memory errors.
+// Checked for every input: next() ends, no record or offset beyond the input, every record formats into a CSV line.
+// With an intact header every record has to be one of the original records (the block CRC rejects the rest), and
+// a single flipped bit may only cost the records of one block.
+
+namespace decoderCheck {
+
+typedef struct {
+    const uint8_t *data;
+    size_t size, pos;
+    CheckRandom *shortReads;        // nullptr: always as much as requested
+} reader_t;
+
+static size_t readMem(void *ctx, uint8_t *buf, size_t len) {
+    reader_t *r = (reader_t*)ctx;
+    size_t n = min(len, r->size - r->pos);
+    if (r->shortReads && n > 1 && r->shortReads->below(4) == 0) {
+        n = 1 + r->shortReads->below(n);
+    }
+    memcpy(buf, r->data + r->pos, n);
+    r->pos += n;
+    return n;
+}
+
+typedef struct {
+    std::vector<uint8_t> data;
+    size_t headerSize;
+    int recordSize;
+    int recordsPerBlock;
+    std::vector<std::string> records;       // all records, in order
+} log_t;
+
+static LogFormat::flashEntryHeader_t schemaHeader() {
+    return {
+        .magic = LogFormat::LOG_FILE_MAGIC,
+        .version = LogFormat::LOG_FILE_VERSION,
+        .headerSize = (uint16_t)(sizeof(LogFormat::flashEntryHeader_t) + sizeof(Telemetry::logEntryDef)),
+        .numLogEntryDefs = (uint16_t)(sizeof(Telemetry::logEntryDef) / sizeof(Telemetry::logEntryDef[0])),
+        .timeFlags = 0,
+        .openTimeUs = 0,
+        .utcOffsetUs = 0,
+    };
+}
+
+// Records of a flight at 200 Hz: smooth values in the range of every field, time_us set raw
+static std::vector<std::string> makeRecords(Telemetry &telem, int num) {
+    std::vector<std::string> records;
+    std::vector<float> values(telem.numValues());
+    std::vector<uint8_t> buf(telem.logEntryBufSize);
+    size_t timeOffset = 0;
+    for (int i = 0; i < telem.logEntryDef_num; i++) {
+        if (strcmp(Telemetry::logEntryDef[i].name, "time_us") == 0) {
+            timeOffset = Telemetry::logEntryDef[i]._offset;
+        }
+    }
+    for (int i = 0; i < num; i++) {
+        for (int v = 0; v < telem.numValues(); v++) {
+            values[v] = 50 + 40 * sinf(i * 0.01f + v);
+        }
+        telem.encode(values.data(), buf.data());
+        uint64_t timeUs = 20000000 + (uint64_t)i * 5000;
+        memcpy(&buf[timeOffset], &timeUs, sizeof(timeUs));
+        records.push_back(std::string((const char*)buf.data(), buf.size()));
+    }
+    return records;
+}
+
+// File as written by TelemetryFS: header, then blocks with as many whole records as fit, a time block now and then
+static log_t makeFile(Telemetry &telem, int numRecords) {
+    log_t log;
+    log.records = makeRecords(telem, numRecords);
+    log.recordSize = telem.logEntryBufSize;
+    log.recordsPerBlock = LogFormat::BLOCK_PAYLOAD / log.recordSize;
+
+    LogFormat::flashEntryHeader_t header = schemaHeader();
+    const uint8_t *h = (const uint8_t*)&header;
+    log.data.insert(log.data.end(), h, h + sizeof(header));
+    const uint8_t *d = (const uint8_t*)Telemetry::logEntryDef;
+    log.data.insert(log.data.end(), d, d + sizeof(Telemetry::logEntryDef));
+    log.headerSize = log.data.size();
+
+    uint8_t block[LogFormat::BLOCK_MAX];
+    uint8_t *payload = block + sizeof(LogFormat::blockHeader_t);
+    uint16_t seq = 0;
+    for (int i = 0; i < numRecords; i += log.recordsPerBlock) {
+        if (seq % 50 == 10) {
+            LogFormat::timeBlock_t time = { LogFormat::TIME_UTC_VALID, 1700000000000000LL + seq };
+            memcpy(payload, &time, sizeof(time));
+            size_t n = LogFormat::frameBlock(block, LogFormat::BLOCK_TIME, seq++, sizeof(time));
+            log.data.insert(log.data.end(), block, block + n);
+        }
+        int num = min(log.recordsPerBlock, numRecords - i);
+        for (int r = 0; r < num; r++) {
+            memcpy(payload + r * log.recordSize, log.records[i + r].data(), log.recordSize);
+        }
+        size_t n = LogFormat::frameBlock(block, LogFormat::BLOCK_RECORDS, seq++, num * log.recordSize);
+        log.data.insert(log.data.end(), block, block + n);
+    }
+    return log;
+}
+
+// Live stream as sent by the BaseStation: boot text, then one block per record, the schema every 100 records
+static log_t makeStream(Telemetry &telem, int numRecords) {
+    log_t log;
+    log.records = makeRecords(telem, numRecords);
+    log.recordSize = telem.logEntryBufSize;
+    log.recordsPerBlock = 1;
+    log.headerSize = 0;
+    const char *text = "RocketControl Receiver\n[Radio] init\n";
+    log.data.insert(log.data.end(), text, text + strlen(text));
+
+    uint8_t block[LogFormat::BLOCK_MAX];
+    uint8_t *payload = block + sizeof(LogFormat::blockHeader_t);
+    uint16_t seq = 0;
+    for (int i = 0; i < numRecords; i++) {
+        if (i % 100 == 0) {
+            LogFormat::flashEntryHeader_t header = schemaHeader();
+            memcpy(payload, &header, sizeof(header));
+            memcpy(payload + sizeof(header), Telemetry::logEntryDef, sizeof(Telemetry::logEntryDef));
+            size_t n = LogFormat::frameBlock(block, LogFormat::BLOCK_HEADER, seq++, header.headerSize);
+            log.data.insert(log.data.end(), block, block + n);
+        }
+        memcpy(payload, log.records[i].data(), log.recordSize);
+        size_t n = LogFormat::frameBlock(block, LogFormat::BLOCK_RECORDS, seq++, log.recordSize);
+        log.data.insert(log.data.end(), block, block + n);
+    }
+    return log;
+}
+
+typedef struct {
+    uint32_t inputs;
+    uint32_t decoded;           // inputs with a valid header / schema
+    uint64_t records;
+    uint32_t failures;          // inputs that broke an invariant
+} fuzzStats_t;
+
+typedef enum { MUT_FLIP_ONE, MUT_RANDOM, MUT_HEADER, MUT_TRUNCATE } mutation_e;
+
+// Mutates the input, returns the mutation that was applied
+static mutation_e mutate(std::vector<uint8_t> &data, size_t headerSize, CheckRandom &rnd) {
+    mutation_e mutation = (mutation_e)rnd.below(4);
+    switch (mutation) {
+        case MUT_FLIP_ONE: {
+            size_t pos = headerSize + rnd.below(data.size() - headerSize);
+            data[pos] ^= 1 << rnd.below(8);
+            break;
+        }
+        case MUT_RANDOM:
+            for (int n = 1 + rnd.below(8); n > 0; n--) {
+                size_t pos = rnd.below(data.size());
+                switch (rnd.below(3)) {
+                    case 0: data[pos] ^= 1 << rnd.below(8); break;
+                    case 1: data[pos] = rnd.next(); break;
+                    default:        // block lengths, counts and sizes with extreme values
+                        if (pos + 4 <= data.size()) {
+                            uint32_t v = rnd.below(2) ? 0xFFFFFFFF : rnd.next();
+                            memcpy(&data[pos], &v, 4);
+                        }
+                        break;
+                }
+            }
+            break;
+        case MUT_HEADER:
+            for (int n = 1 + rnd.below(4); n > 0; n--) {
+                size_t pos = rnd.below(min(data.size(), headerSize + 64));
+                data[pos] = rnd.below(2) ? rnd.next() : data[pos] ^ (1 << rnd.below(8));
+            }
+            break;
+        case MUT_TRUNCATE:
+            data.resize(rnd.below(data.size()));
+            break;
+    }
+    return mutation;
+}
+
+static bool fuzzOne(LogDecoder &decoder, const log_t &log, const std::unordered_set<std::string> &originals, bool stream,
+                    CheckRandom &rnd, fuzzStats_t &stats) {
+    std::vector<uint8_t> data = log.data;
+    mutation_e mutation = mutate(data, stream ? 0 : log.headerSize, rnd);
+    bool headerIntact = !stream && data.size() >= log.headerSize && memcmp(data.data(), log.data.data(), log.headerSize) == 0;
+
+    reader_t reader = { data.data(), data.size(), 0, &rnd };
+    stats.inputs++;
+    if (stream) {
+        decoder.beginStream(readMem, &reader);
+    } else if (!decoder.begin(readMem, &reader)) {
+        return !headerIntact;       // an intact header must be accepted
+    }
+
+    bool ok = true, decoded = !stream;
+    uint64_t records = 0, events = 0;
+    char line[Telemetry::CSV_LINE_SIZE];
+    float values[4];
+    LogDecoder::event_e event;
+    while ((event = decoder.next()) != LogDecoder::EV_END) {
+        if (++events > data.size() + 16) {
+            ok = false;             // more events than bytes: next() doesn't end
+            break;
+        }
+        if (event == LogDecoder::EV_HEADER) {
+            decoded = true;
+        }
+        if (event != LogDecoder::EV_RECORD) {
+            continue;
+        }
+        records++;
+        const uint8_t *record = decoder.record();
+        if (decoder.recordSize() <= 0 || decoder.recordSize() > LogDecoder::MAX_RECORD_SIZE) {
+            ok = false;
+        }
+        for (int i = 0; i < decoder.numDefs(); i++) {
+            decoder.value(record, i, values);
+        }
+        if (records <= 16) {        // formatting is slow, the first records show a broken schema as well
+            size_t len = 0;
+            decoder.formatCsvRecord(line, sizeof(line), &len, record);
+            ok &= len < sizeof(line);
+        }
+        // records of the original schema have to be original records, a CRC collision is practically impossible
+        if ((headerIntact || stream) && decoder.recordSize() == log.recordSize) {
+            ok &= originals.count(std::string((const char*)record, log.recordSize)) == 1;
+        }
+    }
+    ok &= decoder.validEnd() <= data.size();
+    ok &= decoder.skippedTotal() <= data.size();
+    // one flipped bit breaks at most one block
+    if (mutation == MUT_FLIP_ONE && !stream) {
+        ok &= records + log.recordsPerBlock >= log.records.size();
+    }
+    stats.decoded += decoded;
+    stats.records += records;
+    return ok;
+}
+
+static bool fuzz(const log_t &log, bool stream, int iterations, uint32_t seed) {
+    std::unordered_set<std::string> originals(log.records.begin(), log.records.end());
+    CheckRandom rnd(seed);
+    LogDecoder *decoder = new LogDecoder();     // ~3 KB, not on the stack
+    fuzzStats_t stats = {0};
+    for (int i = 0; i < iterations; i++) {
+        if (!fuzzOne(*decoder, log, originals, stream, rnd, stats)) {
+            if (stats.failures++ < 5) {
+                printf("{\"check\":\"decoder_fuzz_case\",\"input\":\"%s\",\"iteration\":%d,\"seed\":%u}\n",
+                       stream ? "stream" : "file", i, seed);
+            }
+        }
+    }
+    delete decoder;
+    printf("{\"check\":\"decoder_fuzz\",\"input\":\"%s\",\"inputs\":%u,\"decoded\":%u,\"records\":%llu,\"failures\":%u,\"ok\":%s}\n",
+           stream ? "stream" : "file", stats.inputs, stats.decoded, (unsigned long long)stats.records, stats.failures,
+           stats.failures == 0 ? "true" : "false");
+    return stats.failures == 0;
+}
+
+// Whole flight from memory: records only, with CSV formatting, and with short reads
+static bool benchmark(const log_t &log) {
+    LogDecoder *decoder = new LogDecoder();
+    char line[Telemetry::CSV_LINE_SIZE];
+    const int rounds[3] = { 100, 5, 100 };
+    double recordsPerS[3];
+    bool ok = true;
+    for (int mode = 0; mode < 3; mode++) {
+        CheckRandom rnd(38);
+        uint64_t records = 0;
+        double start = hostSeconds();
+        for (int r = 0; r < rounds[mode]; r++) {
+            reader_t reader = { log.data.data(), log.data.size(), 0, mode == 2 ? &rnd : nullptr };
+            decoder->begin(readMem, &reader);
+            LogDecoder::event_e event;
+            while ((event = decoder->next()) != LogDecoder::EV_END) {
+                if (event == LogDecoder::EV_RECORD) {
+                    records++;
+                    if (mode == 1) {
+                        size_t len = 0;
+                        decoder->formatCsvRecord(line, sizeof(line), &len, decoder->record());
+                        keep(line[0]);
+                    }
+                }
+            }
+            ok &= decoder->skippedTotal() == 0;
+        }
+        recordsPerS[mode] = records / (hostSeconds() - start);
+        ok &= records == (uint64_t)rounds[mode] * log.records.size();
+    }
+    delete decoder;
+    printf("{\"check\":\"decoder_bench\",\"records\":%zu,\"record_bytes\":%d,\"decode_mrec_s\":%.2f,\"decode_mb_s\":%.0f,"
+           "\"csv_mrec_s\":%.3f,\"short_reads_mrec_s\":%.2f,\"ok\":%s}\n",
+           log.records.size(), log.recordSize, recordsPerS[0] / 1e6, recordsPerS[0] * log.data.size() / log.records.size() / 1e6,
+           recordsPerS[1] / 1e6, recordsPerS[2] / 1e6, ok ? "true" : "false");
+    return ok;
+}
+
+}
+
+static bool checkDecoder() {
+    using namespace decoderCheck;
+    Telemetry *telem = &telemetry;
+    log_t file = makeFile(*telem, 600);
+    log_t stream = makeStream(*telem, 300);
+    bool ok = fuzz(file, false, 10000, 1);
+    ok &= fuzz(stream, true, 10000, 2);
+    ok &= benchmark(makeFile(*telem, 20000));
+    return ok;
+}
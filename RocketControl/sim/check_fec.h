@@ -0,0 +1,247 @@
+#pragma once
+
+#include <vector>
+#include "check.h"
+#include "fec.h"
+
+// FEC of the radio link (fec.h): encodes numbered payloads, drops frames on a simulated channel and checks that
+// every payload the decoder emits is intact. Bursts of up to M lost frames per group have to be rebuilt completely.
+// Prints the delivery rate per loss model and the encode / decode throughput.
+
+namespace fecCheck {
+
+typedef struct {
+    uint8_t buf[Fec::MAX_FRAME];
+    uint8_t len;
+} frame_t;
+
+typedef struct {
+    const char *name;
+    double lossPct;         // random loss: probability of a lost frame
+    bool burst;             // one burst of exactly M lost frames per group, at a random position
+    bool gilbert;           // Gilbert-Elliott channel: good / bad state, lossPct is the loss in the bad state
+} channel_t;
+
+typedef struct {
+    std::vector<bool> delivered;
+    uint32_t duplicates;
+    uint32_t corrupted;
+} receiver_t;
+
+// Payload seq: 4..240 bytes, starts with the sequence number, the rest is derived from it
+static size_t makePayload(uint32_t seq, uint8_t *buf) {
+    CheckRandom rnd(seq * 2654435761u + 1);
+    size_t len = 4 + rnd.below(Fec::MAX_PAYLOAD - 3);
+    memcpy(buf, &seq, 4);
+    for (size_t i = 4; i < len; i++) {
+        buf[i] = rnd.next();
+    }
+    return len;
+}
+
+static void collectFrame(const uint8_t *buf, size_t len, void *ctx) {
+    std::vector<frame_t> *frames = (std::vector<frame_t>*)ctx;
+    frame_t frame;
+    memcpy(frame.buf, buf, len);
+    frame.len = len;
+    frames->push_back(frame);
+}
+
+static void receivePayload(const uint8_t *buf, size_t len, void *ctx) {
+    receiver_t *rx = (receiver_t*)ctx;
+    uint32_t seq;
+    uint8_t expected[Fec::MAX_PAYLOAD];
+    if (len < 4) {
+        rx->corrupted++;
+        return;
+    }
+    memcpy(&seq, buf, 4);
+    if (seq >= rx->delivered.size()) {
+        return;     // padding group at the end
+    }
+    if (makePayload(seq, expected) != len || memcmp(expected, buf, len) != 0) {
+        rx->corrupted++;
+    } else if (rx->delivered[seq]) {
+        rx->duplicates++;
+    } else {
+        rx->delivered[seq] = true;
+    }
+}
+
+// Frames of num payloads plus one extra group, so the decoder finishes the last group of the payloads.
+// reconfigureEvery: configure() again before every n-th payload (0: never), as the fec command does while sending
+static std::vector<frame_t> encodeAll(int k, int m, uint32_t num, uint32_t reconfigureEvery = 0) {
+    std::vector<frame_t> frames;
+    Fec::Encoder encoder;
+    encoder.configure(k, m);
+    uint8_t payload[Fec::MAX_PAYLOAD];
+    uint32_t total = (num + k - 1) / k * k + k;
+    for (uint32_t seq = 0; seq < total; seq++) {
+        if (reconfigureEvery && seq % reconfigureEvery == reconfigureEvery - 1) {
+            encoder.configure(k, m);
+        }
+        size_t len = makePayload(seq, payload);
+        encoder.encode(payload, len, collectFrame, &frames);
+    }
+    return frames;
+}
+
+static bool run(int k, int m, const channel_t &channel, uint32_t num) {
+    std::vector<frame_t> frames = encodeAll(k, m, num);
+    CheckRandom rnd(k * 100 + m + 7);
+    receiver_t rx = { std::vector<bool>(num, false), 0, 0 };
+    Fec::Decoder decoder;
+
+    size_t groupSize = k + m;
+    size_t lastGroup = frames.size() - groupSize;       // the padding group is never lost
+    bool bad = false;
+    uint32_t lostFrames = 0;
+    for (size_t g = 0; g < frames.size(); g += groupSize) {
+        size_t burstStart = rnd.below(groupSize - m + 1);
+        for (size_t i = 0; i < groupSize; i++) {
+            bool lost = false;
+            if (g < lastGroup) {
+                if (channel.burst) {
+                    lost = i >= burstStart && i < burstStart + m;
+                } else if (channel.gilbert) {
+                    bad = bad ? rnd.uniform() >= 0.4 : rnd.uniform() < 0.02;
+                    lost = bad && rnd.uniform() < channel.lossPct / 100;
+                } else {
+                    lost = rnd.uniform() < channel.lossPct / 100;
+                }
+            }
+            if (lost) {
+                lostFrames++;
+                continue;
+            }
+            decoder.push(frames[g + i].buf, frames[g + i].len, receivePayload, &rx);
+        }
+    }
+
+    uint32_t delivered = 0;
+    for (bool d : rx.delivered) {
+        delivered += d;
+    }
+    Fec::stats_t stats = decoder.stats();
+    double frameLossPct = 100.0 * lostFrames / lastGroup;
+    // parity must never make things worse than the raw channel, bursts of up to M frames are always rebuilt
+    bool ok = rx.corrupted == 0 && rx.duplicates == 0 && (m == 0 || delivered >= num * (1 - frameLossPct / 100)) &&
+              (!channel.burst || m == 0 || delivered == num);
+    printf("{\"check\":\"fec\",\"k\":%d,\"m\":%d,\"channel\":\"%s\",\"frame_loss_pct\":%.2f,\"delivered_pct\":%.3f,"
+           "\"recovered\":%u,\"lost\":%u,\"corrupted\":%u,\"duplicates\":%u,\"ok\":%s}\n",
+           k, m, channel.name, frameLossPct, 100.0 * delivered / num, stats.recovered, stats.lost,
+           rx.corrupted, rx.duplicates, ok ? "true" : "false");
+    return ok;
+}
+
+// Encoder reconfigured with the same layout in the middle of every third group, random loss.
+// No payload may be corrupted (rebuilt from parity of two groups) or dropped as a duplicate.
+static bool runReconfigure(int k, int m, double lossPct, uint32_t num) {
+    std::vector<frame_t> frames = encodeAll(k, m, num, 2 * k + 3);
+    CheckRandom rnd(k * 100 + m + 11);
+    receiver_t rx = { std::vector<bool>(num, false), 0, 0 };
+    Fec::Decoder decoder;
+    uint32_t lostFrames = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (i + k + m < frames.size() && rnd.uniform() < lossPct / 100) {
+            lostFrames++;
+            continue;
+        }
+        decoder.push(frames[i].buf, frames[i].len, receivePayload, &rx);
+    }
+    decoder.flush(receivePayload, &rx);
+
+    uint32_t delivered = 0;
+    for (bool d : rx.delivered) {
+        delivered += d;
+    }
+    bool ok = rx.corrupted == 0 && rx.duplicates == 0 && (lossPct > 0 || delivered == num);
+    printf("{\"check\":\"fec\",\"k\":%d,\"m\":%d,\"channel\":\"reconfigure-random-%g\",\"frame_loss_pct\":%.2f,"
+           "\"delivered_pct\":%.3f,\"recovered\":%u,\"lost\":%u,\"corrupted\":%u,\"duplicates\":%u,\"ok\":%s}\n",
+           k, m, lossPct, 100.0 * lostFrames / frames.size(), 100.0 * delivered / num, decoder.stats().recovered,
+           decoder.stats().lost, rx.corrupted, rx.duplicates, ok ? "true" : "false");
+    return ok;
+}
+
+static void countPayload(const uint8_t *buf, size_t len, void *ctx) {
+    *(uint64_t*)ctx += len;
+}
+
+static void countFrame(const uint8_t *buf, size_t len, void *ctx) {
+    keep(buf[0]);
+}
+
+// Full size payloads, throughput of the payload bytes
+static void benchmark(int k, int m) {
+    const uint32_t num = 400000;
+    uint8_t payload[Fec::MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = i * 7;
+    }
+
+    Fec::Encoder encoder;
+    encoder.configure(k, m);
+    double start = hostSeconds();
+    for (uint32_t i = 0; i < num; i++) {
+        payload[0] = i;
+        encoder.encode(payload, sizeof(payload), countFrame, nullptr);
+    }
+    double encodeS = hostSeconds() - start;
+
+    std::vector<frame_t> frames;
+    frames.reserve(num / k * (k + m));
+    encoder.configure(k, m);
+    for (uint32_t i = 0; i < num; i++) {
+        encoder.encode(payload, sizeof(payload), collectFrame, &frames);
+    }
+
+    // without loss and with the first frame of every group lost (one rebuild per group)
+    double decodeS[2];
+    for (int lossy = 0; lossy < 2; lossy++) {
+        Fec::Decoder decoder;
+        uint64_t bytes = 0;
+        start = hostSeconds();
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (lossy && m && i % (k + m) == 0) {
+                continue;
+            }
+            decoder.push(frames[i].buf, frames[i].len, countPayload, &bytes);
+        }
+        decodeS[lossy] = hostSeconds() - start;
+        keep(bytes);
+    }
+
+    double mb = num * sizeof(payload) / 1e6;
+    printf("{\"check\":\"fec_bench\",\"k\":%d,\"m\":%d,\"payload\":%zu,\"encode_mb_s\":%.0f,\"decode_mb_s\":%.0f,"
+           "\"decode_rebuild_mb_s\":%.0f,\"encode_ns_frame\":%.0f,\"decode_ns_frame\":%.0f}\n",
+           k, m, sizeof(payload), mb / encodeS, mb / decodeS[0], mb / decodeS[1],
+           encodeS * 1e9 / num, decodeS[0] * 1e9 / frames.size());
+}
+
+}
+
+static bool checkFec() {
+    const fecCheck::channel_t channels[] = {
+        { "none", 0, false, false },
+        { "random-1", 1, false, false },
+        { "random-5", 5, false, false },
+        { "random-10", 10, false, false },
+        { "burst-m", 0, true, false },
+        { "gilbert", 80, false, true },
+    };
+    const int layouts[][2] = { {8, 2}, {4, 1}, {16, 4}, {8, 0} };
+
+    bool ok = true;
+    for (auto &layout : layouts) {
+        for (auto &channel : channels) {
+            ok &= fecCheck::run(layout[0], layout[1], channel, 50000);
+        }
+    }
+    for (double lossPct : { 0.0, 5.0 }) {
+        ok &= fecCheck::runReconfigure(8, 2, lossPct, 50000);
+        ok &= fecCheck::runReconfigure(4, 1, lossPct, 50000);
+    }
+    fecCheck::benchmark(8, 2);
+    fecCheck::benchmark(16, 4);
+    return ok;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <vector>
+#include "check.h"
+#include "telemetry.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Quantization of the telemetry fields (Telemetry::encode() / decode()): every component of every field of
+// Telemetry::logEntryDef[] gets the range edges of its type (rounding at +-0.5, the type limits, the float limits of
+// the 32 / 64 bit types, whole floats from 2^23 on, NaN, inf) and random values of all magnitudes.
+// The stored raw value and the clipped bit are compared with a double precision reference, the decoded value has
+// to be within half a step of the input. Then benchmarks encode / decode of whole records.
+
+namespace quantCheck {
+
+typedef struct {
+    double lo, hiExcl;      // range of the integer type (max + 1, exact as double), both 0 for T_FLOAT
+} range_t;
+
+static range_t typeRange(LogFormat::logEntryDef_type_e type) {
+    switch (type) {
+        case LogFormat::T_I8:        return { -128.0, 128.0 };
+        case LogFormat::T_U8:
+        case LogFormat::T_U8_VEC4:   return { 0.0, 256.0 };
+        case LogFormat::T_I16:
+        case LogFormat::T_I16_VEC3:  return { -32768.0, 32768.0 };
+        case LogFormat::T_U16:       return { 0.0, 65536.0 };
+        case LogFormat::T_I32:       return { -2147483648.0, 2147483648.0 };
+        case LogFormat::T_U32:       return { 0.0, 4294967296.0 };
+        case LogFormat::T_U64:       return { 0.0, 18446744073709551616.0 };
+        default:                     return { 0.0, 0.0 };
+    }
+}
+
+// Raw value of one component as double (exact for all types, T_U64 up to the precision of a float input)
+static double loadRaw(const uint8_t *src, LogFormat::logEntryDef_type_e type) {
+    switch (type) {
+        case LogFormat::T_I8:        return *(const int8_t*)src;
+        case LogFormat::T_U8:
+        case LogFormat::T_U8_VEC4:   return *src;
+        case LogFormat::T_I16:
+        case LogFormat::T_I16_VEC3:  { int16_t v; memcpy(&v, src, 2); return v; }
+        case LogFormat::T_U16:       { uint16_t v; memcpy(&v, src, 2); return v; }
+        case LogFormat::T_I32:       { int32_t v; memcpy(&v, src, 4); return v; }
+        case LogFormat::T_U32:       { uint32_t v; memcpy(&v, src, 4); return v; }
+        case LogFormat::T_U64:       { uint64_t v; memcpy(&v, src, 8); return (double)v; }
+        case LogFormat::T_FLOAT:     { float v; memcpy(&v, src, 4); return v; }
+        default:                     return NAN;
+    }
+}
+
+// Reference: round half up to the nearest integer, saturate, NaN stores 0
+static double reference(float product, const range_t &range, bool *clipped) {
+    if (product != product) {
+        *clipped = true;
+        return 0;
+    }
+    double r = floor((double)product + 0.5);
+    *clipped = r < range.lo || r >= range.hiExcl;
+    return r < range.lo ? range.lo : r >= range.hiExcl ? range.hiExcl - 1 : r;     // U64: max rounds to 2^64
+}
+
+typedef struct {
+    uint32_t cases;
+    uint32_t rawErrors;         // stored value differs from the reference
+    uint32_t clipErrors;        // clipped bit differs from the reference
+    uint32_t decodeErrors;      // decoded value not within half a step of the input
+} counts_t;
+
+// Encodes value into component comp of field idx (all other values 0) and compares with the reference
+static void checkValue(Telemetry &telem, int idx, int valueIdx, int comp, float value, counts_t &counts,
+                       std::vector<float> &values, std::vector<float> &decoded, uint8_t *buf) {
+    const LogFormat::logEntryDef_t &def = Telemetry::logEntryDef[idx];
+    std::fill(values.begin(), values.end(), 0.0f);
+    values[valueIdx + comp] = value;
+    uint32_t clippedMask = telem.encode(values.data(), buf);
+    telem.decode(buf, decoded.data());
+
+    float product = value * def.multiplier;
+    size_t compSize = def.type == LogFormat::T_I16_VEC3 ? 2 : def.type == LogFormat::T_U8_VEC4 ? 1 : def._size;
+    double raw = loadRaw(buf + def._offset + comp * compSize, def.type);
+    bool clipped = false;
+    double expected;
+    if (def.type == LogFormat::T_FLOAT) {
+        expected = product;
+    } else {
+        expected = reference(product, typeRange(def.type), &clipped);
+    }
+
+    counts.cases++;
+    if (raw != expected && !(raw != raw && expected != expected)) {
+        if (counts.rawErrors++ < 5) {
+            printf("{\"check\":\"quant_case\",\"field\":\"%s\",\"component\":%d,\"value\":%.9g,\"raw\":%.17g,\"expected\":%.17g}\n",
+                   def.name, comp, value, raw, expected);
+        }
+    }
+    if (((clippedMask >> idx) & 1) != clipped || (clippedMask & ~(1UL << idx)) != 0) {
+        counts.clipErrors++;
+    }
+    // the decoded value is the stored step, so within half a step of an unclipped input
+    if (!clipped && value == value && def.type != LogFormat::T_U64) {
+        float step = 1.0f / def.multiplier;
+        float tolerance = step * 0.5f * 1.0001f + fabsf(value) * 2e-7f;
+        if (def.type == LogFormat::T_FLOAT) {
+            tolerance = fabsf(value) * 2e-7f;
+        }
+        if (fabsf(decoded[valueIdx + comp] - value) > tolerance) {
+            counts.decodeErrors++;
+        }
+    }
+}
+
+// Inputs of a field: the products at the edges of its range, divided by the multiplier
+static std::vector<float> edgeValues(const LogFormat::logEntryDef_t &def) {
+    range_t range = typeRange(def.type);
+    std::vector<double> products = {
+        0, 0.25, 0.49999997, 0.5, 0.50000006, 1.5, 2.5, -0.25, -0.5, -0.50000006, -1.5, -2.5,
+        8388607, 8388608, 8388609, 8388611, 16777215, 16777216, 16777218, -8388609, -16777215,
+        2147483520.0, 2147483648.0, -2147483648.0, -2147483904.0, 4294967040.0, 4294967296.0,
+        18446742974197923840.0, 18446744073709551616.0, 1e30, -1e30,
+    };
+    for (double edge : { range.lo, range.hiExcl - 1 }) {
+        for (double d : { -1.0, -0.5, -0.49, 0.0, 0.49, 0.5, 1.0 }) {
+            products.push_back(edge + d);
+        }
+    }
+    std::vector<float> values;
+    for (double p : products) {
+        values.push_back((float)(p / def.multiplier));
+    }
+    values.push_back(INFINITY);
+    values.push_back(-INFINITY);
+    values.push_back(NAN);
+    return values;
+}
+
+static void benchmark(Telemetry &telem) {
+    const int numRecords = 1024, rounds = 400;
+    int numValues = telem.numValues();
+    std::vector<float> values(numRecords * numValues), decoded(numValues);
+    std::vector<uint8_t> records(numRecords * telem.logEntryBufSize);
+    CheckRandom rnd(36);
+    // decoded random records, so every value is in the range of its field
+    std::vector<uint8_t> raw(telem.logEntryBufSize);
+    for (int i = 0; i < numRecords; i++) {
+        for (uint8_t &b : raw) {
+            b = rnd.next();
+        }
+        telem.decode(raw.data(), &values[i * numValues]);
+    }
+    for (float &v : values) {
+        if (!isfinite(v) || fabsf(v) < 1e-30f) {
+            v = 0;      // random T_FLOAT bits: no NaN, inf or denormals
+        }
+    }
+
+    uint64_t cycles = 0;
+    double start = hostSeconds();
+#if defined(__x86_64__) || defined(__i386__)
+    cycles = __rdtsc();
+#endif
+    uint32_t clipped = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < numRecords; i++) {
+            clipped |= telem.encode(&values[i * numValues], &records[i * telem.logEntryBufSize]);
+        }
+        keep(records[0]);
+    }
+    double encodeS = hostSeconds() - start;
+#if defined(__x86_64__) || defined(__i386__)
+    cycles = __rdtsc() - cycles;
+#endif
+    keep(clipped);
+
+    start = hostSeconds();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < numRecords; i++) {
+            telem.decode(&records[i * telem.logEntryBufSize], decoded.data());
+            keep(decoded[0]);
+        }
+    }
+    double decodeS = hostSeconds() - start;
+
+    double n = (double)numRecords * rounds;
+    printf("{\"check\":\"quant_bench\",\"values_per_record\":%d,\"record_bytes\":%d,\"encode_ns_record\":%.1f,"
+           "\"encode_tsc_record\":%.0f,\"decode_ns_record\":%.1f}\n",
+           numValues, telem.logEntryBufSize, encodeS * 1e9 / n, cycles / n, decodeS * 1e9 / n);
+}
+
+}
+
+static bool checkQuant() {
+    using namespace quantCheck;
+    Telemetry *telem = &telemetry;
+    std::vector<float> values(telem->numValues()), decoded(telem->numValues());
+    std::vector<uint8_t> buf(telem->logEntryBufSize);
+    CheckRandom rnd(36);
+
+    bool ok = true;
+    int valueIdx = 0;
+    for (int idx = 0; idx < telem->logEntryDef_num; idx++) {
+        const LogFormat::logEntryDef_t &def = Telemetry::logEntryDef[idx];
+        counts_t counts = {0};
+        std::vector<float> inputs = edgeValues(def);
+        // random values of all magnitudes up to beyond the range, both signs
+        for (int i = 0; i < 20000; i++) {
+            float mantissa = rnd.uniform() * 2 - 1;
+            inputs.push_back(ldexpf(mantissa, (int)rnd.below(80) - 20));
+        }
+        int components = LogFormat::components(def.type);
+        for (int comp = 0; comp < components; comp++) {
+            for (float value : inputs) {
+                checkValue(*telem, idx, valueIdx, comp, value, counts, values, decoded, buf.data());
+            }
+        }
+        valueIdx += components;
+
+        bool fieldOk = counts.rawErrors == 0 && counts.clipErrors == 0 && counts.decodeErrors == 0;
+        printf("{\"check\":\"quant\",\"field\":\"%s\",\"type\":%d,\"multiplier\":%g,\"cases\":%u,\"raw_errors\":%u,"
+               "\"clip_errors\":%u,\"decode_errors\":%u,\"ok\":%s}\n",
+               def.name, def.type, def.multiplier, counts.cases, counts.rawErrors, counts.clipErrors,
+               counts.decodeErrors, fieldOk ? "true" : "false");
+        ok &= fieldOk;
+    }
+
+    benchmark(*telem);
+    return ok;
+}
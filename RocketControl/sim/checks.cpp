@@ -0,0 +1,70 @@
+// Host checks and benchmarks of single firmware modules
+// Unlike the simulator (sim.cpp) the modules run without setup() / loop(), driven directly by the checks.
+// Every check prints one JSON line per case or configuration and fails if the module doesn't behave as expected.
+// Benchmark numbers are host numbers, they compare implementations but don't predict the timing on the target.
+// Build: pio run -e checks, run: .pio/build/checks/program [<check> ...] (default: all)
+
+#include <Arduino.h>
+#include <string>
+
+#include "check_fec.h"
+#include "check_console.h"
+#include "check_control.h"
+#include "check_quant.h"
+#include "check_decoder.h"
+#include "check_columns.h"
+
+typedef struct {
+    const char *name;
+    const char *help;
+    bool (*fn)();
+} check_t;
+
+static const check_t checks[] = {
+    { "fec", "FEC delivery under random / burst loss, encode and decode throughput", checkFec },
+    { "console", "command dispatch, line editing, confirmations and jobs without heap allocations", checkConsole },
+    { "control", "fin control against a simulated plant: step response, disturbances, fin mixing", checkControl },
+    { "quant", "telemetry field quantization at the range edges, encode / decode per record", checkQuant },
+    { "decoder", "log decoder fuzzing (file and stream), decoding throughput", checkDecoder },
+    { "columns", "batch columnar decoding against the per record decoding, throughput", checkColumns },
+};
+
+static void printUsage() {
+    printf("Usage: program [<check> ...]\n"
+           "Runs the given checks (default: all), exit code 1 if one of them failed.\n");
+    for (const check_t &check : checks) {
+        printf("  %-12s %s\n", check.name, check.help);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<const check_t*> selected;
+    for (int i = 1; i < argc; i++) {
+        const check_t *found = nullptr;
+        for (const check_t &check : checks) {
+            if (strcmp(argv[i], check.name) == 0) {
+                found = &check;
+            }
+        }
+        if (!found) {
+            printUsage();
+            return 2;
+        }
+        selected.push_back(found);
+    }
+    if (selected.empty()) {
+        for (const check_t &check : checks) {
+            selected.push_back(&check);
+        }
+    }
+
+    int failed = 0;
+    for (const check_t *check : selected) {
+        double start = hostSeconds();
+        bool ok = check->fn();
+        fflush(stdout);
+        fprintf(stderr, "%-12s %s (%.1f s)\n", check->name, ok ? "ok" : "FAILED", hostSeconds() - start);
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// BME280 returning the simulated pressure / temperature, every read is charged with one burst read
+class Adafruit_Sensor {
+    public:
+    void printSensorDetails() {}
+};
+
+class Adafruit_BME280 {
+    public:
+    enum sensor_mode { MODE_SLEEP = 0, MODE_FORCED = 1, MODE_NORMAL = 3 };
+    enum sensor_sampling { SAMPLING_NONE, SAMPLING_X1, SAMPLING_X2, SAMPLING_X4, SAMPLING_X8, SAMPLING_X16 };
+    enum sensor_filter { FILTER_OFF, FILTER_X2, FILTER_X4, FILTER_X8, FILTER_X16 };
+    enum standby_duration { STANDBY_MS_0_5 = 0 };
+
+    bool begin(uint8_t addr = 0x77, TwoWire *wire = &Wire) { return true; }
+    uint32_t sensorID() { return 0x60; }
+    void setSampling(sensor_mode mode, sensor_sampling tempSampling, sensor_sampling pressSampling,
+                     sensor_sampling humSampling, sensor_filter filter, standby_duration duration) {}
+    Adafruit_Sensor *getPressureSensor() { return &_sensor; }
+
+    float readTemperature() {
+        sim::kernel.busy(sim::hw.bus.bmeReadUs, true);
+        return sim::sensors().temperature + sim::noise(0.05f);
+    }
+
+    float readPressure() {
+        sim::kernel.busy(sim::hw.bus.bmeReadUs, true);
+        return sim::sensors().pressure + sim::noise(2.0f);
+    }
+
+    protected:
+    Adafruit_Sensor _sensor;
+};
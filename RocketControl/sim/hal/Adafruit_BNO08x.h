@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// BNO08x sensor hub producing the enabled reports at their interval from the simulated state.
+// Reports that are not fetched in time get overwritten (visible as sequence number gaps).
+
+typedef uint8_t sh2_SensorId_t;
+
+enum {
+    SH2_ACCELEROMETER = 0x01,
+    SH2_GYROSCOPE_CALIBRATED = 0x02,
+    SH2_MAGNETIC_FIELD_CALIBRATED = 0x03,
+    SH2_LINEAR_ACCELERATION = 0x04,
+    SH2_ROTATION_VECTOR = 0x05,
+    SH2_GAME_ROTATION_VECTOR = 0x08,
+    SH2_ARVR_STABILIZED_RV = 0x28,
+    SH2_GYRO_INTEGRATED_RV = 0x2A,
+};
+
+typedef struct { float x, y, z; } sh2_Accelerometer_t;
+typedef struct { float x, y, z; } sh2_Gyroscope_t;
+typedef struct { float x, y, z; } sh2_MagneticField_t;
+typedef struct { float i, j, k, real, accuracy; } sh2_RotationVectorWAcc_t;
+typedef struct { float i, j, k, real; } sh2_RotationVector_t;
+typedef struct { float i, j, k, real, angVelX, angVelY, angVelZ; } sh2_GyroIntegratedRV_t;
+
+typedef struct {
+    uint8_t sensorId;
+    uint8_t sequence;
+    uint8_t status;
+    uint64_t timestamp;
+    uint32_t delay;
+    union {
+        sh2_Accelerometer_t accelerometer;
+        sh2_Accelerometer_t linearAcceleration;
+        sh2_Gyroscope_t gyroscope;
+        sh2_MagneticField_t magneticField;
+        sh2_RotationVectorWAcc_t rotationVector;
+        sh2_RotationVectorWAcc_t arvrStabilizedRV;
+        sh2_RotationVector_t gameRotationVector;
+        sh2_GyroIntegratedRV_t gyroIntegratedRV;
+    } un;
+} sh2_SensorValue_t;
+
+class Adafruit_BNO08x {
+    public:
+    static const int MAX_REPORTS = 8;
+
+    Adafruit_BNO08x(int8_t resetPin = -1) {}
+
+    bool begin_I2C(uint8_t addr = 0x4A, TwoWire *wire = &Wire, int32_t sensorId = 0) { return true; }
+    bool begin_UART(void *serial, int32_t sensorId = 0) { return false; }
+    bool begin_SPI(uint8_t csPin, uint8_t intPin, void *spi = nullptr, int32_t sensorId = 0) { return false; }
+    bool wasReset() { return false; }
+
+    bool enableReport(sh2_SensorId_t id, uint32_t intervalUs = 10000) {
+        report_t *report = find(id);
+        if (!report) {
+            if (_numReports >= MAX_REPORTS) {
+                return false;
+            }
+            report = &_reports[_numReports++];
+            *report = { id };
+        }
+        report->intervalUs = intervalUs;
+        report->nextUs = sim::kernel.now() + intervalUs;
+        return true;
+    }
+
+    bool getSensorEvent(sh2_SensorValue_t *value) {
+        uint64_t now = sim::kernel.now();
+        report_t *next = nullptr;
+        for (int i = 0; i < _numReports; i++) {
+            if (_reports[i].nextUs <= now && (!next || _reports[i].nextUs < next->nextUs)) {
+                next = &_reports[i];
+            }
+        }
+        sim::kernel.busy(sim::hw.bus.bnoEventUs, true);     // the host reads the SHTP header even if nothing is pending
+        if (!next) {
+            return false;
+        }
+
+        // only the latest sample of a report is kept
+        uint32_t missed = (now - next->nextUs) / next->intervalUs;
+        next->sequence += missed;
+        uint64_t sampleUs = next->nextUs + (uint64_t)missed * next->intervalUs;
+        next->nextUs = sampleUs + next->intervalUs;
+
+        const sim::sensorState_t &s = sim::sensors();
+        memset(value, 0, sizeof(*value));
+        value->sensorId = next->id;
+        value->sequence = next->sequence++;
+        value->timestamp = (uint32_t)sampleUs;     // host time base (micros())
+        value->status = 3;
+        switch (next->id) {
+            case SH2_ACCELEROMETER:
+                value->un.accelerometer = { s.accel[0] + sim::noise(0.05f), s.accel[1] + sim::noise(0.05f), s.accel[2] + sim::noise(0.05f) };
+                break;
+            case SH2_GYROSCOPE_CALIBRATED:
+                value->un.gyroscope = { s.gyro[0] + sim::noise(0.002f), s.gyro[1] + sim::noise(0.002f), s.gyro[2] + sim::noise(0.002f) };
+                break;
+            case SH2_MAGNETIC_FIELD_CALIBRATED:
+                value->un.magneticField = { s.magn[0] + sim::noise(0.3f), s.magn[1] + sim::noise(0.3f), s.magn[2] + sim::noise(0.3f) };
+                break;
+            case SH2_ARVR_STABILIZED_RV:
+            case SH2_ROTATION_VECTOR:
+                value->un.rotationVector = { s.quat[0], s.quat[1], s.quat[2], s.quat[3], 0.05f };
+                break;
+            case SH2_GYRO_INTEGRATED_RV:
+                value->un.gyroIntegratedRV = { s.quat[0], s.quat[1], s.quat[2], s.quat[3], s.gyro[0], s.gyro[1], s.gyro[2] };
+                break;
+        }
+        return true;
+    }
+
+    protected:
+    typedef struct {
+        sh2_SensorId_t id;
+        uint32_t intervalUs;
+        uint64_t nextUs;
+        uint8_t sequence;
+    } report_t;
+
+    report_t _reports[MAX_REPORTS];
+    int _numReports = 0;
+
+    report_t *find(sh2_SensorId_t id) {
+        for (int i = 0; i < _numReports; i++) {
+            if (_reports[i].id == id) {
+                return &_reports[i];
+            }
+        }
+        return nullptr;
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+// Host replacement of the Arduino-ESP32 core API used by the firmware (incl. the FreeRTOS parts it pulls in)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include "hw.h"
+
+using std::min;
+using std::max;
+using std::isnan;
+
+#define RAD_TO_DEG  57.295779513082320876798154814105
+#define DEG_TO_RAD  0.017453292519943295769236907684886
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define INPUT_PULLUP    0x05
+#define LOW             0x0
+#define HIGH            0x1
+#define RISING          0x01
+#define FALLING         0x02
+#define IRAM_ATTR
+#define F(s) (s)
+
+template<class T> T sq(T x) { return x * x; }
+template<class T, class L, class H> T constrain(T x, L low, H high) { return x < low ? low : (x > high ? high : x); }
+
+inline unsigned long micros() { return (uint32_t)sim::kernel.now(); }
+inline unsigned long millis() { return (uint32_t)(sim::kernel.now() / 1000); }
+inline void delay(uint32_t ms) { sim::kernel.sleep((uint64_t)ms * 1000); }
+inline void delayMicroseconds(uint32_t us) { sim::kernel.busy(us); }
+inline void yield() {}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t val) {}
+inline int digitalRead(uint8_t pin) { return HIGH; }     // I2C lines are never stuck in the simulation
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {}
+
+class String {
+    public:
+    String(const char *s = "") : _s(s) {}
+    String(const std::string &s) : _s(s) {}
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.size(); }
+    bool operator==(const char *s) const { return _s == s; }
+    String &operator+=(const String &s) { _s += s._s; return *this; }
+    String &operator+=(char c) { _s += c; return *this; }
+    protected:
+    std::string _s;
+};
+
+class Print {
+    public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            write(buf[i]);
+        }
+        return size;
+    }
+    size_t write(const char *buf, size_t size) { return write((const uint8_t*)buf, size); }
+
+    __attribute__((format(printf, 2, 3)))
+    size_t printf(const char *fmt, ...) {
+        char buf[512];
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        return len > 0 ? write((const uint8_t*)buf, min((size_t)len, sizeof(buf) - 1)) : 0;
+    }
+
+    size_t print(const char *s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long n, int base = 10) { return base == 16 ? printf("%lX", n) : printf("%ld", n); }
+    size_t print(int n, int base = 10) { return print((long)n, base); }
+    size_t print(unsigned long n, int base = 10) { return base == 16 ? printf("%lX", n) : printf("%lu", n); }
+    size_t print(unsigned int n, int base = 10) { return print((unsigned long)n, base); }
+    size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+    size_t println() { return print("\r\n"); }
+    template<class T> size_t println(T value) { return print(value) + println(); }
+    template<class T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print {
+    public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    size_t readBytes(char *buf, size_t len) {
+        size_t n = 0;
+        while (n < len && available()) {
+            buf[n++] = read();
+        }
+        return n;
+    }
+};
+
+// Serial: output goes to sim::hw.console, input comes from sim::hw.consoleInput
+// Other UARTs (GPS) never receive data, the GPS state is injected into TinyGPSPlus directly
+class HardwareSerial : public Stream {
+    public:
+    HardwareSerial(bool console) : _console(console) {}
+    void begin(unsigned long baud) {}
+    void setPins(int8_t rx, int8_t tx) {}
+    int available() override {
+        return _console ? sim::hw.consoleInput.size() : 0;
+    }
+    int read() override {
+        if (!available()) {
+            return -1;
+        }
+        uint8_t c = sim::hw.consoleInput[0];
+        sim::hw.consoleInput.erase(0, 1);
+        return c;
+    }
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+    size_t write(const uint8_t *buf, size_t size) override {
+        return _console ? fwrite(buf, 1, size, sim::hw.console) : size;
+    }
+    int availableForWrite() { return 128; }
+    void flush() { fflush(sim::hw.console); }
+    operator bool() { return true; }
+    protected:
+    bool _console;
+};
+
+inline HardwareSerial Serial(true);
+inline HardwareSerial Serial0(false);
+inline HardwareSerial Serial1(false);
+
+// FreeRTOS
+typedef sim::Kernel::task_t *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct { int unused; } portMUX_TYPE;
+
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define pdPASS                          1
+#define portMAX_DELAY                   0xFFFFFFFF
+#define portTICK_PERIOD_MS              1
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         (void)(mux)     // single core, no preemption inside tasks
+#define portEXIT_CRITICAL(mux)          (void)(mux)
+#define portENTER_CRITICAL_ISR(mux)     (void)(mux)
+#define portEXIT_CRITICAL_ISR(mux)      (void)(mux)
+
+inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *arg, int priority, TaskHandle_t *handle) {
+    TaskHandle_t task = sim::kernel.createTask(fn, name, arg, priority);
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    sim::kernel.sleep((uint64_t)ticks * 1000);
+}
+
+inline TickType_t xTaskGetTickCount() {
+    return millis();
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    sim::kernel.notifyGive(task);
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    return sim::kernel.notifyTake(clearOnExit, ticks == portMAX_DELAY ? UINT64_MAX : (uint64_t)ticks * 1000);
+}
+
+inline uint32_t ulTaskNotifyValueClear(TaskHandle_t task, uint32_t bits) {
+    uint32_t value = task->notify;
+    task->notify &= ~bits;
+    return value;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Arduino.h>
+
+class Servo {
+    public:
+    int attach(int pin) { return 1; }
+    void write(int angle) { _angle = angle; }
+    int read() { return _angle; }
+    protected:
+    int _angle = 90;
+};
+
+class ESP32PWM {
+    public:
+    static void allocateTimer(int timer) {}
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+#include <filesystem>
+
+// Arduino FS API backed by a host directory (sim::hw.fsRoot).
+// Writes are charged with the flash timing of sim::hw.flash: page programs when a page fills up or gets
+// flushed (partial pages are programmed again later), block erases when a file grows into a new block.
+// Written data reaches the host file right away, the size at the last flush / close is kept in sim::hw.syncedSize
+// for the power cut model (sim.cpp).
+
+#define FILE_READ       "r"
+#define FILE_WRITE      "w"
+#define FILE_APPEND     "a"
+
+namespace fs {
+
+class File : public Stream {
+    public:
+    File() {}
+
+    static File openFile(const std::string &hostPath, const std::string &path, const char *mode) {
+        File file;
+        const char *hostMode = mode[0] == 'a' ? "ab+" : mode[0] == 'w' ? "wb+" : mode[1] == '+' ? "rb+" : "rb";
+        FILE *f = fopen(hostPath.c_str(), hostMode);
+        if (f) {
+            file._file = std::shared_ptr<FILE>(f, fclose);
+            file._path = path;
+            file._hostPath = hostPath;
+            file._writable = mode[0] != 'r' || mode[1] == '+';
+            file._size = std::filesystem::file_size(hostPath);
+            if (mode[0] == 'a') {
+                fseek(f, 0, SEEK_END);
+            }
+        }
+        return file;
+    }
+
+    static File openDir(const std::string &hostPath, const std::string &path) {
+        File dir;
+        dir._path = path;
+        dir._isDir = true;
+        dir._entries = std::make_shared<std::vector<std::string>>();
+        for (auto &entry : std::filesystem::directory_iterator(hostPath)) {
+            dir._entries->push_back(entry.path().filename().string());
+        }
+        std::sort(dir._entries->begin(), dir._entries->end());
+        return dir;
+    }
+
+    explicit operator bool() const { return _file || _isDir; }
+    bool isDirectory() { return _isDir; }
+    const char *path() { return _path.c_str(); }
+    const char *name() {
+        size_t slash = _path.rfind('/');
+        return _path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override {
+        if (!_file || !_writable) {
+            return 0;
+        }
+        size_t written = fwrite(buf, 1, size, _file.get());
+        fflush(_file.get());
+        chargeWrite(written);
+        return written;
+    }
+
+    int available() override {
+        return _file ? (int)(size() - position()) : 0;
+    }
+    int read() override {
+        return _file ? fgetc(_file.get()) : -1;
+    }
+    size_t read(uint8_t *buf, size_t size) {
+        return _file ? fread(buf, 1, size, _file.get()) : 0;
+    }
+    size_t readBytes(char *buf, size_t size) {
+        return read((uint8_t*)buf, size);
+    }
+
+    bool seek(uint32_t pos) {
+        return _file && fseek(_file.get(), pos, SEEK_SET) == 0;
+    }
+    size_t position() {
+        return _file ? ftell(_file.get()) : 0;
+    }
+    size_t size() {
+        if (!_file) {
+            return 0;
+        }
+        long pos = ftell(_file.get());
+        fseek(_file.get(), 0, SEEK_END);
+        long end = ftell(_file.get());
+        fseek(_file.get(), pos, SEEK_SET);
+        return end;
+    }
+
+    void flush() {
+        if (!_file) {
+            return;
+        }
+        fflush(_file.get());
+        if (_writable) {
+            chargeFlush();
+            sim::hw.syncedSize[_hostPath] = size();
+        }
+    }
+
+    void close() {
+        if (_file && _writable && _file.use_count() == 1) {
+            chargeFlush();
+            sim::hw.syncedSize[_hostPath] = size();
+        }
+        _file.reset();
+        _entries.reset();
+        _isDir = false;
+    }
+
+    File openNextFile();
+
+    protected:
+    std::shared_ptr<FILE> _file;
+    std::string _path, _hostPath;
+    bool _isDir = false;
+    bool _writable = false;
+    std::shared_ptr<std::vector<std::string>> _entries;
+    size_t _entryIdx = 0;
+    size_t _size = 0;           // size for the block allocation model
+    size_t _pending = 0;        // bytes in the not yet full page
+
+    void chargeWrite(size_t len) {
+        sim::flashModel_t &flash = sim::hw.flash;
+        sim::flashStats_t &stats = sim::hw.flashStats;
+        uint64_t busyUs = 0;
+        size_t blocksBefore = (_size + flash.blockSize - 1) / flash.blockSize;
+        _size += len;
+        size_t blocksAfter = (_size + flash.blockSize - 1) / flash.blockSize;
+        busyUs += (uint64_t)(blocksAfter - blocksBefore) * flash.blockEraseUs;
+        stats.blocksErased += blocksAfter - blocksBefore;
+
+        _pending += len;
+        while (_pending >= flash.pageSize) {
+            _pending -= flash.pageSize;
+            busyUs += flash.pageProgramUs;
+            stats.bytesProgrammed += flash.pageSize;
+        }
+        stats.bytesWritten += len;
+        stats.busyUs += busyUs;
+        sim::kernel.busy(busyUs, flash.suspend);
+    }
+
+    void chargeFlush() {
+        sim::flashModel_t &flash = sim::hw.flash;
+        sim::flashStats_t &stats = sim::hw.flashStats;
+        uint64_t busyUs = flash.commitUs;
+        if (_pending > 0) {
+            busyUs += flash.pageProgramUs;
+            stats.bytesProgrammed += flash.pageSize;
+        }
+        stats.busyUs += busyUs;
+        sim::kernel.busy(busyUs, flash.suspend);
+    }
+};
+
+class FS {
+    public:
+    File open(const char *path, const char *mode = FILE_READ) {
+        std::string hostPath = hostPathOf(path);
+        if (std::filesystem::is_directory(hostPath)) {
+            return File::openDir(hostPath, path);
+        }
+        if (mode[0] == 'r' && !std::filesystem::exists(hostPath)) {
+            return File();
+        }
+        return File::openFile(hostPath, path, mode);
+    }
+    File open(const String &path, const char *mode = FILE_READ) { return open(path.c_str(), mode); }
+
+    bool exists(const char *path) { return std::filesystem::exists(hostPathOf(path)); }
+    bool mkdir(const char *path) { return std::filesystem::create_directories(hostPathOf(path)); }
+    bool remove(const char *path) { return std::filesystem::remove(hostPathOf(path)); }
+    bool rename(const char *from, const char *to) {
+        std::error_code err;
+        std::filesystem::rename(hostPathOf(from), hostPathOf(to), err);
+        return !err;
+    }
+
+    static std::string hostPathOf(const char *path) {
+        return sim::hw.fsRoot + (path[0] == '/' ? "" : "/") + path;
+    }
+};
+
+inline File File::openNextFile() {
+    if (!_isDir || !_entries || _entryIdx >= _entries->size()) {
+        return File();
+    }
+    std::string path = _path + (_path.back() == '/' ? "" : "/") + (*_entries)[_entryIdx++];
+    std::string hostPath = FS::hostPathOf(path.c_str());
+    if (std::filesystem::is_directory(hostPath)) {
+        return File::openDir(hostPath, path);
+    }
+    return File::openFile(hostPath, path, FILE_READ);
+}
+
+}
+
+using fs::File;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <FS.h>
+
+#define LITTLEFS_VFS_PATH   sim::hw.fsRoot.c_str()      // POSIX calls on the VFS go to the host directory
+#define LITTLEFS_FLASH_STATS                            // LittleFS.flashStats() is available (flash model, not on target)
+
+class LittleFSFS : public fs::FS {
+    public:
+    static const size_t PARTITION_SIZE = 0x2E0000;     // spiffs partition in partition.csv
+    static const size_t BLOCK_SIZE = 4096;
+
+    bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *label = "spiffs") {
+        std::filesystem::create_directories(sim::hw.fsRoot);
+        return true;
+    }
+
+    bool format() {
+        std::filesystem::remove_all(sim::hw.fsRoot);
+        std::filesystem::create_directories(sim::hw.fsRoot);
+        return true;
+    }
+
+    size_t totalBytes() {
+        return PARTITION_SIZE;
+    }
+
+    // Files occupy whole blocks, plus two metadata blocks per directory
+    size_t usedBytes() {
+        size_t used = 2 * BLOCK_SIZE;
+        for (auto &entry : std::filesystem::recursive_directory_iterator(sim::hw.fsRoot)) {
+            if (entry.is_directory()) {
+                used += 2 * BLOCK_SIZE;
+            } else {
+                used += (entry.file_size() + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+            }
+        }
+        return used;
+    }
+
+    // Counters of the flash model (sim::hw.flashStats) since the start
+    void flashStats(uint64_t *bytesProgrammed, uint32_t *blocksErased) {
+        *bytesProgrammed = sim::hw.flashStats.bytesProgrammed;
+        *blocksErased = sim::hw.flashStats.blocksErased;
+    }
+};
+
+inline LittleFSFS LittleFS;
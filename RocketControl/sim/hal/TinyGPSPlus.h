@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Arduino.h>
+
+// TinyGPSPlus with the same accessors as the library. No NMEA parsing, the simulator
+// injects fixes with simUpdate() at the navigation rate of the receiver.
+
+class TinyGPSField {
+    public:
+    bool isValid() const { return _valid; }
+    bool isUpdated() const { return _updated; }
+    uint32_t age() const { return _valid ? millis() - _updateMs : UINT32_MAX; }
+
+    protected:
+    bool _valid = false, _updated = false;
+    uint32_t _updateMs = 0;
+
+    void commit(bool valid) {
+        _valid = valid;
+        _updated = true;
+        _updateMs = millis();
+    }
+};
+
+class TinyGPSLocation : public TinyGPSField {
+    public:
+    double lat() { _updated = false; return _lat; }
+    double lng() { _updated = false; return _lng; }
+    void simSet(bool valid, double lat, double lng) { _lat = lat; _lng = lng; commit(valid); }
+    protected:
+    double _lat = 0, _lng = 0;
+};
+
+class TinyGPSAltitude : public TinyGPSField {
+    public:
+    double meters() { _updated = false; return _meters; }
+    void simSet(bool valid, double meters) { _meters = meters; commit(valid); }
+    protected:
+    double _meters = 0;
+};
+
+class TinyGPSInteger : public TinyGPSField {
+    public:
+    uint32_t value() { _updated = false; return _value; }
+    void simSet(bool valid, uint32_t value) { _value = value; commit(valid); }
+    protected:
+    uint32_t _value = 0;
+};
+
+class TinyGPSDate : public TinyGPSField {
+    public:
+    uint16_t year() { _updated = false; return _year; }
+    uint8_t month() { _updated = false; return _month; }
+    uint8_t day() { _updated = false; return _day; }
+    void simSet(bool valid, uint16_t year, uint8_t month, uint8_t day) { _year = year; _month = month; _day = day; commit(valid); }
+    protected:
+    uint16_t _year = 2000;
+    uint8_t _month = 1, _day = 1;
+};
+
+class TinyGPSTime : public TinyGPSField {
+    public:
+    uint8_t hour() { _updated = false; return _hour; }
+    uint8_t minute() { _updated = false; return _minute; }
+    uint8_t second() { _updated = false; return _second; }
+    uint8_t centisecond() { _updated = false; return _centisecond; }
+    void simSet(bool valid, uint8_t hour, uint8_t minute, uint8_t second, uint8_t centisecond) {
+        _hour = hour; _minute = minute; _second = second; _centisecond = centisecond;
+        commit(valid);
+    }
+    protected:
+    uint8_t _hour = 0, _minute = 0, _second = 0, _centisecond = 0;
+};
+
+class TinyGPSPlus {
+    public:
+    TinyGPSLocation location;
+    TinyGPSAltitude altitude;
+    TinyGPSInteger satellites;
+    TinyGPSDate date;
+    TinyGPSTime time;
+
+    bool encode(char c) { _chars++; return false; }
+    uint32_t charsProcessed() const { return _chars; }
+    uint32_t sentencesWithFix() const { return _fixes; }
+    uint32_t failedChecksum() const { return 0; }
+    uint32_t passedChecksum() const { return _sentences; }
+
+    // Inject one navigation solution (one RMC + GGA pair on the real receiver)
+    void simUpdate(bool fix, double lat, double lng, double altitude, uint8_t satellites, int64_t utcUs) {
+        int64_t seconds = utcUs / 1000000;
+        int64_t days = seconds / 86400;
+        int secOfDay = seconds % 86400;
+
+        // civil from days, see http://howardhinnant.github.io/date_algorithms.html
+        days += 719468;
+        int64_t era = days / 146097;
+        int doe = days - era * 146097;
+        int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int mp = (5 * doy + 2) / 153;
+        int day = doy - (153 * mp + 2) / 5 + 1;
+        int month = mp < 10 ? mp + 3 : mp - 9;
+        int year = yoe + era * 400 + (month <= 2);
+
+        date.simSet(true, year, month, day);
+        time.simSet(true, secOfDay / 3600, secOfDay / 60 % 60, secOfDay % 60, utcUs / 10000 % 100);
+        location.simSet(fix, lat, lng);
+        this->altitude.simSet(fix, altitude);
+        this->satellites.simSet(true, satellites);
+        _sentences += 2;
+        _fixes += fix ? 2 : 0;
+    }
+
+    protected:
+    uint32_t _chars = 0, _sentences = 0, _fixes = 0;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define WIFI_STA 1
+
+class WiFiClass {
+    public:
+    String macAddress() { return String("02:00:00:00:00:01"); }
+    bool mode(int mode) { return true; }
+    bool disconnect() { return true; }
+};
+
+inline WiFiClass WiFi;
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Arduino.h>
+
+// All simulated devices always acknowledge, bus time is charged by the device stubs
+class TwoWire {
+    public:
+    bool begin(int sda, int scl, uint32_t frequency = 0) { return true; }
+    bool end() { return true; }
+    void beginTransmission(uint8_t address) {}
+    uint8_t endTransmission(bool sendStop = true) { return 0; }
+};
+
+inline TwoWire Wire;
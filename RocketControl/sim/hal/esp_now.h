@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_wifi.h>
+
+// Sent packets are only counted (sim::hw.radio)
+
+typedef struct {
+    uint8_t peer_addr[6];
+    uint8_t channel;
+    bool encrypt;
+} esp_now_peer_info_t;
+
+typedef void (*esp_now_recv_cb_t)(const uint8_t *mac, const uint8_t *data, int len);
+
+inline esp_err_t esp_now_init() { return ESP_OK; }
+inline esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) { return ESP_OK; }
+inline esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) { return ESP_OK; }
+
+inline esp_err_t esp_now_send(const uint8_t *addr, const uint8_t *data, size_t len) {
+    sim::hw.radio.packets++;
+    sim::hw.radio.bytes += len;
+    return ESP_OK;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+typedef sim::Kernel::timer_t *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef int esp_err_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    int dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+inline int64_t esp_timer_get_time() {
+    return sim::kernel.now();
+}
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    *handle = sim::kernel.createTimer(args->name, args->callback, args->arg);
+    return 0;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    sim::kernel.startTimer(timer, period, true);
+    return 0;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout) {
+    sim::kernel.startTimer(timer, timeout, false);
+    return 0;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    timer->active = false;
+    return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define WIFI_IF_STA             0
+#define WIFI_PROTOCOL_LR        8
+#define WIFI_SECOND_CHAN_NONE   0
+#define ESP_ERROR_CHECK(x)      (void)(x)
+
+inline esp_err_t esp_wifi_set_protocol(int ifx, uint8_t protocol) { return ESP_OK; }
+inline esp_err_t esp_wifi_set_channel(uint8_t primary, int second) { return ESP_OK; }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <map>
+#include "kernel.h"
+
+// Simulated hardware, shared between the HAL stubs (sim/hal) and the flight models (model.h)
+namespace sim {
+
+// Physical state seen by the sensors, in the sensor frames
+typedef struct {
+    float accel[3];             // m/s^2, specific force (reads +9.81 on z at rest)
+    float gyro[3];              // rad/s
+    float magn[3];              // uT
+    float quat[4];              // orientation i, j, k, real
+    float pressure;             // Pa
+    float temperature;          // °C
+    bool gpsFix;
+    double lat, lon;            // deg
+    float gpsAltitude;          // m
+    uint8_t satellites;
+    int64_t utcUs;              // GPS time, us since the Unix epoch
+} sensorState_t;
+
+// Source of the sensor state (physics model or recorded flight)
+class Environment {
+    public:
+    virtual ~Environment() {}
+    // Bring the state up to the given virtual time
+    virtual void update(uint64_t us, sensorState_t &state) = 0;
+};
+
+// Approximate timing of the SPI NOR flash behind LittleFS, charged as busy time to the writing task
+typedef struct {
+    uint32_t pageSize = 256;
+    uint32_t blockSize = 4096;
+    uint32_t pageProgramUs = 700;       // per programmed page
+    uint32_t blockEraseUs = 45000;      // per newly allocated block
+    uint32_t commitUs = 1500;           // metadata update per flush / close
+    bool suspend = false;               // flash auto suspend (CONFIG_SPI_FLASH_AUTO_SUSPEND): other tasks run
+                                        // during erase / program, without it the whole CPU stalls (cache disabled)
+} flashModel_t;
+
+// Approximate I2C transaction times at 400 kHz
+typedef struct {
+    uint32_t bnoEventUs = 350;          // one sensor hub event (SHTP header + report)
+    uint32_t bmeReadUs = 250;           // one burst read of the BME280
+} busModel_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+} radioStats_t;
+
+typedef struct {
+    uint64_t bytesWritten;              // payload written by the firmware
+    uint64_t bytesProgrammed;           // pages programmed incl. partial pages on flush (write amplification)
+    uint32_t blocksErased;
+    uint64_t busyUs;                    // total flash time charged
+} flashStats_t;
+
+typedef struct {
+    sensorState_t state;
+    Environment *environment = nullptr;
+    flashModel_t flash;
+    busModel_t bus;
+    flashStats_t flashStats;
+    radioStats_t radio;
+    std::string fsRoot = "fs";          // host directory backing LittleFS
+    std::map<std::string, uint64_t> syncedSize;     // file size at the last flush / close, by host path
+    FILE *console = stdout;             // Serial output
+    std::string consoleInput;           // pending Serial input
+    uint32_t seed = 1;
+} hw_t;
+
+inline hw_t hw;
+
+inline const sensorState_t &sensors() {
+    if (hw.environment) {
+        hw.environment->update(kernel.now(), hw.state);
+    }
+    return hw.state;
+}
+
+// Deterministic noise source for the sensor stubs (xorshift + Box-Muller)
+inline float noise(float sigma) {
+    static uint32_t state = 0;
+    if (state == 0) {
+        state = hw.seed ? hw.seed * 2654435761u : 1;
+    }
+    auto next = []() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state & 0xFFFFFF) / 16777216.0f + 1e-7f;
+    };
+    float u1 = next(), u2 = next();
+    return sigma * sqrtf(-2 * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include <vector>
+
+// Deterministic single core emulation of the FreeRTOS / esp_timer parts used by the firmware.
+// Runs on a virtual clock: time only advances when a task blocks (delay, notify wait) or consumes
+// time via busy() (e.g. I2C transfers, flash writes in the HAL stubs). Tasks are coroutines (ucontext),
+// the highest priority ready task runs whenever the current one blocks or a timer makes a higher priority
+// task ready during preemptible busy time. Code between two such points runs atomically (like a critical section).
+namespace sim {
+
+typedef void (*taskFn_t)(void*);
+typedef void (*timerCb_t)(void*);
+
+class Kernel {
+    public:
+    static const size_t TASK_STACK_SIZE = 256 * 1024;      // host stacks need more than the target (printf, libc)
+
+    typedef struct task_t {
+        const char *name;
+        taskFn_t fn;
+        void *arg;
+        int priority;
+        ucontext_t ctx;
+        void *stack;
+        uint64_t wakeUs;        // blocked until this time (UINT64_MAX: no timeout)
+        bool waitNotify;        // blocked until notified
+        uint32_t notify;        // notification count
+        uint32_t switches;      // number of times the task was resumed
+    } task_t;
+
+    typedef struct {
+        const char *name;
+        timerCb_t callback;
+        void *arg;
+        uint64_t periodUs;      // 0: one shot
+        uint64_t nextUs;
+        bool active;
+        uint32_t fired;
+    } timer_t;
+
+    Kernel() {
+        _loopTask = { "loopTask", nullptr, nullptr, 1 };
+        _loopTask.wakeUs = 0;
+        _tasks.push_back(&_loopTask);
+        _current = &_loopTask;
+    }
+
+    uint64_t now() { return _nowUs; }
+
+    // Consume time in the current task. Timers still fire meanwhile, if preemptible a higher priority task that
+    // becomes ready runs first (e.g. the task waits for an I2C transfer), otherwise the CPU is blocked (flash operations).
+    void busy(uint64_t us, bool preemptible = false) {
+        uint64_t remaining = us;
+        while (remaining > 0) {
+            uint64_t next = nextTimerUs();
+            if (!preemptible || next >= _nowUs + remaining) {
+                advanceTo(_nowUs + remaining);
+                return;
+            }
+            remaining -= next - _nowUs;
+            advanceTo(next);
+            schedule();     // the current task stays ready, switches only if a higher priority task is ready now
+        }
+    }
+
+    // Block the current task for the given time, other tasks run meanwhile
+    void sleep(uint64_t us) {
+        _current->wakeUs = _nowUs + us;
+        schedule();
+    }
+
+    task_t *createTask(taskFn_t fn, const char *name, void *arg, int priority) {
+        task_t *task = new task_t();
+        *task = { name, fn, arg, priority };
+        task->wakeUs = 0;
+        task->stack = malloc(TASK_STACK_SIZE);
+        getcontext(&task->ctx);
+        task->ctx.uc_stack.ss_sp = task->stack;
+        task->ctx.uc_stack.ss_size = TASK_STACK_SIZE;
+        task->ctx.uc_link = nullptr;
+        makecontext(&task->ctx, (void (*)())trampoline, 0);
+        _tasks.push_back(task);
+        return task;
+    }
+
+    task_t *currentTask() { return _current; }
+
+    void notifyGive(task_t *task) {
+        task->notify++;
+    }
+
+    // Wait for a notification, returns the notification count (0 on timeout)
+    uint32_t notifyTake(bool clear, uint64_t timeoutUs) {
+        task_t *task = _current;
+        if (task->notify == 0) {
+            task->waitNotify = true;
+            task->wakeUs = timeoutUs == UINT64_MAX ? UINT64_MAX : _nowUs + timeoutUs;
+            schedule();
+            task->waitNotify = false;
+        }
+        uint32_t value = task->notify;
+        if (value > 0) {
+            task->notify = clear ? 0 : value - 1;
+        }
+        return value;
+    }
+
+    timer_t *createTimer(const char *name, timerCb_t callback, void *arg) {
+        timer_t *timer = new timer_t();
+        *timer = { name, callback, arg };
+        _timers.push_back(timer);
+        return timer;
+    }
+
+    void startTimer(timer_t *timer, uint64_t us, bool periodic) {
+        timer->periodUs = periodic ? us : 0;
+        timer->nextUs = _nowUs + us;
+        timer->active = true;
+    }
+
+    // Advance the clock, firing all timers that become due on the way (in the context of the current task)
+    void advanceTo(uint64_t us) {
+        while (true) {
+            timer_t *next = nullptr;
+            for (timer_t *timer : _timers) {
+                if (timer->active && timer->nextUs <= us && (!next || timer->nextUs < next->nextUs)) {
+                    next = timer;
+                }
+            }
+            if (!next) {
+                break;
+            }
+            _nowUs = next->nextUs > _nowUs ? next->nextUs : _nowUs;
+            if (next->periodUs) {
+                next->nextUs += next->periodUs;
+            } else {
+                next->active = false;
+            }
+            next->fired++;
+            next->callback(next->arg);
+        }
+        if (us > _nowUs) {
+            _nowUs = us;
+        }
+    }
+
+    const std::vector<task_t*> &tasks() { return _tasks; }
+
+    protected:
+    uint64_t _nowUs = 0;
+    task_t _loopTask;
+    task_t *_current;
+    std::vector<task_t*> _tasks;
+    std::vector<timer_t*> _timers;
+
+    uint64_t nextTimerUs() {
+        uint64_t next = UINT64_MAX;
+        for (timer_t *timer : _timers) {
+            if (timer->active && timer->nextUs < next) {
+                next = timer->nextUs;
+            }
+        }
+        return next;
+    }
+
+    bool ready(task_t *task) {
+        if (task->waitNotify && task->notify > 0) {
+            return true;
+        }
+        return task->wakeUs <= _nowUs;
+    }
+
+    // Switch to the highest priority ready task, advances the clock if no task is ready
+    void schedule() {
+        while (true) {
+            task_t *next = nullptr;
+            for (task_t *task : _tasks) {
+                if (ready(task) && (!next || task->priority > next->priority)) {
+                    next = task;
+                }
+            }
+            if (next) {
+                if (next != _current) {
+                    task_t *prev = _current;
+                    _current = next;
+                    next->switches++;
+                    swapcontext(&prev->ctx, &next->ctx);
+                }
+                return;
+            }
+
+            uint64_t wake = UINT64_MAX;
+            for (task_t *task : _tasks) {
+                wake = task->wakeUs < wake ? task->wakeUs : wake;
+            }
+            uint64_t nextTimer = nextTimerUs();
+            wake = nextTimer < wake ? nextTimer : wake;
+            if (wake == UINT64_MAX) {
+                abort();    // all tasks wait forever
+            }
+            advanceTo(wake);
+        }
+    }
+
+    static void trampoline();
+};
+
+inline Kernel kernel;
+
+inline void Kernel::trampoline() {
+    task_t *task = kernel._current;
+    task->fn(task->arg);
+    // FreeRTOS tasks must not return, park it
+    task->wakeUs = UINT64_MAX;
+    kernel.schedule();
+}
+
+}
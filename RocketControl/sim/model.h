@@ -0,0 +1,270 @@
+#pragma once
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "hw.h"
+#include "telemetry.h"
+
+namespace sim {
+
+const float GRAVITY = 9.80665f;
+
+// Barometric formula, inverse of the altitude calculation in bme.h
+inline float pressureAt(float altitude) {
+    return 101325.0f * powf(1.0f - altitude / 44330.0f, 1.0f / 0.1903f);
+}
+
+// Vertical (1-D) flight: motor burn, coast, parachute descent. The rocket stays upright, so the
+// specific force is measured on the z axis of the IMU only.
+class BallisticModel : public Environment {
+    public:
+    typedef struct {
+        float massKg = 1.5;
+        float thrustN = 80;
+        float burnS = 1.6;
+        float dragArea = 0.003;         // Cd * A of the rocket, m^2
+        float chuteArea = 0.35;         // Cd * A of the parachute, m^2
+        float chuteDelayS = 1.0;        // parachute opens this long after apogee
+        float igniteS = 20;             // time of ignition (virtual time since boot)
+        float padAltitude = 400;        // m above sea level
+        float padTemperature = 15;      // °C
+        double lat = 47.3769, lon = 8.5417;
+        float gpsFixS = 3;              // time to first fix
+        int64_t utcStartUs = 1790000000LL * 1000000;    // UTC at boot
+    } params_t;
+
+    // Flight events of the model, in virtual us (0: did not happen yet)
+    typedef struct {
+        uint64_t liftoffUs, burnoutUs, apogeeUs, chuteUs, landingUs;
+        float apogeeM;                  // above the pad
+        float maxVelocity;
+    } truth_t;
+
+    params_t params;
+    truth_t truth = {0};
+
+    BallisticModel(params_t params) : params(params) {}
+
+    void update(uint64_t us, sensorState_t &s) override {
+        while (_t + STEP_US <= us) {
+            step();
+        }
+
+        float thrust = burning() ? params.thrustN : 0;
+        float specificForce = _onGround ? GRAVITY : (thrust - drag()) / params.massKg;
+        float altitude = params.padAltitude + _height;
+
+        s.accel[0] = 0;
+        s.accel[1] = 0;
+        s.accel[2] = specificForce;
+        s.gyro[0] = s.gyro[1] = s.gyro[2] = 0;
+        s.magn[0] = 20;
+        s.magn[1] = 0;
+        s.magn[2] = -43;
+        s.quat[0] = s.quat[1] = s.quat[2] = 0;
+        s.quat[3] = 1;
+        s.pressure = pressureAt(altitude);
+        s.temperature = params.padTemperature - 0.0065f * _height;
+        s.gpsFix = _t >= params.gpsFixS * 1e6;
+        s.lat = params.lat;
+        s.lon = params.lon;
+        s.gpsAltitude = altitude;
+        s.satellites = s.gpsFix ? 9 : 3;
+        s.utcUs = params.utcStartUs + _t;
+    }
+
+    // Landed for the given time
+    bool finished(uint64_t afterLandingUs) {
+        return truth.landingUs && _t >= truth.landingUs + afterLandingUs;
+    }
+
+    protected:
+    static const uint32_t STEP_US = 1000;
+    uint64_t _t = 0;
+    float _height = 0, _velocity = 0;
+    bool _onGround = true;
+
+    bool burning() {
+        return truth.liftoffUs && _t < params.igniteS * 1e6 + params.burnS * 1e6;
+    }
+
+    float drag() {
+        float rho = 1.225f * expf(-(params.padAltitude + _height) / 8500.0f);
+        float area = params.dragArea + (truth.chuteUs ? params.chuteArea : 0);
+        return 0.5f * rho * area * _velocity * fabsf(_velocity);
+    }
+
+    void step() {
+        _t += STEP_US;
+        float dt = STEP_US * 1e-6f;
+        if (!truth.liftoffUs && _t >= params.igniteS * 1e6) {
+            truth.liftoffUs = _t;
+        }
+        if (truth.landingUs || !truth.liftoffUs) {
+            return;
+        }
+
+        bool wasBurning = burning();
+        float thrust = wasBurning ? params.thrustN : 0;
+        float accel = (thrust - drag()) / params.massKg - GRAVITY;
+        if (_onGround && accel <= 0) {
+            return;     // thrust does not lift the rocket yet
+        }
+        _onGround = false;
+        _velocity += accel * dt;
+        _height += _velocity * dt;
+        truth.maxVelocity = max(truth.maxVelocity, _velocity);
+
+        if (!wasBurning && !truth.burnoutUs) {
+            truth.burnoutUs = _t;
+        }
+        if (!truth.apogeeUs && _velocity < 0) {
+            truth.apogeeUs = _t;
+            truth.apogeeM = _height;
+        }
+        if (truth.apogeeUs && !truth.chuteUs && _t >= truth.apogeeUs + params.chuteDelayS * 1e6) {
+            truth.chuteUs = _t;
+        }
+        if (_height <= 0 && truth.apogeeUs) {
+            _height = 0;
+            _velocity = 0;
+            _onGround = true;
+            truth.landingUs = _t;
+        }
+    }
+};
+
+// Replays the sensor values of a recorded telemetry file (sample and hold between records)
+class ReplayModel : public Environment {
+    public:
+    // startUs: virtual time at which the first record gets replayed
+    bool load(const char *path, uint64_t startUs) {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            return false;
+        }
+        // same decoder as the dump command, invalid blocks and partial records are skipped
+        std::vector<uint8_t> records;
+        if (_decoder.begin(fileReader, f)) {
+            while (LogDecoder::event_e event = _decoder.next()) {
+                if (event == LogDecoder::EV_RECORD) {
+                    records.insert(records.end(), _decoder.record(), _decoder.record() + _decoder.recordSize());
+                }
+            }
+        }
+        fclose(f);
+        if (_decoder.error() != LogDecoder::ERR_NONE) {
+            return false;
+        }
+        _numRecords = records.size() / _decoder.recordSize();
+
+        // decoded once into columns, update() only indexes them
+        _values.resize((size_t)_decoder.numColumns() * _numRecords);
+        std::vector<float*> columns(_decoder.numColumns());
+        for (int c = 0; c < _decoder.numColumns(); c++) {
+            columns[c] = _values.data() + (size_t)c * _numRecords;
+        }
+        _decoder.decodeColumns(records.data(), _numRecords, columns.data());
+        _timeUs.resize(_numRecords);
+        if (_decoder.columnIndex("time_us") >= 0) {
+            _decoder.decodeColumnRaw(records.data(), _numRecords, _decoder.columnIndex("time_us"), _timeUs.data());
+        } else if (_decoder.columnIndex("millis") >= 0) {
+            _decoder.decodeColumnRaw(records.data(), _numRecords, _decoder.columnIndex("millis"), _timeUs.data());
+            for (auto &t : _timeUs) {
+                t *= 1000;
+            }
+        } else {
+            for (uint32_t i = 0; i < _numRecords; i++) {
+                _timeUs[i] = (int64_t)i * 100000;
+            }
+        }
+        _startUs = startUs;
+        return _numRecords > 0;
+    }
+
+    uint32_t numRecords() { return _numRecords; }
+
+    bool finished(uint64_t us) {
+        return _numRecords == 0 || us >= _startUs + recordTimeUs(_numRecords - 1) - recordTimeUs(0);
+    }
+
+    void update(uint64_t us, sensorState_t &s) override {
+        int64_t fileUs = recordTimeUs(0) + (int64_t)us - (int64_t)_startUs;
+        while (_idx + 1 < _numRecords && recordTimeUs(_idx + 1) <= fileUs) {
+            _idx++;
+        }
+
+        float v[4];
+        if (value("accel", v) == 3) {
+            memcpy(s.accel, v, sizeof(s.accel));
+        }
+        if (value("gyro", v) == 3) {
+            for (int i = 0; i < 3; i++) {
+                s.gyro[i] = v[i] * DEG_TO_RAD;
+            }
+        }
+        if (value("magn", v) == 3) {
+            memcpy(s.magn, v, sizeof(s.magn));
+        }
+        if (value("rotation", v) == 3) {
+            eulerToQuat(v[0] * DEG_TO_RAD, v[1] * DEG_TO_RAD, v[2] * DEG_TO_RAD, s.quat);
+        }
+        if (value("height", v) == 1) {
+            s.pressure = pressureAt(v[0]);
+        }
+        if (value("temp_c", v) == 1) {
+            s.temperature = v[0];
+        }
+        if (value("gps_lat", v) == 1 && v[0] != 0) {
+            s.gpsFix = true;
+            s.lat = v[0];
+            value("gps_lon", v);
+            s.lon = v[0];
+            value("gps_alt", v);
+            s.gpsAltitude = v[0];
+            value("gps_SV", v);
+            s.satellites = v[0];
+        }
+    }
+
+    protected:
+    LogDecoder _decoder;
+    std::vector<float> _values;         // column c of record i at c * _numRecords + i
+    std::vector<int64_t> _timeUs;
+    uint32_t _numRecords = 0, _idx = 0;
+    uint64_t _startUs = 0;
+
+    static size_t fileReader(void *ctx, uint8_t *buf, size_t len) {
+        return fread(buf, 1, len, (FILE*)ctx);
+    }
+
+    // All components of a field of the current record, returns the number of components (0: not in the file)
+    int value(const char *name, float *values) {
+        int col = _decoder.columnIndex(name);
+        if (col < 0) {
+            return 0;
+        }
+        int n = LogFormat::components(_decoder.defs()[_decoder.column(col).field].type);
+        for (int j = 0; j < n; j++) {
+            values[j] = _values[(size_t)(col + j) * _numRecords + _idx];
+        }
+        return n;
+    }
+
+    int64_t recordTimeUs(uint32_t idx) {
+        return _timeUs[idx];
+    }
+
+    static void eulerToQuat(float yaw, float pitch, float roll, float *q) {
+        float cy = cosf(yaw / 2), sy = sinf(yaw / 2);
+        float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+        float cr = cosf(roll / 2), sr = sinf(roll / 2);
+        q[0] = sr * cp * cy - cr * sp * sy;     // i
+        q[1] = cr * sp * cy + sr * cp * sy;     // j
+        q[2] = cr * cp * sy - sr * sp * cy;     // k
+        q[3] = cr * cp * cy + sr * sp * sy;     // real
+    }
+};
+
+}
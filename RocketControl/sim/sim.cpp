@@ -0,0 +1,377 @@
+// Software in the loop runner
+// Runs the unmodified firmware (setup() / loop() of src/main.cpp incl. all tasks and timers) on the virtual
+// clock of kernel.h against a flight model and writes the produced log files plus a timing report per run.
+// Build: pio run -e sim, run: .pio/build/sim/program --help
+// Each run is a separate process (fork), so the firmware globals start fresh and runs can execute in parallel.
+
+#include <Arduino.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include "../src/main.cpp"
+#include "model.h"
+
+typedef struct {
+    uint64_t atUs;
+    std::string line;
+} simCommand_t;
+
+typedef struct {
+    const char *replayFile = nullptr;       // replay a recorded flight instead of the ballistic model
+    uint32_t seed = 1;
+    int runs = 1;
+    int jobs = 1;
+    float maxDurationS = 300;
+    float afterLandingS = 10;               // keep running this long after the landing
+    float igniteS = 0;                      // ignition time of the ballistic model (0: model default)
+    uint32_t loopUs = 200;                  // virtual time consumed by one loop() iteration
+    float cpuScale = 0;                     // additionally consume host time * cpuScale (0: deterministic)
+    float varyPct = 10;                     // random variation of the model parameters between runs
+    uint32_t maxTriggerMs = 500;            // max launch detection delay for a passing run
+    bool capture = true;                    // enable capture mode (launch detection) after boot
+    bool verbose = false;                   // console output to stdout instead of console.log
+    bool powerCut = false;                  // cut the power at a random time after the ignition and boot again
+    std::string outDir = "sim_out";
+    std::vector<simCommand_t> commands;
+} simOptions_t;
+
+// Percentile of unsorted values (sorts in place)
+static uint32_t percentile(std::vector<uint32_t> &values, float p) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t idx = min(values.size() - 1, (size_t)(p / 100 * values.size()));
+    std::nth_element(values.begin(), values.begin() + idx, values.end());
+    return values[idx];
+}
+
+static uint64_t directorySize(const std::string &path) {
+    uint64_t size = 0;
+    if (std::filesystem::exists(path)) {
+        for (auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                size += entry.file_size();
+            }
+        }
+    }
+    return size;
+}
+
+static float vary(float value, float pct) {
+    return value * (1 + sim::noise(pct / 100 / 2));
+}
+
+// Deterministic pseudo random number of the run (independent of the sensor noise sequence)
+static uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+typedef struct {
+    float atS;
+    uint64_t writtenBytes;      // size of the telemetry file when the power was cut
+    uint64_t syncedBytes;       // size at the last flush
+    uint64_t keptBytes;         // synced part plus the random part of the unsynced data that made it to flash
+    uint64_t recoveredBytes;    // size after the recovery on boot
+    uint32_t records;           // records in the recovered file
+    uint32_t skippedBytes;      // invalid data reported by the dump
+    bool ok;
+} powerCut_t;
+
+// Cuts the power: the open telemetry file keeps the part written up to the last flush plus a random number of the
+// bytes written after it (torn write). Then the firmware boots again on the same flash, the recovered file must
+// keep all synced data and dump without invalid bytes.
+static powerCut_t powerCut(int fileId, uint32_t rnd) {
+    powerCut_t cut = { (float)(sim::kernel.now() * 1e-6) };
+    char path[256];
+    snprintf(path, sizeof(path), "%s" FOLDER_NAME "/" FILE_FORMAT, sim::hw.fsRoot.c_str(), fileId);
+    cut.writtenBytes = std::filesystem::file_size(path);
+    cut.syncedBytes = sim::hw.syncedSize[path];
+    cut.keptBytes = cut.syncedBytes + rnd % (cut.writtenBytes - cut.syncedBytes + 1);
+    std::filesystem::resize_file(path, cut.keptBytes);
+
+    Telemetry *rebooted = new Telemetry();
+    rebooted->init();
+    cut.recoveredBytes = std::filesystem::file_size(path);
+    if (rebooted->dumpBegin(fileId)) {
+        char line[Telemetry::CSV_LINE_SIZE];
+        size_t len;
+        while (rebooted->dumpNextLine(line, sizeof(line), &len)) {
+            unsigned skipped;
+            if (sscanf(line, "# skipped %u", &skipped) == 1) {
+                cut.skippedBytes += skipped;
+            } else if (line[0] != '#') {
+                cut.records++;
+            }
+        }
+    }
+    cut.ok = cut.recoveredBytes >= cut.syncedBytes && cut.recoveredBytes <= cut.keptBytes && cut.skippedBytes == 0;
+    return cut;
+}
+
+// GPS receiver at 10 Hz
+static void gpsTimerCb(void *arg) {
+    const sim::sensorState_t &s = sim::sensors();
+    gps.simUpdate(s.gpsFix, s.lat, s.lon, s.gpsAltitude + sim::noise(2), s.satellites, s.utcUs);
+}
+
+// One simulated flight, returns true if the launch detection worked as expected
+static bool runFlight(const simOptions_t &opt, int run) {
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s/run-%04d", opt.outDir.c_str(), run);
+    std::filesystem::create_directories(dir);
+    sim::hw.fsRoot = std::string(dir) + "/fs";
+    sim::hw.seed = opt.seed + run;
+    if (!opt.verbose) {
+        sim::hw.console = fopen((std::string(dir) + "/console.log").c_str(), "w");
+    }
+
+    sim::BallisticModel::params_t params;
+    params.massKg = vary(params.massKg, opt.varyPct);
+    params.thrustN = vary(params.thrustN, opt.varyPct);
+    params.burnS = vary(params.burnS, opt.varyPct);
+    params.dragArea = vary(params.dragArea, opt.varyPct);
+    params.igniteS = vary(opt.igniteS > 0 ? opt.igniteS : params.igniteS, opt.varyPct);
+    sim::BallisticModel ballistic(params);
+    sim::ReplayModel replay;
+    if (opt.replayFile) {
+        if (!replay.load(opt.replayFile, (uint64_t)params.igniteS * 1000000)) {
+            fprintf(stderr, "Can't read flight %s\n", opt.replayFile);
+            return false;
+        }
+        sim::hw.environment = &replay;
+    } else {
+        sim::hw.environment = &ballistic;
+    }
+    sim::sensors();
+
+    sim::Kernel::timer_t *gpsTimer = sim::kernel.createTimer("gps", gpsTimerCb, nullptr);
+    sim::kernel.startTimer(gpsTimer, 100000, true);
+
+    auto hostStart = std::chrono::steady_clock::now();
+    setup();
+
+    std::vector<simCommand_t> commands = opt.commands;
+    if (opt.capture) {
+        commands.insert(commands.begin(), { 0, "capture on" });
+    }
+
+    std::vector<uint32_t> loopVirtualUs, loopHostNs;
+    uint64_t launchDetectedUs = 0, landingDetectedUs = 0;
+    uint64_t endUs = opt.maxDurationS * 1e6;
+    uint64_t cutUs = opt.powerCut ? (uint64_t)(params.igniteS * 1e6) + 500000 + hash32(sim::hw.seed) % 45000000 : 0;
+    size_t nextCommand = 0;
+    while (sim::kernel.now() < endUs) {
+        uint64_t now = sim::kernel.now();
+        if (cutUs && now >= cutUs) {
+            break;
+        }
+        while (nextCommand < commands.size() && commands[nextCommand].atUs <= now) {
+            sim::hw.consoleInput += commands[nextCommand++].line + "\n";
+        }
+
+        auto hostT0 = std::chrono::steady_clock::now();
+        loop();
+        uint32_t hostNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - hostT0).count();
+        loopHostNs.push_back(hostNs);
+        loopVirtualUs.push_back(sim::kernel.now() - now);
+
+        LaunchDetector::state_e state = telemetry.launchDetector.state();
+        if (state != LaunchDetector::PAD && !launchDetectedUs) {
+            launchDetectedUs = sim::kernel.now();
+        }
+        if (state == LaunchDetector::LANDED && !landingDetectedUs) {
+            landingDetectedUs = sim::kernel.now();
+        }
+
+        bool finished = opt.replayFile ? replay.finished(sim::kernel.now()) : ballistic.finished(opt.afterLandingS * 1e6);
+        if (finished && nextCommand >= commands.size()) {
+            break;
+        }
+        sim::kernel.sleep(opt.loopUs + (uint64_t)(hostNs / 1000 * opt.cpuScale));
+    }
+    powerCut_t cut = {0};
+    if (cutUs) {
+        cut = powerCut(telemetry.fs.fileId(), hash32(sim::hw.seed + 0x9E3779B9));
+    } else {
+        telemetry.fs.flush();
+    }
+    double hostMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hostStart).count();
+
+    // Trigger check against the model truth
+    sim::BallisticModel::truth_t &truth = ballistic.truth;
+    bool falseTrigger = !opt.replayFile && launchDetectedUs && launchDetectedUs < truth.liftoffUs;
+    int64_t triggerDelayMs = launchDetectedUs && truth.liftoffUs ? ((int64_t)launchDetectedUs - (int64_t)truth.liftoffUs) / 1000 : -1;
+    bool ok = true;
+    if (opt.capture && !opt.replayFile) {
+        ok = !falseTrigger && triggerDelayMs >= 0 && triggerDelayMs <= opt.maxTriggerMs;
+    }
+    if (cutUs) {
+        ok = ok && cut.ok;
+    }
+
+    TelemetryFS::writeStats_t fsStats = telemetry.fs.stats();
+    FinControl::stats_t ctrl = finControl.getStats();
+    sim::flashStats_t &flash = sim::hw.flashStats;
+    uint64_t loopSum = 0;
+    for (uint32_t us : loopVirtualUs) {
+        loopSum += us;
+    }
+    uint64_t hostSum = 0;
+    for (uint32_t ns : loopHostNs) {
+        hostSum += ns;
+    }
+    size_t iterations = loopVirtualUs.size();
+
+    char report[2048];
+    size_t len = 0;
+    TelemetryFS::appendf(report, sizeof(report), &len,
+        "{\"run\":%d,\"seed\":%u,\"ok\":%s,\"model\":\"%s\",\"sim_s\":%.3f,\"host_ms\":%.1f,",
+        run, sim::hw.seed, ok ? "true" : "false", opt.replayFile ? "replay" : "ballistic", sim::kernel.now() * 1e-6, hostMs);
+    if (!opt.replayFile) {
+        TelemetryFS::appendf(report, sizeof(report), &len,
+            "\"liftoff_s\":%.3f,\"apogee_m\":%.1f,\"apogee_s\":%.3f,\"max_velocity\":%.1f,\"landing_s\":%.3f,\"false_trigger\":%s,\"trigger_delay_ms\":%lld,",
+            truth.liftoffUs * 1e-6, truth.apogeeM, truth.apogeeUs * 1e-6, truth.maxVelocity, truth.landingUs * 1e-6,
+            falseTrigger ? "true" : "false", (long long)triggerDelayMs);
+    }
+    TelemetryFS::appendf(report, sizeof(report), &len,
+        "\"launch_detected_s\":%.3f,\"landing_detected_s\":%.3f,"
+        "\"log_bytes\":%llu,\"fs_writes\":%u,\"fs_write_max_us\":%u,\"fs_flush_max_us\":%u,\"capture_dropped\":%u,\"clipped_fields\":%u,"
+        "\"flash_busy_ms\":%.1f,\"write_amplification\":%.2f,\"blocks_erased\":%u,"
+        "\"loop_iterations\":%zu,\"loop_mean_us\":%.1f,\"loop_p99_us\":%u,\"loop_max_us\":%u,\"loop_host_mean_ns\":%.0f,\"loop_host_p99_ns\":%u,"
+        "\"ctrl_cycles\":%u,\"ctrl_jitter_max_us\":%u,\"ctrl_latency_max_us\":%u,\"ctrl_overruns\":%u,",
+        launchDetectedUs * 1e-6, landingDetectedUs * 1e-6,
+        (unsigned long long)directorySize(sim::hw.fsRoot), fsStats.writes, fsStats.writeMaxUs, fsStats.flushMaxUs, telemetry.captureDropped(), telemetry.clipped(),
+        flash.busyUs / 1000.0, flash.bytesWritten ? (double)flash.bytesProgrammed / flash.bytesWritten : 0, flash.blocksErased,
+        iterations, iterations ? (double)loopSum / iterations : 0, percentile(loopVirtualUs, 99), percentile(loopVirtualUs, 100),
+        iterations ? (double)hostSum / iterations : 0, percentile(loopHostNs, 99),
+        ctrl.cycles, ctrl.jitterMaxUs, ctrl.latencyMaxUs, ctrl.overruns);
+    TelemetryFS::appendf(report, sizeof(report), &len, "\"i2c\":{");
+    for (int i = 0; i < i2cBus.numDevices(); i++) {
+        I2CBus::device_t dev = i2cBus.getDevice(i);
+        TelemetryFS::appendf(report, sizeof(report), &len, "%s\"%s\":{\"runs\":%u,\"max_us\":%u,\"max_delay_us\":%u}",
+            i ? "," : "", dev.name, dev.runs, dev.maxTimeUs, dev.maxDelayUs);
+    }
+    TelemetryFS::appendf(report, sizeof(report), &len, "},\"radio_packets\":%u,\"radio_bytes\":%u",
+        sim::hw.radio.packets, sim::hw.radio.bytes);
+    if (cutUs) {
+        TelemetryFS::appendf(report, sizeof(report), &len,
+            ",\"power_cut\":{\"ok\":%s,\"at_s\":%.3f,\"written_bytes\":%llu,\"synced_bytes\":%llu,\"kept_bytes\":%llu,"
+            "\"recovered_bytes\":%llu,\"records\":%u,\"skipped_bytes\":%u}",
+            cut.ok ? "true" : "false", cut.atS, (unsigned long long)cut.writtenBytes, (unsigned long long)cut.syncedBytes,
+            (unsigned long long)cut.keptBytes, (unsigned long long)cut.recoveredBytes, cut.records, cut.skippedBytes);
+    }
+    TelemetryFS::appendf(report, sizeof(report), &len, "}\n");
+
+    FILE *f = fopen((std::string(dir) + "/report.json").c_str(), "w");
+    if (f) {
+        fwrite(report, 1, len, f);
+        fclose(f);
+    }
+    write(STDOUT_FILENO, report, len);     // one write per line, so parallel runs don't interleave
+    if (sim::hw.console != stdout) {
+        fclose(sim::hw.console);
+    }
+    return ok;
+}
+
+static void printUsage() {
+    printf("Usage: program [options]\n"
+           "  --runs <n>            number of simulated flights (default 1)\n"
+           "  --jobs <n>            flights simulated in parallel (default 1)\n"
+           "  --seed <n>            seed of the first run, run i uses seed + i (default 1)\n"
+           "  --vary <pct>          random variation of the model parameters (default 10)\n"
+           "  --replay <file.bin>   replay the sensor values of a recorded telemetry file\n"
+           "  --duration <s>        max simulated time (default 300)\n"
+           "  --ignite <s>          ignition time (default 20), e.g. after --duration to stay on the pad\n"
+           "  --loop-us <us>        virtual time of one loop() iteration (default 200)\n"
+           "  --cpu-scale <f>       add host time of loop() * f to the virtual time (default 0)\n"
+           "  --max-trigger-ms <ms> max launch detection delay of a passing run (default 500)\n"
+           "  --flash-erase-us <us> flash block erase time (default 45000)\n"
+           "  --flash-page-us <us>  flash page program time (default 700)\n"
+           "  --flash-suspend       flash auto suspend, tasks keep running during erase / program\n"
+           "  --no-capture          don't enable capture mode after boot\n"
+           "  --power-cut           cut the power at a random time in flight (torn write), boot again and check the recovery\n"
+           "  --cmd [<s>:]<command> console command, optionally at the given virtual time\n"
+           "  --out <dir>           output folder (default sim_out), one run-NNNN folder per run\n"
+           "  --verbose             console output to stdout\n");
+}
+
+int main(int argc, char **argv) {
+    simOptions_t opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--runs" && hasValue)                opt.runs = atoi(argv[++i]);
+        else if (arg == "--jobs" && hasValue)           opt.jobs = max(1, atoi(argv[++i]));
+        else if (arg == "--seed" && hasValue)           opt.seed = strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--vary" && hasValue)           opt.varyPct = atof(argv[++i]);
+        else if (arg == "--replay" && hasValue)         opt.replayFile = argv[++i];
+        else if (arg == "--duration" && hasValue)       opt.maxDurationS = atof(argv[++i]);
+        else if (arg == "--ignite" && hasValue)         opt.igniteS = atof(argv[++i]);
+        else if (arg == "--loop-us" && hasValue)        opt.loopUs = max(1, atoi(argv[++i]));
+        else if (arg == "--cpu-scale" && hasValue)      opt.cpuScale = atof(argv[++i]);
+        else if (arg == "--max-trigger-ms" && hasValue) opt.maxTriggerMs = atoi(argv[++i]);
+        else if (arg == "--out" && hasValue)            opt.outDir = argv[++i];
+        else if (arg == "--flash-erase-us" && hasValue) sim::hw.flash.blockEraseUs = atoi(argv[++i]);
+        else if (arg == "--flash-page-us" && hasValue)  sim::hw.flash.pageProgramUs = atoi(argv[++i]);
+        else if (arg == "--flash-suspend")              sim::hw.flash.suspend = true;
+        else if (arg == "--no-capture")                 opt.capture = false;
+        else if (arg == "--power-cut")                  opt.powerCut = true;
+        else if (arg == "--verbose")                    opt.verbose = true;
+        else if (arg == "--cmd" && hasValue) {
+            std::string cmd = argv[++i];
+            size_t colon = cmd.find(':');
+            char *end;
+            double atS = strtod(cmd.c_str(), &end);
+            if (colon != std::string::npos && end == cmd.c_str() + colon) {
+                opt.commands.push_back({ (uint64_t)(atS * 1e6), cmd.substr(colon + 1) });
+            } else {
+                opt.commands.push_back({ 0, cmd });
+            }
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    std::stable_sort(opt.commands.begin(), opt.commands.end(), [](const simCommand_t &a, const simCommand_t &b) { return a.atUs < b.atUs; });
+    std::filesystem::create_directories(opt.outDir);
+    fflush(stdout);
+
+    auto start = std::chrono::steady_clock::now();
+    int running = 0, failed = 0, started = 0;
+    while (started < opt.runs || running > 0) {
+        if (started < opt.runs && running < opt.jobs) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                _exit(runFlight(opt, started) ? 0 : 1);
+            }
+            if (pid < 0) {
+                perror("fork");
+                return 2;
+            }
+            started++;
+            running++;
+            continue;
+        }
+        int status;
+        if (wait(&status) > 0) {
+            running--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failed++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Runs: %d, failed: %d, %.1f s (%.0f flights/min)\n", opt.runs, failed, seconds, opt.runs / seconds * 60);
+    return failed ? 1 : 0;
+}
@@ -1,13 +1,38 @@
+#pragma once
+
 #include <Adafruit_BME280.h>
+#include "i2cbus.h"
+#include "timebase.h"
 
 #define SEALEVELPRESSURE_HPA (1013.25)
+#define BME_ADDRESS 0x76
+
+const uint32_t BME_POLL_INTERVAL_US = 50000;    // sensor runs in normal mode, poll with 20 Hz
 
 Adafruit_BME280 bme; // I2C
 
-void bmeInit() {
+// Latest measurement, written by the I2C bus task, access via bmeGetData()
+typedef struct {
+    float temperature;      // °C
+    float pressure;         // Pa
+    float altitude;         // m, based on SEALEVELPRESSURE_HPA
+    int64_t timestampUs;    // timebase of the measurement
+} bmeData_t;
+
+bmeData_t bmeData = { NAN, NAN, NAN, 0 };
+portMUX_TYPE bmeDataMux = portMUX_INITIALIZER_UNLOCKED;
+
+void bmeGetData(bmeData_t *data) {
+    portENTER_CRITICAL(&bmeDataMux);
+    *data = bmeData;
+    portEXIT_CRITICAL(&bmeDataMux);
+}
+
+// Initialize the sensor, also called by the I2C bus after a bus recovery
+bool bmeSetup() {
     unsigned status;
     // status = bmp.begin(BMP280_ADDRESS_ALT, BMP280_CHIPID);
-    status = bme.begin(0x76, &Wire);
+    status = bme.begin(BME_ADDRESS, &Wire);
     if (!status) {
         Serial.println(F("Could not find a valid BMP280 sensor, check wiring or "
                          "try a different address!"));
@@ -17,9 +42,7 @@ void bmeInit() {
         Serial.print("   ID of 0x56-0x58 represents a BMP 280,\n");
         Serial.print("        ID of 0x60 represents a BME 280.\n");
         Serial.print("        ID of 0x61 represents a BME 680.\n");
-        // while (1)
-        //     delay(10);
-        return;
+        return false;
     }
 
     bme.setSampling(Adafruit_BME280::MODE_NORMAL,
@@ -27,42 +50,42 @@ void bmeInit() {
                     Adafruit_BME280::SAMPLING_X16, // pressure
                     Adafruit_BME280::SAMPLING_X1,  // humidity
                     Adafruit_BME280::FILTER_X16, Adafruit_BME280::STANDBY_MS_0_5);
-
-    // bmp_temp->printSensorDetails();
-    bme.getPressureSensor()->printSensorDetails();
+    return true;
 }
 
-void bmePrintValues() {
-    Serial.print("Temperature = ");
-    Serial.print(bme.readTemperature());
-    Serial.println(" *C");
-
-    Serial.print("Pressure = ");
-
-    Serial.print(bme.readPressure() / 100.0F);
-    Serial.println(" hPa");
-
-    Serial.print("Approx. Altitude = ");
-    Serial.print(bme.readAltitude(SEALEVELPRESSURE_HPA));
-    Serial.println(" m");
-
-    Serial.print("Humidity = ");
-    Serial.print(bme.readHumidity());
-    Serial.println(" %");
-
-    Serial.println();
-
-    // Re-initialize sensor if wrong values got received (e.g. I2C glitch)
-    if (isnanf(bme.readPressure())) {
-        bmeInit();
+// Poll job, runs in the I2C bus task
+bool bmePoll() {
+    float temperature = bme.readTemperature();
+    float pressure = bme.readPressure();    // Pa
+    if (isnan(pressure) || isnan(temperature)) {
+        return false;
     }
+    float altitude = 44330.0 * (1.0 - pow(pressure / 100.0F / SEALEVELPRESSURE_HPA, 0.1903));
+
+    portENTER_CRITICAL(&bmeDataMux);
+    bmeData = { temperature, pressure, altitude, Timebase::nowUs() };
+    portEXIT_CRITICAL(&bmeDataMux);
+    return true;
 }
 
-void bmeLoop() {
-    // Only needed in forced mode! In normal mode, you can remove the next line.
-    bme.takeForcedMeasurement(); // has no effect in normal mode
+void bmePrintValues() {
+    bmeData_t data;
+    bmeGetData(&data);
+    CONSOLE_UART.printf("Temperature = %.2f *C\n", data.temperature);
+    CONSOLE_UART.printf("Pressure = %.2f hPa\n", data.pressure / 100.0F);
+    CONSOLE_UART.printf("Approx. Altitude = %.2f m\n", data.altitude);
+    CONSOLE_UART.printf("Age = %lld ms\n", (long long)((Timebase::nowUs() - data.timestampUs) / 1000));
+}
 
-    bmePrintValues();
+// Call in setup() after i2cBus.init() and before i2cBus.start()
+void bmeInit() {
+    if (!bmeSetup()) {
+        return;
+    }
+    bme.getPressureSensor()->printSensorDetails();
 
-    delay(100);
-}
\ No newline at end of file
+    i2cBus.addDevice("bme280", BME_ADDRESS, I2CBus::PRIO_LOW, BME_POLL_INTERVAL_US, bmePoll, []() { bmeSetup(); });
+    console.addCommand({ "baro", "", "prints the latest BME280 measurement", 0, [](int argc, char **argv) {
+        bmePrintValues();
+    }});
+}
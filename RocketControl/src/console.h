@@ -1,109 +1,260 @@
+#pragma once
+
 #include <Arduino.h>
-#include <telemetry.h>
 
 #define CONSOLE_UART Serial
 
-// char consoleBuf[128] = {0};
-String consoleBuf = "";
-
-const char * help_text = R""""(Simple Rocket CLI Help
-help            - prints this help
-ls              - list files in flash
-dump <id>       - dumps the telemetry file with the given ID
-hexdump <id>    - dumps a file as hex
-delete <id>     - delte telemetry file
-format          - deletes all telemetry files (use with caution)
-)"""";
-
-bool formatInitiated = false;
-
-void consoleHandle(String input) {
-    String token[5];
-
-    // Split input string by spaces
-    int numParsedTokens = 0;
-    int nextTokenIdx = 0;
-    for (int i = 0; i < sizeof(token) / sizeof(token[0]); i++) {
-        int spaceIdx = input.indexOf(' ', nextTokenIdx);
-        if (spaceIdx == -1) {
-            spaceIdx = input.length();
-            numParsedTokens--;
-        }
-        token[i] = input.substring(nextTokenIdx, spaceIdx);
-        nextTokenIdx = spaceIdx + 1;
-        numParsedTokens++;
+// Simple command line interface without heap allocations.
+// Input is collected in a fixed line buffer and split in place into arguments.
+// Modules register their commands with console.addCommand(), usually in their init function.
+class Console {
+    public:
+    static const int LINE_SIZE = 128;           // max input line length
+    static const int MAX_ARGS = 8;              // max number of arguments including the command name
+    static const int MAX_COMMANDS = 32;         // size of the command table
+    static const int JOB_LINE_SIZE = 512;       // max length of a single output line of a job
+    const uint32_t JOB_BUDGET_US = 2000;        // max time spent on a job per loop() call
+
+    typedef void (*commandHandler_t)(int argc, char **argv);
+
+    typedef struct {
+        const char *name;
+        const char *args;           // argument synopsis shown in the help, e.g. "<id>"
+        const char *help;           // short description
+        int minArgs;                // number of required arguments (not counting the command name)
+        commandHandler_t handler;   // argv[0] is the command name
+    } command_t;
+
+    // Long running commands are executed as resumable jobs. The job function writes one output line per call
+    // and returns false when done. loop() only fetches new lines within a time budget and only writes
+    // as much as fits into the TX buffer, so the main loop never blocks on console output.
+    typedef bool (*job_t)(char *line, size_t size, size_t *len);
+
+    Console() {
+        addCommand({ "help", "", "prints this help", 0, [](int argc, char **argv) {
+            extern Console console;
+            console.printHelp();
+        }});
+        addCommand({ "cancel", "", "aborts a running command (e.g. dump)", 0, [](int argc, char **argv) {
+            extern Console console;
+            if (console.jobRunning()) {
+                console.cancelJob();
+                CONSOLE_UART.println("Cancelled.");
+            }
+        }});
     }
 
-    // handle commands
-    String cmd = token[0];
-    if (cmd == "") {
-        // do nothing
+    // Add a command to the command table, the strings need to stay valid (use literals)
+    bool addCommand(const command_t &cmd) {
+        if (_numCommands >= MAX_COMMANDS) {
+            CONSOLE_UART.printf("[Console] Command table full, can't add \"%s\"\n", cmd.name);
+            return false;
+        }
+        _commands[_numCommands++] = cmd;
+        return true;
     }
-    else if (cmd == "help" || cmd == "\"help\"") {
-        Serial.println(help_text);
+
+    // Ask for confirmation, action gets called if the next input line is "yes"
+    void confirm(const char *question, void (*action)()) {
+        CONSOLE_UART.printf("%s \nType \"yes\" to confirm: ", question);
+        _confirmAction = action;
     }
-    else if (cmd == "ls") {
-        telemetry.fs.listDir(LittleFS, "/", 1);
+
+    void startJob(job_t job, void (*cancel)() = nullptr) {
+        _job = job;
+        _jobCancel = cancel;
+        _jobLineLen = 0;
+        _jobLinePos = 0;
     }
-    else if (cmd == "dump") {
-        if (numParsedTokens >= 2) {
-            int id = token[1].toInt();
-            telemetry.dump(id);
+
+    void cancelJob() {
+        if (_jobCancel) {
+            _jobCancel();
         }
+        _job = nullptr;
+        _jobCancel = nullptr;
+        _jobLineLen = 0;
+        _jobLinePos = 0;
     }
-    else if (cmd == "hexdump") {
-        if (numParsedTokens >= 2) {
-            int id = token[1].toInt();
-            telemetry.fs.hexdump(id);
-        }
+
+    bool jobRunning() {
+        return _job != nullptr;
     }
-    else if (cmd == "delete") {
-        if (numParsedTokens >= 2) {
-            int id = token[1].toInt();
-            telemetry.fs.deleteFile(id);
+
+    // Argument parsing helpers, return false if the string is not a complete number
+    static bool parseInt(const char *str, int32_t *out) {
+        char *end;
+        long val = strtol(str, &end, 0);
+        if (end == str || *end != '\0') {
+            return false;
         }
+        *out = val;
+        return true;
     }
-    else if (cmd == "format") {
-        Serial.print("This will format all data stored in Flash! Are you sure? \nType \"yes\" to confirm: ");
-        Serial.flush();
-        formatInitiated = true;
-        return;
+
+    static bool parseFloat(const char *str, float *out) {
+        char *end;
+        float val = strtof(str, &end);
+        if (end == str || *end != '\0') {
+            return false;
+        }
+        *out = val;
+        return true;
     }
-    else if (cmd == "yes") {
-        if (formatInitiated) {
-            telemetry.fs.format();
-            formatInitiated = false;
+
+    void printHelp() {
+        CONSOLE_UART.println("Simple Rocket CLI Help");
+        for (int i = 0; i < _numCommands; i++) {
+            char synopsis[48];
+            snprintf(synopsis, sizeof(synopsis), "%s %s", _commands[i].name, _commands[i].args);
+            CONSOLE_UART.printf("%-20s - %s\n", synopsis, _commands[i].help);
         }
     }
-    else {
-        Serial.println("Unknown command, try \"help\"");
+
+    // Parse and execute a command line (modified in place)
+    void handle(char *line) {
+        char *argv[MAX_ARGS];
+        int argc = tokenize(line, argv, MAX_ARGS);
+
+        // a pending confirmation is only valid for the very next input
+        void (*confirmAction)() = _confirmAction;
+        _confirmAction = nullptr;
+        if (confirmAction) {
+            if (argc == 1 && strcmp(argv[0], "yes") == 0) {
+                confirmAction();
+            } else {
+                CONSOLE_UART.println(" Aborted.");
+            }
+            return;
+        }
+
+        if (argc == 0) {
+            return;
+        }
+
+        const command_t *cmd = findCommand(argv[0]);
+        if (!cmd) {
+            CONSOLE_UART.println("Unknown command, try \"help\"");
+            return;
+        }
+        if (_job && strcmp(cmd->name, "cancel") != 0) {        // only "cancel" is allowed while a job runs
+            CONSOLE_UART.println("Busy, wait for the running command to finish or type \"cancel\"");
+            return;
+        }
+        if (argc - 1 < cmd->minArgs) {
+            CONSOLE_UART.printf("Usage: %s %s\n", cmd->name, cmd->args);
+            return;
+        }
+        cmd->handler(argc, argv);
     }
 
-    if (formatInitiated) {
-        Serial.println(" Aborted.");
-        formatInitiated = false;
+    // Call this in your main loop() repeatedly
+    void loop() {
+        while (CONSOLE_UART.available()) {
+            char c = CONSOLE_UART.read();
+            if (c == '\n') {                        // handle input on newline
+                CONSOLE_UART.print(c);
+                if (_lineOverflow) {
+                    CONSOLE_UART.println("Input line too long");
+                } else {
+                    _line[_lineLen] = '\0';
+                    handle(_line);
+                }
+                _lineLen = 0;                       // clear receive buffer
+                _lineOverflow = false;
+            }
+            else if (c == '\b' || c == 0x7F) {     // backspace / delete
+                if (_lineLen > 0) {
+                    _lineLen--;                     // remove last char
+                    CONSOLE_UART.print("\b \b");    // clear char on screen
+                }
+            }
+            else if (c != '\r') {                   // ignore carriage return char
+                CONSOLE_UART.print(c);              // echo back input
+                if (_lineLen < LINE_SIZE - 1) {
+                    _line[_lineLen++] = c;          // add received char to buffer
+                } else {
+                    _lineOverflow = true;
+                }
+            }
+        }
+
+        jobLoop();
     }
 
-}
-
-// Call this in your main loop() repeatedly
-void consoleLoop() {
-    while (CONSOLE_UART.available()) {
-        char c = CONSOLE_UART.read();
-        CONSOLE_UART.print(c);          // echo back input
-        if (c == '\n') {                // handle input on newline
-            consoleBuf += ' ';          // replace newline with space for easier parsing
-            consoleHandle(consoleBuf);
-            consoleBuf = "";            // clear receive buffer
+    protected:
+    command_t _commands[MAX_COMMANDS];
+    int _numCommands = 0;
+
+    char _line[LINE_SIZE];
+    int _lineLen = 0;
+    bool _lineOverflow = false;
+    void (*_confirmAction)() = nullptr;
+
+    job_t _job = nullptr;
+    void (*_jobCancel)() = nullptr;
+    char _jobLine[JOB_LINE_SIZE];
+    size_t _jobLineLen = 0, _jobLinePos = 0;
+
+    // Split line in place into space separated arguments, surrounding quotes get removed
+    static int tokenize(char *line, char **argv, int maxArgs) {
+        int argc = 0;
+        char *p = line;
+        while (*p && argc < maxArgs) {
+            while (*p == ' ' || *p == '\t') {
+                p++;
+            }
+            if (!*p) {
+                break;
+            }
+            char end = ' ';
+            if (*p == '"') {
+                end = '"';
+                p++;
+            }
+            argv[argc++] = p;
+            while (*p && *p != end && !(end == ' ' && *p == '\t')) {
+                p++;
+            }
+            if (*p) {
+                *p++ = '\0';
+            }
         }
-        else if (c == '\b') {           // backspace
-            if (consoleBuf.length() > 0) {
-                consoleBuf.remove(consoleBuf.length() - 1); // remove last char
+        return argc;
+    }
+
+    const command_t *findCommand(const char *name) {
+        for (int i = 0; i < _numCommands; i++) {
+            if (strcmp(name, _commands[i].name) == 0) {
+                return &_commands[i];
             }
-            Serial.print(" \b");        // clear char on screen
         }
-        else if (c != '\r') {           // ignore carriage return char
-            consoleBuf += c;            // add received char to buffer
+        return nullptr;
+    }
+
+    // Runs the active job until the time budget is used up or the TX buffer is full
+    void jobLoop() {
+        uint32_t start = micros();
+        while (_job && micros() - start < JOB_BUDGET_US) {
+            if (_jobLinePos >= _jobLineLen) {
+                _jobLinePos = 0;
+                if (!_job(_jobLine, sizeof(_jobLine), &_jobLineLen)) {
+                    _job = nullptr;
+                    _jobCancel = nullptr;
+                    _jobLineLen = 0;
+                    return;
+                }
+            }
+
+            int txFree = CONSOLE_UART.availableForWrite();
+            if (txFree <= 0) {
+                return;
+            }
+            size_t writeLen = min((size_t)txFree, _jobLineLen - _jobLinePos);
+            CONSOLE_UART.write((uint8_t*)_jobLine + _jobLinePos, writeLen);
+            _jobLinePos += writeLen;
         }
     }
-}
\ No newline at end of file
+};
+
+inline Console console;
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP32Servo.h>
+#include <esp_timer.h>
+#include "imu.h"
+#include "console.h"
+
+// PID controller with derivative on measurement, so setpoint changes don't cause output kicks
+class Pid {
+    public:
+    typedef struct {
+        float kp, ki, kd;
+        float iLimit;       // max absolute value of the integral part
+        float outLimit;     // max absolute output
+    } gains_t;
+
+    gains_t gains;
+
+    Pid(gains_t gains) : gains(gains) {}
+
+    // error = setpoint - measurement, rate = derivative of the measurement, dt in seconds
+    float update(float error, float rate, float dt) {
+        _integral = constrain(_integral + gains.ki * error * dt, -gains.iLimit, gains.iLimit);
+        float out = gains.kp * error + _integral - gains.kd * rate;
+        return constrain(out, -gains.outLimit, gains.outLimit);
+    }
+
+    void reset() {
+        _integral = 0;
+    }
+
+    protected:
+    float _integral = 0;
+};
+
+// Fixed rate fin control loop
+// A periodic esp_timer wakes up a high priority task, which reads the latest IMU attitude,
+// runs one PID controller per axis, mixes the outputs onto the four fins and writes the servos.
+// Fin layout (viewed from the tail): fin 0 top, 1 right, 2 bottom, 3 left.
+// Fins 0/2 steer yaw, fins 1/3 steer pitch, all fins deflect in the same direction for roll.
+// The task runs above all other tasks, including the loop task that does the flash writes. A flash erase still
+// stalls it (~45 ms, caches are disabled) unless the flash auto suspend of the ESP-IDF is enabled
+// (CONFIG_SPI_FLASH_AUTO_SUSPEND, simulator: --flash-suspend).
+class FinControl {
+    public:
+    static const int NUM_FINS = 4;
+    const uint32_t RATE_HZ = 250;
+    const int FIN_CENTER = 90;              // servo angle of the neutral fin position
+    const int TASK_PRIORITY = 10;           // above the I2C bus task (5) and the Arduino loop task (1)
+
+    enum axis_e { AXIS_YAW, AXIS_PITCH, AXIS_ROLL, AXIS_COUNT };
+
+    typedef struct {
+        uint32_t cycles;
+        uint32_t periodMinUs, periodMaxUs;  // measured time between two control cycles
+        uint32_t jitterMaxUs;               // max deviation from the nominal period
+        uint32_t latencyMaxUs;              // max time from IMU sample to servo output
+        uint64_t latencySumUs;              // for averaging, divide by latencySamples (32 bit would wrap after ~1 h)
+        uint32_t latencySamples;            // cycles with an IMU sample (the first ones may have none yet)
+        uint32_t computeMaxUs;              // max execution time of one cycle
+        uint32_t overruns;                  // cycles that were triggered while the previous one was still pending
+    } stats_t;
+
+    float setpoint[AXIS_COUNT] = {0, 0, 0};     // degrees
+    float maxDeflection = 15;                   // degrees, limit of the fin deflection
+
+    Pid pid[AXIS_COUNT] = {
+        Pid({ 0.5, 0.1, 0.05, 5, 15 }),     // yaw
+        Pid({ 0.5, 0.1, 0.05, 5, 15 }),     // pitch
+        Pid({ 0.2, 0.0, 0.02, 5, 10 }),     // roll
+    };
+
+    void init(const int *servoPins) {
+        for (int i = 0; i < NUM_FINS; i++) {
+            _servos[i].attach(servoPins[i]);
+            _servos[i].write(FIN_CENTER);
+            _positions[i] = FIN_CENTER;
+        }
+        resetStats();
+
+        xTaskCreate(taskFn, "finControl", 4096, this, TASK_PRIORITY, &_task);
+
+        esp_timer_create_args_t timerArgs = {};
+        timerArgs.callback = timerCb;
+        timerArgs.arg = this;
+        timerArgs.name = "finControl";
+        esp_timer_create(&timerArgs, &_timer);
+        esp_timer_start_periodic(_timer, 1000000 / RATE_HZ);
+
+        registerCommands();
+    }
+
+    // Enable / disable active control, fins go to neutral position when disabled
+    void enable(bool enabled) {
+        for (int i = 0; i < AXIS_COUNT; i++) {
+            pid[i].reset();
+        }
+        _enabled = enabled;
+    }
+
+    bool enabled() {
+        return _enabled;
+    }
+
+    // Fin positions that were actually commanded last (servo angle in degrees)
+    void getPositions(uint8_t *positions) {
+        portENTER_CRITICAL(&_mux);
+        memcpy(positions, (const void*)_positions, sizeof(_positions));
+        portEXIT_CRITICAL(&_mux);
+    }
+
+    stats_t getStats() {
+        portENTER_CRITICAL(&_mux);
+        stats_t stats = _stats;
+        portEXIT_CRITICAL(&_mux);
+        return stats;
+    }
+
+    void resetStats() {
+        portENTER_CRITICAL(&_mux);
+        _stats = {0};
+        _stats.periodMinUs = UINT32_MAX;
+        _lastCycleUs = 0;
+        portEXIT_CRITICAL(&_mux);
+    }
+
+    // One control cycle, called from the control task
+    void step() {
+        uint32_t start = micros();
+
+        imuAttitude_t att;
+        imuGetAttitude(&att);
+
+        float measurement[AXIS_COUNT] = { att.yaw, att.pitch, att.roll };
+        float deflection[AXIS_COUNT] = {0};
+
+        if (_enabled && att.seq != 0) {
+            float dt = 1.0f / RATE_HZ;
+            for (int i = 0; i < AXIS_COUNT; i++) {
+                // derivative of the measurement, only updated when a new IMU sample arrived
+                if (att.seq != _lastAttSeq && _lastAttSeq != 0) {
+                    float sampleDt = (att.timestampUs - _lastAttTimestampUs) * 1e-6f;
+                    if (sampleDt > 0) {
+                        _rate[i] = wrapAngle(measurement[i] - _lastMeasurement[i]) / sampleDt;
+                    }
+                }
+                deflection[i] = pid[i].update(wrapAngle(setpoint[i] - measurement[i]), _rate[i], dt);
+            }
+        }
+        if (att.seq != _lastAttSeq) {
+            memcpy(_lastMeasurement, measurement, sizeof(measurement));
+            _lastAttSeq = att.seq;
+            _lastAttTimestampUs = att.timestampUs;
+        }
+
+        // Mix axis outputs onto the fins
+        float fin[NUM_FINS] = {
+             deflection[AXIS_YAW]   + deflection[AXIS_ROLL],
+             deflection[AXIS_PITCH] + deflection[AXIS_ROLL],
+            -deflection[AXIS_YAW]   + deflection[AXIS_ROLL],
+            -deflection[AXIS_PITCH] + deflection[AXIS_ROLL],
+        };
+
+        uint8_t positions[NUM_FINS];
+        for (int i = 0; i < NUM_FINS; i++) {
+            positions[i] = FIN_CENTER + lroundf(constrain(fin[i], -maxDeflection, maxDeflection));
+            _servos[i].write(positions[i]);
+        }
+        uint32_t end = micros();
+
+        portENTER_CRITICAL(&_mux);
+        memcpy((void*)_positions, positions, sizeof(positions));
+        _stats.cycles++;
+        if (_lastCycleUs != 0) {
+            uint32_t period = start - _lastCycleUs;
+            uint32_t nominal = 1000000 / RATE_HZ;
+            uint32_t jitter = period > nominal ? period - nominal : nominal - period;
+            _stats.periodMinUs = min(_stats.periodMinUs, period);
+            _stats.periodMaxUs = max(_stats.periodMaxUs, period);
+            _stats.jitterMaxUs = max(_stats.jitterMaxUs, jitter);
+        }
+        if (att.seq != 0) {
+            uint32_t latency = end - att.timestampUs;
+            _stats.latencyMaxUs = max(_stats.latencyMaxUs, latency);
+            _stats.latencySumUs += latency;
+            _stats.latencySamples++;
+        }
+        _stats.computeMaxUs = max(_stats.computeMaxUs, end - start);
+        _lastCycleUs = start;
+        portEXIT_CRITICAL(&_mux);
+    }
+
+    protected:
+    Servo _servos[NUM_FINS];
+    volatile uint8_t _positions[NUM_FINS];
+    bool _enabled = false;
+
+    TaskHandle_t _task = nullptr;
+    esp_timer_handle_t _timer = nullptr;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    stats_t _stats;
+    uint32_t _lastCycleUs = 0;
+
+    uint32_t _lastAttSeq = 0, _lastAttTimestampUs = 0;
+    float _lastMeasurement[AXIS_COUNT] = {0};
+    float _rate[AXIS_COUNT] = {0};
+
+    static float wrapAngle(float deg) {
+        while (deg > 180) deg -= 360;
+        while (deg < -180) deg += 360;
+        return deg;
+    }
+
+    static void timerCb(void *arg) {
+        FinControl *self = (FinControl*)arg;
+        // notification count > 0 means the previous cycle has not been processed yet
+        if (ulTaskNotifyValueClear(self->_task, 0) > 0) {
+            portENTER_CRITICAL(&self->_mux);
+            self->_stats.overruns++;
+            portEXIT_CRITICAL(&self->_mux);
+        }
+        xTaskNotifyGive(self->_task);
+    }
+
+    static void taskFn(void *arg) {
+        FinControl *self = (FinControl*)arg;
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            self->step();
+        }
+    }
+
+    void registerCommands() {
+        console.addCommand({ "ctrl", "[on|off|reset]", "fin control state, timing statistics", 0, [](int argc, char **argv) {
+            extern FinControl finControl;
+            if (argc >= 2) {
+                if (strcmp(argv[1], "on") == 0)         finControl.enable(true);
+                else if (strcmp(argv[1], "off") == 0)   finControl.enable(false);
+                else if (strcmp(argv[1], "reset") == 0) finControl.resetStats();
+            }
+            stats_t stats = finControl.getStats();
+            uint8_t pos[NUM_FINS];
+            finControl.getPositions(pos);
+            CONSOLE_UART.printf("Control: %s, %u Hz, fins: %u %u %u %u\n", finControl.enabled() ? "on" : "off",
+                finControl.RATE_HZ, pos[0], pos[1], pos[2], pos[3]);
+            CONSOLE_UART.printf("Cycles: %u, period: %u..%u us, jitter max: %u us, overruns: %u\n",
+                stats.cycles, stats.periodMinUs, stats.periodMaxUs, stats.jitterMaxUs, stats.overruns);
+            CONSOLE_UART.printf("Latency avg: %u us, max: %u us, compute max: %u us\n",
+                stats.latencySamples ? (uint32_t)(stats.latencySumUs / stats.latencySamples) : 0, stats.latencyMaxUs, stats.computeMaxUs);
+        }});
+        console.addCommand({ "pid", "<yaw|pitch|roll> <kp> <ki> <kd>", "sets controller gains of an axis", 4, [](int argc, char **argv) {
+            extern FinControl finControl;
+            const char *axes[AXIS_COUNT] = { "yaw", "pitch", "roll" };
+            for (int i = 0; i < AXIS_COUNT; i++) {
+                Pid::gains_t gains = finControl.pid[i].gains;
+                if (strcmp(argv[1], axes[i]) == 0 && Console::parseFloat(argv[2], &gains.kp) &&
+                    Console::parseFloat(argv[3], &gains.ki) && Console::parseFloat(argv[4], &gains.kd)) {
+                    finControl.pid[i].gains = gains;
+                    finControl.pid[i].reset();
+                    return;
+                }
+            }
+            CONSOLE_UART.println("Invalid arguments");
+        }});
+    }
+};
+
+inline FinControl finControl;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32 (IEEE 802.3, same as zlib.crc32() / binascii.crc32() in Python), table driven
+// No Arduino dependencies, so it can also be used in host tools.
+class Crc32 {
+    public:
+    // Continue a CRC over more data, start with crc = 0
+    static uint32_t update(uint32_t crc, const void *data, size_t len) {
+        const uint8_t *p = (const uint8_t*)data;
+        const uint32_t *table = Crc32::table();
+        crc = ~crc;
+        while (len--) {
+            crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    static uint32_t calc(const void *data, size_t len) {
+        return update(0, data, len);
+    }
+
+    protected:
+    typedef struct {
+        uint32_t v[256];
+    } table_t;
+
+    static constexpr table_t makeTable() {
+        table_t t = {};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t.v[i] = c;
+        }
+        return t;
+    }
+
+    // generated at compile time, lives in flash
+    static const uint32_t *table() {
+        static constexpr table_t t = makeTable();
+        return t.v;
+    }
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+// Forward error correction for the broadcast radio link (ESP-NOW broadcasts have no retries)
+// Data frames are sent in groups of K, followed by M XOR parity frames.
+// Parity frame j is the XOR of all data frames i of the group with (i % M == j), so the receiver
+// can rebuild one lost frame per parity lane, e.g. any burst of up to M consecutive lost frames.
+// No Arduino dependencies, so it can also be used in host tools.
+class Fec {
+    public:
+    static const uint8_t FRAME_MAGIC = 0xFE;
+    static const int MAX_K = 16;            // max data frames per group
+    static const int MAX_M = 4;             // max parity frames per group
+    static const size_t MAX_PAYLOAD = 240;  // ESP-NOW frames are limited to 250 bytes including the FEC header
+
+    typedef struct {
+        uint8_t magic;      // FRAME_MAGIC
+        uint8_t group;      // group sequence number, wraps around
+        uint8_t index;      // 0..K-1: data frame, K..K+M-1: parity frame
+        uint8_t k, m;       // group layout, so the receiver does not need to be configured
+        uint8_t len;        // payload length (XOR of the covered lengths for parity frames)
+    } __attribute__((packed)) frameHeader_t;
+
+    static const size_t MAX_FRAME = sizeof(frameHeader_t) + MAX_PAYLOAD;
+
+    // Called for every frame (encoder) or every restored payload (decoder)
+    typedef void (*emitCb_t)(const uint8_t *buf, size_t len, void *ctx);
+
+    typedef struct {
+        uint32_t received;      // data frames received directly
+        uint32_t recovered;     // data frames rebuilt from parity
+        uint32_t lost;          // data frames that could not be rebuilt
+        uint32_t groups;        // completed groups
+    } stats_t;
+
+    class Encoder {
+        public:
+        // m = 0 disables parity, frames are still sent with FEC header
+        bool configure(uint8_t k, uint8_t m) {
+            if (k < 1 || k > MAX_K || m > MAX_M || m > k) {
+                return false;
+            }
+            _k = k;
+            _m = m;
+            if (_index != 0) {
+                // unfinished group: its frames must not be mixed with the new ones (same group number and layout)
+                _group++;
+                _index = 0;
+            }
+            clearParity();
+            return true;
+        }
+
+        // Send one payload, emits the data frame and, at the end of each group, the parity frames
+        bool encode(const uint8_t *payload, size_t len, emitCb_t emit, void *ctx) {
+            if (len > MAX_PAYLOAD) {
+                return false;
+            }
+
+            uint8_t frame[MAX_FRAME];
+            frameHeader_t *hdr = (frameHeader_t*)frame;
+            *hdr = { FRAME_MAGIC, _group, _index, _k, _m, (uint8_t)len };
+            memcpy(frame + sizeof(frameHeader_t), payload, len);
+            emit(frame, sizeof(frameHeader_t) + len, ctx);
+
+            if (_m) {
+                int lane = _index % _m;
+                xorInto(_parity[lane], payload, len);
+                _parityLen[lane] ^= len;
+                if (len > _parityMaxLen[lane]) {
+                    _parityMaxLen[lane] = len;
+                }
+            }
+
+            if (++_index >= _k) {
+                for (int j = 0; j < _m; j++) {
+                    *hdr = { FRAME_MAGIC, _group, (uint8_t)(_k + j), _k, _m, _parityLen[j] };
+                    memcpy(frame + sizeof(frameHeader_t), _parity[j], _parityMaxLen[j]);
+                    emit(frame, sizeof(frameHeader_t) + _parityMaxLen[j], ctx);
+                }
+                _index = 0;
+                _group++;
+                clearParity();
+            }
+            return true;
+        }
+
+        protected:
+        uint8_t _k = 1, _m = 0;
+        uint8_t _group = 0, _index = 0;
+        uint8_t _parity[MAX_M][MAX_PAYLOAD];
+        uint8_t _parityLen[MAX_M];      // XOR of covered payload lengths
+        uint8_t _parityMaxLen[MAX_M];   // bytes of the parity buffer that need to be sent
+
+        void clearParity() {
+            memset(_parity, 0, sizeof(_parity));
+            memset(_parityLen, 0, sizeof(_parityLen));
+            memset(_parityMaxLen, 0, sizeof(_parityMaxLen));
+        }
+    };
+
+    class Decoder {
+        public:
+        // Process a received frame. Data frames are emitted right away,
+        // rebuilt frames once the group is complete or the next group starts, so they arrive out of order
+        // (after later frames of their group). Consumers have to order records by their timestamp.
+        // Returns false if the frame is not a valid FEC frame.
+        bool push(const uint8_t *frame, size_t frameLen, emitCb_t emit, void *ctx) {
+            if (!isFrame(frame, frameLen)) {
+                return false;
+            }
+            const frameHeader_t *hdr = (const frameHeader_t*)frame;
+            const uint8_t *payload = frame + sizeof(frameHeader_t);
+            size_t payloadLen = frameLen - sizeof(frameHeader_t);
+
+            if (_active && (hdr->group != _group || hdr->k != _k || hdr->m != _m)) {
+                finishGroup(emit, ctx);
+            }
+            if (!_active) {
+                startGroup(hdr);
+            }
+
+            uint32_t bit = 1UL << hdr->index;
+            if (_haveMask & bit) {
+                return true;    // duplicate
+            }
+            _haveMask |= bit;
+
+            memset(_buf[hdr->index], 0, MAX_PAYLOAD);
+            memcpy(_buf[hdr->index], payload, payloadLen);
+            _len[hdr->index] = hdr->len;
+
+            if (hdr->index < _k) {
+                _stats.received++;
+                emit(payload, hdr->len, ctx);
+            }
+
+            if (_haveMask == fullMask()) {
+                finishGroup(emit, ctx);
+            }
+            return true;
+        }
+
+        // Call when no more frames are expected (e.g. link timeout) to rebuild the pending group
+        void flush(emitCb_t emit, void *ctx) {
+            if (_active) {
+                finishGroup(emit, ctx);
+            }
+        }
+
+        static bool isFrame(const uint8_t *frame, size_t frameLen) {
+            if (frameLen < sizeof(frameHeader_t) || frameLen > MAX_FRAME) {
+                return false;
+            }
+            const frameHeader_t *hdr = (const frameHeader_t*)frame;
+            size_t payloadLen = frameLen - sizeof(frameHeader_t);
+            if (hdr->magic != FRAME_MAGIC || hdr->k < 1 || hdr->k > MAX_K || hdr->m > MAX_M || hdr->m > hdr->k) {
+                return false;
+            }
+            if (hdr->index >= hdr->k + hdr->m) {
+                return false;
+            }
+            // data frames carry exactly their length, parity frames at least the longest covered payload
+            return hdr->index < hdr->k ? payloadLen == hdr->len : payloadLen <= MAX_PAYLOAD;
+        }
+
+        stats_t stats() { return _stats; }
+
+        protected:
+        bool _active = false;
+        uint8_t _group = 0, _k = 0, _m = 0;
+        uint8_t _lastGroup = 0;
+        bool _haveLastGroup = false;
+        uint32_t _haveMask = 0;
+        uint8_t _buf[MAX_K + MAX_M][MAX_PAYLOAD];
+        uint8_t _len[MAX_K + MAX_M];
+        stats_t _stats = {0};
+
+        uint32_t fullMask() {
+            return (1UL << (_k + _m)) - 1;
+        }
+
+        void startGroup(const frameHeader_t *hdr) {
+            // count data frames of groups that were lost completely
+            if (_haveLastGroup) {
+                uint8_t skipped = hdr->group - _lastGroup - 1;
+                if (skipped < 128) {    // otherwise it is most likely a transmitter restart
+                    _stats.lost += skipped * hdr->k;
+                }
+            }
+            _active = true;
+            _group = hdr->group;
+            _k = hdr->k;
+            _m = hdr->m;
+            _haveMask = 0;
+        }
+
+        void finishGroup(emitCb_t emit, void *ctx) {
+            if (_m == 0) {
+                for (int i = 0; i < _k; i++) {
+                    if (!(_haveMask & (1UL << i))) {
+                        _stats.lost++;
+                    }
+                }
+            }
+            for (int lane = 0; lane < _m; lane++) {
+                int missing = -1, numMissing = 0;
+                for (int i = lane; i < _k; i += _m) {
+                    if (!(_haveMask & (1UL << i))) {
+                        missing = i;
+                        numMissing++;
+                    }
+                }
+                if (numMissing == 0) {
+                    continue;
+                }
+                if (numMissing > 1 || !(_haveMask & (1UL << (_k + lane)))) {
+                    _stats.lost += numMissing;
+                    continue;
+                }
+
+                // missing = parity ^ all other frames of this lane
+                uint8_t *out = _buf[missing];
+                uint8_t len = _len[_k + lane];
+                memcpy(out, _buf[_k + lane], MAX_PAYLOAD);
+                for (int i = lane; i < _k; i += _m) {
+                    if (i != missing) {
+                        xorInto(out, _buf[i], MAX_PAYLOAD);
+                        len ^= _len[i];
+                    }
+                }
+                if (len > MAX_PAYLOAD) {
+                    _stats.lost++;
+                    continue;
+                }
+                _stats.recovered++;
+                emit(out, len, ctx);
+            }
+            _stats.groups++;
+            _lastGroup = _group;
+            _haveLastGroup = true;
+            _active = false;
+        }
+    };
+
+    protected:
+    static void xorInto(uint8_t *dst, const uint8_t *src, size_t len) {
+        size_t i = 0;
+        // word-wise XOR, buffers are not guaranteed to be aligned
+        for (; i + 4 <= len; i += 4) {
+            uint32_t a, b;
+            memcpy(&a, dst + i, 4);
+            memcpy(&b, src + i, 4);
+            a ^= b;
+            memcpy(dst + i, &a, 4);
+        }
+        for (; i < len; i++) {
+            dst[i] ^= src[i];
+        }
+    }
+};
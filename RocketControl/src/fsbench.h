@@ -0,0 +1,654 @@
+#pragma once
+
+#include <new>
+#include <FS.h>
+#include <LittleFS.h>
+#include "console.h"
+#include "telemetry.h"
+#ifdef FSBENCH_LFS_RAM
+#include "lfsram.h"
+#endif
+
+// Storage benchmark: runs write patterns against LittleFS and prints one JSON line per configuration.
+// The default sweep varies one parameter at a time around the flight write path (baseline): telemetry sized
+// records in TelemetryFS blocks, flushed every FILE_FLUSH_INTERVAL at the capture record rate, empty flash.
+//
+// Devices:
+// - ram: the littlefs code (lfs_*) on a RAM block device with the geometry of the partition (lfsram.h), formatted
+//   for every configuration. Reports bytes programmed, blocks erased and the wear of the most erased block, the
+//   latencies include a NOR flash timing charged by the device. Only in builds with FSBENCH_LFS_RAM (simulator).
+// - flash: LittleFS on the flash partition (the real flash on the target), reports the space used, the simulator
+//   also the counters of its flash model (it has no block allocator, so fill level and fragmentation don't show).
+//
+// Runs as a console job, a few writes per loop(). Latencies and throughput only count the time spent in the
+// FS calls. The telemetry logger keeps running, so use it on the pad with capture enabled (nothing gets written
+// until launch). The bench files are deleted after every configuration.
+class FsBench {
+    public:
+    static const int CHUNK_BLOCKS = 0;          // TelemetryFS::writeRecord(), records in CRC framed blocks
+    static const int CHUNK_RECORD = -1;         // one write() per record (version 1 files)
+    static const size_t MAX_RECORD = 256;
+    static const size_t MAX_CHUNK = 4096;
+    static const size_t BENCH_BYTES = 256 * 1024;       // payload per configuration
+    static const size_t RESERVE_BYTES = 64 * 1024;      // fill and fragmentation leave this much free besides the payload
+    static const int FRAG_FILES = 32;
+    static const size_t FRAG_FILE_BYTES = 16 * 1024;
+    static const size_t RAM_DEVICE_BYTES = 0x2E0000;    // size of the LittleFS partition (partition.csv)
+
+    enum device_e : uint8_t {
+        DEV_FLASH,
+        DEV_RAM,
+    };
+
+#ifdef FSBENCH_LFS_RAM
+    static constexpr device_e DEFAULT_DEVICE = DEV_RAM;
+#else
+    static constexpr device_e DEFAULT_DEVICE = DEV_FLASH;
+#endif
+
+    typedef struct {
+        uint16_t recordSize;    // bytes (0: size of the telemetry record)
+        int16_t chunk;          // CHUNK_BLOCKS, CHUNK_RECORD or bytes per write() (records are split / merged)
+        uint16_t flushMs;       // flush interval at the capture record rate (0: only on close)
+        uint8_t fillPct;        // used space before the run, % of the partition
+        bool fragment;          // free space split up by FRAG_FILES small files of which every other gets deleted
+    } config_t;
+
+    static constexpr config_t SWEEP[] = {
+        {   0, CHUNK_BLOCKS, 2000,  0, false },     // baseline
+        {  32, CHUNK_BLOCKS, 2000,  0, false },
+        { 128, CHUNK_BLOCKS, 2000,  0, false },
+        { 256, CHUNK_BLOCKS, 2000,  0, false },
+        {   0, CHUNK_RECORD, 2000,  0, false },
+        {   0,          256, 2000,  0, false },
+        {   0,         4096, 2000,  0, false },
+        {   0, CHUNK_BLOCKS,    0,  0, false },
+        {   0, CHUNK_BLOCKS,  100,  0, false },
+        {   0, CHUNK_BLOCKS,  500,  0, false },
+        {   0, CHUNK_BLOCKS, 2000, 50, false },
+        {   0, CHUNK_BLOCKS, 2000, 90, false },
+        {   0, CHUNK_BLOCKS, 2000,  0, true },
+        {   0, CHUNK_BLOCKS, 2000, 50, true },
+    };
+
+    // Starts a run of the given configurations, the results are read with nextLine()
+    bool begin(const config_t *configs, int num, device_e device = DEFAULT_DEVICE) {
+        end();
+        _device = device;
+        if (_device == DEV_FLASH) {
+            _fs = new (std::nothrow) TelemetryFS();
+        }
+        _buf = (uint8_t*)malloc(MAX_CHUNK);
+        if ((_device == DEV_FLASH && !_fs) || !_buf) {
+            Serial.printf("[FsBench] Error: can't allocate %d bytes\n", (int)(sizeof(TelemetryFS) + MAX_CHUNK));
+            end();
+            return false;
+        }
+        for (size_t i = 0; i < MAX_RECORD; i++) {
+            _record[i] = i * 7;
+        }
+        memset(_buf, 0x5A, MAX_CHUNK);
+        _configs = configs;
+        _numConfigs = num;
+        _configIdx = 0;
+        _phase = SETUP;
+        return true;
+    }
+
+    // Console job: does one step of the run, writes a JSON line after every configuration
+    bool nextLine(char *line, size_t size, size_t *len) {
+        *len = 0;
+        switch (_phase) {
+            case SETUP:
+                if (_configIdx >= _numConfigs) {
+                    end();
+                    return false;
+                }
+                if (!setup(_configs[_configIdx])) {
+                    end();
+                    return false;
+                }
+                break;
+            case FRAGMENT:
+                fragmentStep();
+                break;
+            case FILL:
+                if (writeFileStep()) {
+                    startRun();
+                }
+                break;
+            case RUN:
+                runStep();
+                break;
+            case REPORT:
+                report(line, size, len);
+                removeFiles();
+                _configIdx++;
+                _phase = SETUP;
+                break;
+        }
+        return true;
+    }
+
+    // Stops a run and deletes the bench files
+    void end() {
+        fileClose();
+        if (_fs) {
+            _fs->close();
+            delete _fs;
+            _fs = nullptr;
+        }
+        free(_buf);
+        _buf = nullptr;
+        removeFiles();
+#ifdef FSBENCH_LFS_RAM
+        _ram.end();
+#endif
+    }
+
+    // A flash run allocates a TelemetryFS (about 1.5 KB with its block buffer) and MAX_CHUNK (4 KB) on the heap,
+    // a RAM run the RAM device (size of the partition, simulator only), all of it is freed when the run ends
+    void registerCommands() {
+        console.addCommand({ "fsbench", "[flash|ram] [<record bytes> <block|record|<chunk bytes>> <flush ms> <fill %> [frag]]",
+                             "flash write benchmark, JSON line per run (default: sweep)", 0, [](int argc, char **argv) {
+            extern FsBench fsBench;
+            extern Telemetry telemetry;
+            static FsBench::config_t custom;
+            if (telemetry.launchDetector.state() != LaunchDetector::PAD) {
+                CONSOLE_UART.println("Only available on the pad");
+                return;
+            }
+            device_e device = DEFAULT_DEVICE;
+            if (argc > 1 && (strcmp(argv[1], "flash") == 0 || strcmp(argv[1], "ram") == 0)) {
+                device = strcmp(argv[1], "flash") == 0 ? DEV_FLASH : DEV_RAM;
+                argc--;
+                argv++;
+            }
+#ifndef FSBENCH_LFS_RAM
+            if (device == DEV_RAM) {
+                CONSOLE_UART.println("No RAM device in this build (simulator only)");
+                return;
+            }
+#endif
+            bool ok;
+            if (argc == 1) {
+                ok = fsBench.begin(SWEEP, sizeof(SWEEP) / sizeof(SWEEP[0]), device);
+            }
+            else {
+                int32_t record, chunk, flushMs, fillPct;
+                if (argc < 5 || !Console::parseInt(argv[1], &record) || !Console::parseInt(argv[3], &flushMs) ||
+                    !Console::parseInt(argv[4], &fillPct) || record < 1 || record > (int32_t)MAX_RECORD ||
+                    flushMs < 0 || flushMs > 60000 || fillPct < 0 || fillPct > 95) {
+                    CONSOLE_UART.println("Invalid arguments");
+                    return;
+                }
+                if (strcmp(argv[2], "block") == 0) {
+                    chunk = CHUNK_BLOCKS;
+                }
+                else if (strcmp(argv[2], "record") == 0) {
+                    chunk = CHUNK_RECORD;
+                }
+                else if (!Console::parseInt(argv[2], &chunk) || chunk < 1 || chunk > (int32_t)MAX_CHUNK) {
+                    CONSOLE_UART.println("Invalid chunk size");
+                    return;
+                }
+                custom = { (uint16_t)record, (int16_t)chunk, (uint16_t)flushMs, (uint8_t)fillPct,
+                           argc >= 6 && strcmp(argv[5], "frag") == 0 };
+                ok = fsBench.begin(&custom, 1, device);
+            }
+            if (ok) {
+                console.startJob([](char *line, size_t size, size_t *len) { return fsBench.nextLine(line, size, len); },
+                                 []() { fsBench.end(); });
+            }
+        }});
+    }
+
+    protected:
+    #define BENCH_FILE      "/fsbench.tmp"
+    #define FILL_FILE       "/fsbench_fill.tmp"
+    #define FRAG_FORMAT     "/fsbench_%02d.tmp"
+
+    // Write latency histogram: exact up to 7 us, then 4 buckets per power of two (percentiles within 25 %)
+    static const int HIST_BUCKETS = 124;
+
+    enum phase_e : uint8_t {
+        SETUP,          // next configuration
+        FRAGMENT,       // writing the fragmentation files
+        FILL,           // writing the fill file
+        RUN,            // writing the records
+        REPORT,         // output of the result
+    };
+
+    const config_t *_configs = nullptr;
+    int _numConfigs = 0, _configIdx = 0;
+    phase_e _phase = SETUP;
+    config_t _config;               // current configuration, record size resolved
+    device_e _device = DEFAULT_DEVICE;
+
+    TelemetryFS *_fs = nullptr;     // block writer of the bench file (flash)
+    uint8_t *_buf = nullptr;        // MAX_CHUNK, chunk being assembled or fill data
+    size_t _bufLen = 0;
+    uint8_t _record[MAX_RECORD];
+    File _file;                     // fragmentation / fill file being written (flash)
+    size_t _fileBytes = 0;          // bytes left to write to _file
+    int _fragIdx = 0, _fragFiles = 0;
+
+#ifdef FSBENCH_LFS_RAM
+    LfsRam _ram;
+    lfs_file_t _ramFile;            // fragmentation / fill / bench file being written (RAM)
+    bool _ramFileOpen = false;
+    // block writer of the bench file like TelemetryFS::writeRecord() / commitBlock()
+    uint8_t _block[LogFormat::BLOCK_MAX];
+    size_t _blockLen = 0;
+    uint16_t _blockSeq = 0;
+#endif
+
+    uint32_t _records = 0, _flushEvery = 0;
+    size_t _bytes = 0;
+    uint64_t _fsUs = 0;
+    uint32_t _hist[HIST_BUCKETS];
+    uint32_t _writeMaxUs = 0, _flushes = 0, _flushMaxUs = 0;
+    size_t _usedBefore = 0, _usedAfter = 0;
+    bool _haveFlashStats = false;
+    uint64_t _programmed = 0;
+    uint32_t _erased = 0;
+    uint32_t _maxBlockErases = 0;   // RAM device only
+    uint64_t _flashUs = 0;          // RAM device only
+    bool _openFailed = false;
+
+    bool setup(const config_t &config) {
+        extern Telemetry telemetry;
+        _config = config;
+        if (_config.recordSize == 0) {
+            _config.recordSize = constrain(telemetry.logEntryBufSize, 1, (int)MAX_RECORD);
+        }
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            // a freshly formatted device for every configuration, preparing it costs no flash time
+            if (!_ram.begin(RAM_DEVICE_BYTES)) {
+                Serial.printf("[FsBench] Error: can't set up a %d byte RAM device\n", (int)RAM_DEVICE_BYTES);
+                return false;
+            }
+            _ram.timed = false;
+        }
+#endif
+        _fragFiles = 0;
+        if (_config.fragment) {
+            _fragFiles = min((size_t)FRAG_FILES, spareBytes() / FRAG_FILE_BYTES);
+        }
+        _fragIdx = 0;
+        _phase = FRAGMENT;
+        return true;
+    }
+
+    // Space of the device
+    size_t totalBytes() {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            return _ram.totalBytes();
+        }
+#endif
+        return LittleFS.totalBytes();
+    }
+
+    size_t usedBytes() {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            return _ram.usedBytes();
+        }
+#endif
+        return LittleFS.usedBytes();
+    }
+
+    size_t freeBytes() {
+        if (_device == DEV_FLASH) {
+            return _fs->freeBytes();
+        }
+        size_t total = totalBytes(), used = usedBytes();
+        return used < total ? total - used : 0;
+    }
+
+    // Space that can be used for fill and fragmentation files
+    size_t spareBytes() {
+        size_t free = freeBytes();
+        return free > BENCH_BYTES + RESERVE_BYTES ? free - BENCH_BYTES - RESERVE_BYTES : 0;
+    }
+
+    // Fill / fragmentation files (and the bench file on the RAM device)
+    bool fileOpen(const char *path) {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            _ramFileOpen = lfs_file_open(_ram.lfs(), &_ramFile, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) == LFS_ERR_OK;
+            return _ramFileOpen;
+        }
+#endif
+        _file = LittleFS.open(path, FILE_WRITE);
+        return (bool)_file;
+    }
+
+    bool fileIsOpen() {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            return _ramFileOpen;
+        }
+#endif
+        return (bool)_file;
+    }
+
+    size_t fileWrite(const uint8_t *buf, size_t len) {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            lfs_ssize_t written = _ramFileOpen ? lfs_file_write(_ram.lfs(), &_ramFile, buf, len) : 0;
+            return written > 0 ? written : 0;
+        }
+#endif
+        return _file.write(buf, len);
+    }
+
+    void fileClose() {
+#ifdef FSBENCH_LFS_RAM
+        if (_ramFileOpen) {
+            lfs_file_close(_ram.lfs(), &_ramFile);
+            _ramFileOpen = false;
+        }
+#endif
+        _file.close();
+    }
+
+    void fileRemove(const char *path) {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            lfs_remove(_ram.lfs(), path);
+            return;
+        }
+#endif
+        LittleFS.remove(path);
+    }
+
+    void fragmentStep() {
+        char path[32];
+        if (_fragIdx < _fragFiles) {
+            if (!fileIsOpen()) {
+                snprintf(path, sizeof(path), FRAG_FORMAT, _fragIdx);
+                fileOpen(path);
+                _fileBytes = FRAG_FILE_BYTES;
+            }
+            if (writeFileStep()) {
+                _fragIdx++;
+            }
+            return;
+        }
+        // every other file, so the free space is split into FRAG_FILE_BYTES holes
+        for (int i = 1; i < _fragFiles; i += 2) {
+            snprintf(path, sizeof(path), FRAG_FORMAT, i);
+            fileRemove(path);
+        }
+        size_t total = totalBytes(), used = usedBytes();
+        size_t target = (uint64_t)total * _config.fillPct / 100;
+        _fileBytes = target > used ? min(target - used, spareBytes()) : 0;
+        if (_fileBytes > 0) {
+            fileOpen(FILL_FILE);
+        }
+        _phase = FILL;
+    }
+
+    // Writes the next piece of the open file, returns true when it's complete (or can't be written)
+    bool writeFileStep() {
+        if (!fileIsOpen() || _fileBytes == 0) {
+            fileClose();
+            return true;
+        }
+        size_t len = min(_fileBytes, MAX_CHUNK);
+        if (fileWrite(_buf, len) != len) {
+            _fileBytes = 0;
+        }
+        else {
+            _fileBytes -= len;
+        }
+        return false;
+    }
+
+    void startRun() {
+        extern Telemetry telemetry;
+        _records = 0;
+        _bytes = 0;
+        _fsUs = 0;
+        memset(_hist, 0, sizeof(_hist));
+        _writeMaxUs = _flushes = _flushMaxUs = 0;
+        _bufLen = 0;
+        _flushEvery = _config.flushMs > 0 ? max((uint32_t)1, _config.flushMs * telemetry.capture.highRateHz / 1000) : 0;
+        _usedBefore = usedBytes();
+        _haveFlashStats = false;
+        _maxBlockErases = 0;
+        _flashUs = 0;
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            _ram.resetStats();
+            _ram.timed = true;
+            _haveFlashStats = true;
+            _blockLen = 0;
+            _blockSeq = 0;
+            _openFailed = !fileOpen(BENCH_FILE);
+            _phase = _openFailed ? REPORT : RUN;
+            return;
+        }
+#endif
+#ifdef LITTLEFS_FLASH_STATS
+        LittleFS.flashStats(&_programmed, &_erased);
+        _haveFlashStats = true;
+#endif
+        _openFailed = !_fs->openFile(BENCH_FILE, FILE_WRITE);
+        _phase = _openFailed ? REPORT : RUN;
+    }
+
+    // Write path of the run: TelemetryFS on the flash, the same calls of the littlefs API on the RAM device
+    void benchWriteRecord(const uint8_t *data, size_t len) {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            if (_blockLen + len > LogFormat::BLOCK_PAYLOAD) {
+                benchCommitBlock();
+            }
+            memcpy(_block + sizeof(LogFormat::blockHeader_t) + _blockLen, data, len);
+            _blockLen += len;
+            return;
+        }
+#endif
+        _fs->writeRecord(data, len);
+    }
+
+    void benchWrite(uint8_t *data, size_t len) {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            fileWrite(data, len);
+            return;
+        }
+#endif
+        _fs->write(data, len);
+    }
+
+    void benchFlush() {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            benchCommitBlock();
+            lfs_file_sync(_ram.lfs(), &_ramFile);
+            return;
+        }
+#endif
+        _fs->flush();
+    }
+
+    void benchClose() {
+#ifdef FSBENCH_LFS_RAM
+        if (_device == DEV_RAM) {
+            benchCommitBlock();
+            fileClose();
+            return;
+        }
+#endif
+        _fs->close();
+    }
+
+#ifdef FSBENCH_LFS_RAM
+    void benchCommitBlock() {
+        if (_blockLen == 0) {
+            return;
+        }
+        size_t len = LogFormat::frameBlock(_block, LogFormat::BLOCK_RECORDS, _blockSeq++, _blockLen);
+        _blockLen = 0;
+        fileWrite(_block, len);
+    }
+#endif
+
+    void runStep() {
+        memcpy(_record, &_records, min(sizeof(_records), (size_t)_config.recordSize));
+        uint32_t start = micros();
+        if (_config.chunk == CHUNK_BLOCKS) {
+            benchWriteRecord(_record, _config.recordSize);
+        }
+        else if (_config.chunk == CHUNK_RECORD) {
+            benchWrite(_record, _config.recordSize);
+        }
+        else {
+            for (size_t pos = 0; pos < _config.recordSize; ) {
+                size_t len = min(_config.recordSize - pos, _config.chunk - _bufLen);
+                memcpy(_buf + _bufLen, _record + pos, len);
+                _bufLen += len;
+                pos += len;
+                if (_bufLen == (size_t)_config.chunk) {
+                    benchWrite(_buf, _bufLen);
+                    _bufLen = 0;
+                }
+            }
+        }
+        uint32_t duration = micros() - start;
+        _fsUs += duration;
+        _hist[bucketOf(duration)]++;
+        _writeMaxUs = max(_writeMaxUs, duration);
+        _records++;
+        _bytes += _config.recordSize;
+
+        bool done = _bytes >= BENCH_BYTES;
+        if (done || (_flushEvery > 0 && _records % _flushEvery == 0)) {
+            start = micros();
+            if (_bufLen > 0) {
+                benchWrite(_buf, _bufLen);
+                _bufLen = 0;
+            }
+            benchFlush();
+            duration = micros() - start;
+            _fsUs += duration;
+            _flushes++;
+            _flushMaxUs = max(_flushMaxUs, duration);
+        }
+        if (done) {
+            start = micros();
+            benchClose();
+            _fsUs += micros() - start;
+#ifdef FSBENCH_LFS_RAM
+            if (_device == DEV_RAM) {
+                LfsRam::stats_t stats = _ram.stats();
+                _programmed = stats.bytesProgrammed;
+                _erased = stats.blocksErased;
+                _maxBlockErases = stats.maxBlockErases;
+                _flashUs = stats.flashUs;
+                _ram.timed = false;
+            }
+#endif
+#ifdef LITTLEFS_FLASH_STATS
+            if (_device == DEV_FLASH) {
+                uint64_t programmed;
+                uint32_t erased;
+                LittleFS.flashStats(&programmed, &erased);
+                _programmed = programmed - _programmed;
+                _erased = erased - _erased;
+            }
+#endif
+            _usedAfter = usedBytes();
+            _phase = REPORT;
+        }
+    }
+
+    void report(char *line, size_t size, size_t *len) {
+        int64_t used = (int64_t)_usedAfter - (int64_t)_usedBefore;     // negative if LittleFS freed blocks meanwhile
+        char chunk[8];
+        if (_config.chunk == CHUNK_BLOCKS || _config.chunk == CHUNK_RECORD) {
+            strcpy(chunk, _config.chunk == CHUNK_BLOCKS ? "block" : "record");
+        }
+        else {
+            snprintf(chunk, sizeof(chunk), "%d", _config.chunk);
+        }
+        LogFormat::appendf(line, size, len, "{\"device\":\"%s\",\"record\":%u,\"chunk\":\"%s\",\"flush_ms\":%u,"
+            "\"fill_pct\":%.1f,\"frag\":%d", _device == DEV_RAM ? "ram" : "flash", _config.recordSize, chunk,
+            _config.flushMs, 100.0f * _usedBefore / totalBytes(), _fragFiles);
+        if (_openFailed) {
+            LogFormat::appendf(line, size, len, ",\"error\":\"open failed\"}\n");
+            return;
+        }
+        LogFormat::appendf(line, size, len,
+            ",\"bytes\":%u,\"records\":%u,\"fs_us\":%llu,\"kb_s\":%.1f,\"write_p50_us\":%u,\"write_p99_us\":%u,"
+            "\"write_max_us\":%u,\"flushes\":%u,\"flush_max_us\":%u,\"used_bytes\":%lld,\"space_amp\":%.3f",
+            (unsigned)_bytes, _records, (unsigned long long)_fsUs, _fsUs > 0 ? _bytes / 1.024f / _fsUs * 1000 : 0.0f,
+            percentile(50), percentile(99), _writeMaxUs, _flushes, _flushMaxUs,
+            (long long)used, (float)used / _bytes);
+        if (_haveFlashStats) {
+            LogFormat::appendf(line, size, len, ",\"programmed\":%llu,\"erased\":%u,\"write_amp\":%.3f",
+                (unsigned long long)_programmed, _erased, (float)_programmed / _bytes);
+        }
+        if (_device == DEV_RAM) {
+            LogFormat::appendf(line, size, len, ",\"max_block_erases\":%u,\"flash_us\":%llu",
+                _maxBlockErases, (unsigned long long)_flashUs);
+        }
+        LogFormat::appendf(line, size, len, "}\n");
+    }
+
+    // Bench files on the flash, the RAM device gets formatted for the next configuration instead
+    void removeFiles() {
+        if (_device == DEV_RAM) {
+            return;
+        }
+        char path[32];
+        for (int i = 0; i < FRAG_FILES; i++) {
+            snprintf(path, sizeof(path), FRAG_FORMAT, i);
+            if (LittleFS.exists(path)) {
+                LittleFS.remove(path);
+            }
+        }
+        if (LittleFS.exists(FILL_FILE)) {
+            LittleFS.remove(FILL_FILE);
+        }
+        if (LittleFS.exists(BENCH_FILE)) {
+            LittleFS.remove(BENCH_FILE);
+        }
+    }
+
+    static int bucketOf(uint32_t us) {
+        if (us < 8) {
+            return us;
+        }
+        int msb = 31 - __builtin_clz(us);
+        return min(8 + (msb - 3) * 4 + (int)((us >> (msb - 2)) & 3), HIST_BUCKETS - 1);
+    }
+
+    // Upper bound of a bucket
+    static uint32_t bucketMaxUs(int bucket) {
+        if (bucket < 8) {
+            return bucket;
+        }
+        int msb = (bucket - 8) / 4 + 3;
+        return ((uint64_t)(5 + (bucket - 8) % 4) << (msb - 2)) - 1;
+    }
+
+    // Write latency percentile (upper bound of its bucket, at most the max)
+    uint32_t percentile(int pct) {
+        uint32_t rank = ((uint64_t)_records * pct + 99) / 100, count = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            count += _hist[i];
+            if (count >= rank && count > 0) {
+                return min(bucketMaxUs(i), _writeMaxUs);
+            }
+        }
+        return _writeMaxUs;
+    }
+};
+
+inline FsBench fsBench;
@@ -1,8 +1,11 @@
 #include <Arduino.h>
 #include <TinyGPSPlus.h>
+#include "console.h"
+#include "timebase.h"
 
 const int pinGpsTX = 6, pinGpsRX = 5;
 const int GPS_BAUD = 115200;
+const int pinGpsPPS = -1;      // PPS output of the receiver, disciplines the timebase to UTC (-1: not connected)
 #define GPS_SERIAL Serial0
 
 TinyGPSPlus gps;
@@ -10,15 +13,38 @@ TinyGPSPlus gps;
 void gpsInit() {
     GPS_SERIAL.setPins(pinGpsRX, pinGpsTX);
     GPS_SERIAL.begin(GPS_BAUD);
+    if (pinGpsPPS >= 0) {
+        timebase.attachPps(pinGpsPPS);
+    }
+    timebase.registerCommands();
+
+    console.addCommand({ "gps", "", "prints GPS fix and receiver statistics", 0, [](int argc, char **argv) {
+        CONSOLE_UART.printf("Fix: %s, SV: %u, lat: %f, lon: %f, alt: %.1f m, age: %u ms\n",
+            gps.location.isValid() ? "yes" : "no", gps.satellites.value(),
+            gps.location.lat(), gps.location.lng(), gps.altitude.meters(), gps.location.age());
+        CONSOLE_UART.printf("Chars: %u, with fix: %u, checksum passed: %u, failed: %u\n",
+            gps.charsProcessed(), gps.sentencesWithFix(), gps.passedChecksum(), gps.failedChecksum());
+    }});
 }
 
 uint32_t lastGpsPrint = 0;
 
+// Timebase of the latest location fix
+int64_t gpsFixTimeUs() {
+    return Timebase::nowUs() - (int64_t)gps.location.age() * 1000;
+}
+
 void gpsLoop() {
     while (GPS_SERIAL.available()) {
         gps.encode(GPS_SERIAL.read());
     }
 
+    if (gps.time.isUpdated() && gps.time.isValid() && gps.date.isValid() && gps.date.year() >= 2020) {
+        int64_t utcUs = Timebase::utcFromDate(gps.date.year(), gps.date.month(), gps.date.day(),
+            gps.time.hour(), gps.time.minute(), gps.time.second(), gps.time.centisecond());
+        timebase.updateGps(utcUs, gps.time.age() * 1000);
+    }
+
     if (millis() - lastGpsPrint > 5000) {
         lastGpsPrint = millis();
         // if (gps.charsProcessed() < 10)
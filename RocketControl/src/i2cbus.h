@@ -0,0 +1,220 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <esp_timer.h>
+#include "console.h"
+
+// Owns the shared I2C bus (Wire) and runs all device transactions from a single task.
+// Devices register a periodic poll job with a priority. When several jobs are due, the one with the
+// highest priority runs first (IMU before baro), so slow devices only delay others by one transaction.
+// The bus time of every device is measured, failed jobs are checked for NACK / timeout with an
+// address probe and the bus gets recovered (9 clock pulses + re-init) after repeated errors.
+// Device drivers must only access Wire from their jobs once start() was called.
+class I2CBus {
+    public:
+    static const int MAX_DEVICES = 4;
+    const uint32_t DEFAULT_CLOCK = 400000;
+    const uint8_t RECOVER_AFTER_ERRORS = 5;     // consecutive failed jobs before a bus recovery
+    const int TASK_PRIORITY = 5;                // below fin control, above the Arduino loop task
+
+    enum priority_e : uint8_t { PRIO_HIGH, PRIO_NORMAL, PRIO_LOW };
+
+    typedef bool (*job_t)();        // returns false if the transaction failed
+    typedef void (*recover_t)();    // re-initializes the device after a bus recovery
+
+    typedef struct {
+        const char *name;
+        uint8_t address;
+        priority_e priority;
+        uint32_t periodUs;
+        job_t job;
+        recover_t recover;
+
+        // statistics
+        uint32_t runs, errors, nacks, timeouts;
+        uint64_t busTimeUs;         // accumulated since the last statistics reset (64 bit, micros() wraps after 71 min)
+        uint32_t maxTimeUs;
+        uint32_t maxDelayUs;        // max time a job was run after it became due
+
+        uint32_t nextRunUs;
+        uint8_t consecutiveErrors;
+    } device_t;
+
+    void init(int pinSDA, int pinSCL, uint32_t clockHz = 0) {
+        _pinSDA = pinSDA;
+        _pinSCL = pinSCL;
+        _clockHz = clockHz ? clockHz : DEFAULT_CLOCK;
+        Wire.begin(_pinSDA, _pinSCL, _clockHz);
+        resetStats();
+        registerCommands();
+    }
+
+    // Register a device, call before start(). Returns the device index or -1.
+    int addDevice(const char *name, uint8_t address, priority_e priority, uint32_t periodUs, job_t job, recover_t recover = nullptr) {
+        if (_numDevices >= MAX_DEVICES || _task) {
+            Serial.printf("[I2C] Can't add device %s\n", name);
+            return -1;
+        }
+        device_t &dev = _devices[_numDevices];
+        dev = {0};
+        dev.name = name;
+        dev.address = address;
+        dev.priority = priority;
+        dev.periodUs = periodUs;
+        dev.job = job;
+        dev.recover = recover;
+        dev.nextRunUs = micros();
+        return _numDevices++;
+    }
+
+    // Start the bus task, from now on all bus access happens in device jobs
+    void start() {
+        xTaskCreate(taskFn, "i2cBus", 4096, this, TASK_PRIORITY, &_task);
+    }
+
+    // Run the most urgent due job, returns the time in us until the next job is due
+    uint32_t step() {
+        uint32_t now = micros();
+        device_t *next = nullptr;
+        for (int i = 0; i < _numDevices; i++) {
+            device_t &dev = _devices[i];
+            if ((int32_t)(now - dev.nextRunUs) >= 0 && (!next || dev.priority < next->priority)) {
+                next = &dev;
+            }
+        }
+        if (next) {
+            run(*next, now);
+        }
+
+        now = micros();
+        int32_t wait = INT32_MAX;
+        for (int i = 0; i < _numDevices; i++) {
+            wait = min(wait, (int32_t)(_devices[i].nextRunUs - now));
+        }
+        return max(wait, (int32_t)0);
+    }
+
+    int numDevices() {
+        return _numDevices;
+    }
+
+    device_t getDevice(int idx) {
+        return _devices[idx];
+    }
+
+    void resetStats() {
+        for (int i = 0; i < _numDevices; i++) {
+            device_t &dev = _devices[i];
+            dev.runs = dev.errors = dev.nacks = dev.timeouts = 0;
+            dev.busTimeUs = dev.maxTimeUs = dev.maxDelayUs = 0;
+        }
+        _statsSinceUs = esp_timer_get_time();
+    }
+
+    // Frees a stuck bus (slave holding SDA low) by clocking SCL and re-initializes all devices
+    void recover() {
+        _recoveries++;
+        Wire.end();
+        pinMode(_pinSDA, INPUT_PULLUP);
+        pinMode(_pinSCL, OUTPUT);
+        for (int i = 0; i < 9 && !digitalRead(_pinSDA); i++) {
+            digitalWrite(_pinSCL, LOW);
+            delayMicroseconds(5);
+            digitalWrite(_pinSCL, HIGH);
+            delayMicroseconds(5);
+        }
+        Wire.begin(_pinSDA, _pinSCL, _clockHz);
+        for (int i = 0; i < _numDevices; i++) {
+            if (_devices[i].recover) {
+                _devices[i].recover();
+            }
+            _devices[i].consecutiveErrors = 0;
+        }
+    }
+
+    void printStats() {
+        int64_t elapsed = max(esp_timer_get_time() - _statsSinceUs, (int64_t)1);
+        uint64_t totalBusTime = 0;
+        CONSOLE_UART.printf("I2C clock: %u Hz, recoveries: %u, stats over %u ms\n", _clockHz, _recoveries, (uint32_t)(elapsed / 1000));
+        CONSOLE_UART.printf("%-8s %4s %4s %8s %6s %6s %8s %8s %8s %6s\n",
+            "device", "addr", "prio", "runs", "errors", "nacks", "avg us", "max us", "delay us", "util%");
+        for (int i = 0; i < _numDevices; i++) {
+            device_t &dev = _devices[i];
+            totalBusTime += dev.busTimeUs;
+            CONSOLE_UART.printf("%-8s 0x%02X %4d %8u %6u %6u %8u %8u %8u %6.2f\n",
+                dev.name, dev.address, dev.priority, dev.runs, dev.errors, dev.nacks,
+                dev.runs ? (uint32_t)(dev.busTimeUs / dev.runs) : 0, dev.maxTimeUs, dev.maxDelayUs,
+                100.0 * dev.busTimeUs / elapsed);
+        }
+        CONSOLE_UART.printf("Bus utilization: %.2f %%\n", 100.0 * totalBusTime / elapsed);
+    }
+
+    protected:
+    device_t _devices[MAX_DEVICES];
+    int _numDevices = 0;
+    int _pinSDA = -1, _pinSCL = -1;
+    uint32_t _clockHz = 0;
+    uint32_t _recoveries = 0;
+    int64_t _statsSinceUs = 0;
+    TaskHandle_t _task = nullptr;
+
+    void run(device_t &dev, uint32_t now) {
+        dev.maxDelayUs = max(dev.maxDelayUs, now - dev.nextRunUs);
+
+        uint32_t start = micros();
+        bool ok = dev.job();
+        uint32_t duration = micros() - start;
+
+        dev.runs++;
+        dev.busTimeUs += duration;
+        dev.maxTimeUs = max(dev.maxTimeUs, duration);
+
+        // schedule relative to the planned time to keep the rate, skip missed periods
+        dev.nextRunUs += dev.periodUs;
+        if ((int32_t)(micros() - dev.nextRunUs) > 0) {
+            dev.nextRunUs = micros() + dev.periodUs;
+        }
+
+        if (ok) {
+            dev.consecutiveErrors = 0;
+            return;
+        }
+
+        dev.errors++;
+        Wire.beginTransmission(dev.address);
+        uint8_t err = Wire.endTransmission();
+        if (err == 2 || err == 3) {
+            dev.nacks++;
+        } else if (err == 5) {
+            dev.timeouts++;
+        }
+        if (++dev.consecutiveErrors >= RECOVER_AFTER_ERRORS) {
+            Serial.printf("[I2C] %s not responding, recovering bus\n", dev.name);
+            recover();
+        }
+    }
+
+    static void taskFn(void *arg) {
+        I2CBus *self = (I2CBus*)arg;
+        while (true) {
+            uint32_t waitUs = self->step();
+            if (waitUs > 0) {
+                // tick resolution is 1 ms, sleep at least one tick so lower priority tasks can run
+                vTaskDelay(max((TickType_t)1, (TickType_t)pdMS_TO_TICKS(waitUs / 1000)));
+            }
+        }
+    }
+
+    void registerCommands() {
+        console.addCommand({ "bus", "[reset]", "I2C bus utilization and device statistics", 0, [](int argc, char **argv) {
+            extern I2CBus i2cBus;
+            i2cBus.printStats();
+            if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+                i2cBus.resetStats();
+            }
+        }});
+    }
+};
+
+inline I2CBus i2cBus;
@@ -1,25 +1,105 @@
+#pragma once
+
 #include <Adafruit_BNO08x.h>
+#include "i2cbus.h"
+#include "timebase.h"
+#include "console.h"
 
 #define BNO08X_RESET -1 // Pin
+#define BNO08X_ADDRESS 0x4A
+
+const int IMU_MAX_EVENTS_PER_POLL = 16;     // limits the time one poll job can occupy the bus
+const uint32_t IMU_STALL_INTERVALS = 10;    // no report for this many of the shortest report intervals: poll failed
 
 struct euler_t {
     float yaw;
     float pitch;
     float roll;
-} ypr;
+};
+
+// Enabled sensor reports and their statistics
+typedef struct {
+    sh2_SensorId_t id;
+    const char *name;
+    uint32_t intervalUs;    // requested report interval
+    uint32_t count;         // received reports
+    uint32_t drops;         // reports missed according to the sequence numbers
+    uint32_t rateHz;        // measured report rate of the last full second
+    uint32_t lastRateCount;
+    uint8_t lastSeq;
+    bool seqValid;          // false after (re-)enabling the report
+} imuReport_t;
+
+imuReport_t imuReports[] = {
+    // id                           | name        | interval (us)
+    { SH2_ACCELEROMETER,            "accel",        5000 },
+    { SH2_GYROSCOPE_CALIBRATED,     "gyro",         5000 },
+    { SH2_MAGNETIC_FIELD_CALIBRATED,"magn",         20000 },
+    { SH2_ARVR_STABILIZED_RV,       "rotation",     5000 },
+};
+const int imuReportNum = sizeof(imuReports) / sizeof(imuReports[0]);
+
+// Latest values of all reports, written by the I2C bus task, read via imuGetData()
+// Timestamps are the sensor hub timestamps of the samples, converted to the timebase (us)
+typedef struct {
+    float accel[3];         // m/s^2, including gravity
+    float gyro[3];          // deg/s
+    float magn[3];          // uT
+    euler_t ypr;            // deg
+    uint8_t rvAccuracy;     // status of the rotation vector (0..3)
+    int64_t accelUs, gyroUs, magnUs, rotationUs;
+} imuData_t;
+
+// Latest attitude, shared with other tasks (e.g. fin control), access via imuGetAttitude()
+typedef struct {
+    float yaw, pitch, roll;     // degrees
+    uint32_t timestampUs;       // sensor timestamp of the sample
+    uint32_t seq;               // incremented for every new sample
+} imuAttitude_t;
+
+imuData_t imuData = {0};
+imuAttitude_t imuAttitude = {0};
+portMUX_TYPE imuDataMux = portMUX_INITIALIZER_UNLOCKED;
 
 Adafruit_BNO08x bno08x(BNO08X_RESET);
-sh2_SensorValue_t sensorValue;
+uint32_t imuRateWindowStart = 0;
+uint32_t imuLastEventUs = 0;        // micros() of the last report (or of enabling the reports)
+uint32_t imuStallUs = UINT32_MAX;   // set by imuInit()
+
+void imuGetData(imuData_t *data) {
+    portENTER_CRITICAL(&imuDataMux);
+    *data = imuData;
+    portEXIT_CRITICAL(&imuDataMux);
+}
 
-// Top frequency is about 250Hz but this report is more accurate
-sh2_SensorId_t reportType = SH2_ARVR_STABILIZED_RV;
-long reportIntervalUs = 5000;
+void imuGetAttitude(imuAttitude_t *att) {
+    portENTER_CRITICAL(&imuDataMux);
+    *att = imuAttitude;
+    portEXIT_CRITICAL(&imuDataMux);
+}
+
+void imuPublishAttitude(euler_t *ypr, uint32_t timestampUs) {
+    portENTER_CRITICAL(&imuDataMux);
+    imuData.ypr = *ypr;
+    imuAttitude.yaw = ypr->yaw;
+    imuAttitude.pitch = ypr->pitch;
+    imuAttitude.roll = ypr->roll;
+    imuAttitude.timestampUs = timestampUs;
+    imuAttitude.seq++;
+    portEXIT_CRITICAL(&imuDataMux);
+}
 
-void setReports(sh2_SensorId_t reportType, long report_interval) {
-    Serial.println("Setting desired reports");
-    if (!bno08x.enableReport(reportType, report_interval)) {
-        Serial.println("Could not enable stabilized remote vector");
+bool setReports() {
+    bool success = true;
+    for (int i = 0; i < imuReportNum; i++) {
+        if (!bno08x.enableReport(imuReports[i].id, imuReports[i].intervalUs)) {
+            Serial.printf("[IMU] Could not enable report %s\n", imuReports[i].name);
+            success = false;
+        }
+        imuReports[i].seqValid = false;     // sequence numbers restart
     }
+    imuLastEventUs = micros();              // give the first reports time to arrive
+    return success;
 }
 
 void quaternionToEuler(float qr, float qi, float qj, float qk, euler_t* ypr, bool degrees = false) {
@@ -47,48 +127,143 @@ void quaternionToEulerGI(sh2_GyroIntegratedRV_t* rotational_vector, euler_t* ypr
     quaternionToEuler(rotational_vector->real, rotational_vector->i, rotational_vector->j, rotational_vector->k, ypr, degrees);
 }
 
-void imuInit() {
-    // Try to initialize!
-    if (!bno08x.begin_I2C()) {
-        // if (!bno08x.begin_UART(&Serial1)) {  // Requires a device with > 300 byte UART buffer!
-        // if (!bno08x.begin_SPI(BNO08X_CS, BNO08X_INT)) {
-        Serial.println("Failed to find BNO08x chip");
-        while (1) {
-            delay(10);
+// Count received and missed reports (sequence numbers are per report and wrap at 256)
+void imuCountReport(sh2_SensorValue_t *value) {
+    for (int i = 0; i < imuReportNum; i++) {
+        imuReport_t &report = imuReports[i];
+        if (report.id == value->sensorId) {
+            if (report.seqValid) {
+                report.drops += (uint8_t)(value->sequence - report.lastSeq - 1);
+            }
+            report.lastSeq = value->sequence;
+            report.seqValid = true;
+            report.count++;
+            return;
         }
     }
-    Serial.println("BNO08x Found!");
+}
+
+void imuHandleEvent(sh2_SensorValue_t *value) {
+    imuCountReport(value);
+    // the sh2 host timestamps are based on micros()
+    int64_t timestampUs = Timebase::fromMicros32((uint32_t)value->timestamp);
 
-    setReports(reportType, reportIntervalUs);
+    switch (value->sensorId) {
+        case SH2_ACCELEROMETER: {
+            sh2_Accelerometer_t &a = value->un.accelerometer;
+            portENTER_CRITICAL(&imuDataMux);
+            imuData.accel[0] = a.x;
+            imuData.accel[1] = a.y;
+            imuData.accel[2] = a.z;
+            imuData.accelUs = timestampUs;
+            portEXIT_CRITICAL(&imuDataMux);
+            break;
+        }
+        case SH2_GYROSCOPE_CALIBRATED: {
+            sh2_Gyroscope_t &g = value->un.gyroscope;
+            portENTER_CRITICAL(&imuDataMux);
+            imuData.gyro[0] = g.x * RAD_TO_DEG;
+            imuData.gyro[1] = g.y * RAD_TO_DEG;
+            imuData.gyro[2] = g.z * RAD_TO_DEG;
+            imuData.gyroUs = timestampUs;
+            portEXIT_CRITICAL(&imuDataMux);
+            break;
+        }
+        case SH2_MAGNETIC_FIELD_CALIBRATED: {
+            sh2_MagneticField_t &m = value->un.magneticField;
+            portENTER_CRITICAL(&imuDataMux);
+            imuData.magn[0] = m.x;
+            imuData.magn[1] = m.y;
+            imuData.magn[2] = m.z;
+            imuData.magnUs = timestampUs;
+            portEXIT_CRITICAL(&imuDataMux);
+            break;
+        }
+        case SH2_ARVR_STABILIZED_RV: {
+            euler_t ypr;
+            quaternionToEulerRV(&value->un.arvrStabilizedRV, &ypr, true);
+            imuPublishAttitude(&ypr, (uint32_t)value->timestamp);
+            portENTER_CRITICAL(&imuDataMux);
+            imuData.rvAccuracy = value->status & 0x03;
+            imuData.rotationUs = timestampUs;
+            portEXIT_CRITICAL(&imuDataMux);
+            break;
+        }
+        case SH2_GYRO_INTEGRATED_RV: {
+            // faster (more noise?), only used if enabled in imuReports[]
+            euler_t ypr;
+            quaternionToEulerGI(&value->un.gyroIntegratedRV, &ypr, true);
+            imuPublishAttitude(&ypr, (uint32_t)value->timestamp);
+            break;
+        }
+    }
 }
 
-void imuLoop() {
+// Poll job, runs in the I2C bus task. Drains all pending sensor events.
+// Note: the Adafruit driver only keeps the last report if the sensor hub bundles several
+// reports into one packet, such losses show up in the drop counters.
+// The driver doesn't report bus / SH2 errors (getSensorEvent() is false for those and for "nothing pending"), so the
+// poll fails when no report arrived for IMU_STALL_INTERVALS intervals: the bus manager then counts the errors, probes
+// the address and after repeated failures recovers the bus and re-enables the reports (setReports()).
+bool imuLoop() {
     if (bno08x.wasReset()) {
-        Serial.print("sensor was reset ");
-        setReports(reportType, reportIntervalUs);
+        Serial.println("[IMU] Sensor was reset");
+        setReports();
     }
 
-    if (bno08x.getSensorEvent(&sensorValue)) {
-        // in this demo only one report type will be received depending on FAST_MODE define (above)
-        switch (sensorValue.sensorId) {
-        case SH2_ARVR_STABILIZED_RV:
-            quaternionToEulerRV(&sensorValue.un.arvrStabilizedRV, &ypr, true);
-        case SH2_GYRO_INTEGRATED_RV:
-            // faster (more noise?)
-            quaternionToEulerGI(&sensorValue.un.gyroIntegratedRV, &ypr, true);
-            break;
+    sh2_SensorValue_t sensorValue;
+    for (int i = 0; i < IMU_MAX_EVENTS_PER_POLL && bno08x.getSensorEvent(&sensorValue); i++) {
+        imuHandleEvent(&sensorValue);
+        imuLastEventUs = micros();
+    }
+
+    uint32_t now = millis();
+    if (now - imuRateWindowStart >= 1000) {
+        for (int i = 0; i < imuReportNum; i++) {
+            imuReports[i].rateHz = (imuReports[i].count - imuReports[i].lastRateCount) * 1000 / (now - imuRateWindowStart);
+            imuReports[i].lastRateCount = imuReports[i].count;
         }
-        static long last = 0;
-        long now = micros();
-        Serial.print(now - last);
-        Serial.print("\t");
-        last = now;
-        Serial.print(sensorValue.status);
-        Serial.print("\t"); // This is accuracy in the range of 0 to 3
-        Serial.print(ypr.yaw);
-        Serial.print("\t");
-        Serial.print(ypr.pitch);
-        Serial.print("\t");
-        Serial.println(ypr.roll);
+        imuRateWindowStart = now;
+    }
+    return micros() - imuLastEventUs < imuStallUs;
+}
+
+void imuPrintStats() {
+    imuData_t data;
+    imuGetData(&data);
+    CONSOLE_UART.printf("%-10s %8s %8s %8s %8s\n", "report", "interval", "rate Hz", "count", "drops");
+    for (int i = 0; i < imuReportNum; i++) {
+        imuReport_t &report = imuReports[i];
+        CONSOLE_UART.printf("%-10s %8u %8u %8u %8u\n", report.name, report.intervalUs, report.rateHz, report.count, report.drops);
     }
-}
\ No newline at end of file
+    CONSOLE_UART.printf("accel: %.2f %.2f %.2f m/s^2, gyro: %.1f %.1f %.1f deg/s, magn: %.1f %.1f %.1f uT\n",
+        data.accel[0], data.accel[1], data.accel[2], data.gyro[0], data.gyro[1], data.gyro[2], data.magn[0], data.magn[1], data.magn[2]);
+    CONSOLE_UART.printf("yaw: %.1f, pitch: %.1f, roll: %.1f deg, accuracy: %u\n", data.ypr.yaw, data.ypr.pitch, data.ypr.roll, data.rvAccuracy);
+}
+
+// Call in setup() after i2cBus.init() and before i2cBus.start()
+bool imuInit() {
+    // Try to initialize!
+    if (!bno08x.begin_I2C(BNO08X_ADDRESS, &Wire)) {
+        // if (!bno08x.begin_UART(&Serial1)) {  // Requires a device with > 300 byte UART buffer!
+        // if (!bno08x.begin_SPI(BNO08X_CS, BNO08X_INT)) {
+        Serial.println("[IMU] Failed to find BNO08x chip");
+        return false;
+    }
+    Serial.println("[IMU] BNO08x Found!");
+
+    setReports();
+
+    // poll twice per shortest report interval, so samples don't pile up in the sensor
+    uint32_t minInterval = UINT32_MAX;
+    for (int i = 0; i < imuReportNum; i++) {
+        minInterval = min(minInterval, imuReports[i].intervalUs);
+    }
+    imuStallUs = IMU_STALL_INTERVALS * minInterval;
+    i2cBus.addDevice("bno08x", BNO08X_ADDRESS, I2CBus::PRIO_HIGH, minInterval / 2, imuLoop, []() { setReports(); });
+
+    console.addCommand({ "imu", "", "IMU report rates, drop counters and latest values", 0, [](int argc, char **argv) {
+        imuPrintStats();
+    }});
+    return true;
+}
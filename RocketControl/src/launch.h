@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+// Detects launch and landing from acceleration magnitude and barometric altitude.
+// Has no hardware dependencies, so recorded flights can be replayed through it on the host.
+class LaunchDetector {
+    public:
+    enum state_e : uint8_t {
+        PAD,        // waiting for launch
+        FLIGHT,     // launch detected
+        LANDED,     // altitude did not change for a while after the launch
+    };
+
+    typedef struct {
+        float accelThreshold;       // m/s^2, acceleration magnitude that counts as launch
+        uint32_t accelHoldMs;       // acceleration needs to stay above the threshold for this long
+        float altitudeGain;         // m above the pad altitude that counts as launch (0: disabled)
+        float padTimeConstS;        // s, time constant of the pad altitude tracking (baro drift)
+        float padFreezeGain;        // m, pad altitude tracking pauses while the altitude is this much above it
+        float landedTolerance;      // m, max altitude change while landed
+        uint32_t landedHoldMs;      // altitude needs to be stable for this long to detect the landing
+        uint32_t minFlightMs;       // no landing detection before this time after launch
+    } config_t;
+
+    config_t config = {
+        .accelThreshold = 30,
+        .accelHoldMs = 50,
+        .altitudeGain = 20,
+        .padTimeConstS = 30,
+        .padFreezeGain = 3,
+        .landedTolerance = 2,
+        .landedHoldMs = 5000,
+        .minFlightMs = 3000,
+    };
+
+    // Feed a new sample, accel: magnitude of the acceleration vector in m/s^2, altitude in m (NAN if not available)
+    // Returns true if the state changed
+    bool update(uint32_t ms, float accel, float altitude) {
+        state_e oldState = _state;
+        bool haveAltitude = !isnan(altitude);
+
+        switch (_state) {
+            case PAD:
+                // slowly track the pad altitude, so baro drift doesn't trigger, but not a slow ascent
+                if (haveAltitude) {
+                    if (isnan(_padAltitude)) {
+                        _padAltitude = altitude;
+                    } else if (altitude - _padAltitude < config.padFreezeGain) {
+                        float dt = (ms - _padMs) / 1000.0f;
+                        _padAltitude += (altitude - _padAltitude) * dt / (config.padTimeConstS + dt);
+                    }
+                    _padMs = ms;
+                }
+
+                if (accel >= config.accelThreshold) {
+                    if (!_accelAbove) {
+                        _accelAbove = true;
+                        _accelAboveSince = ms;
+                    }
+                    if (ms - _accelAboveSince >= config.accelHoldMs) {
+                        trigger(ms);
+                    }
+                } else {
+                    _accelAbove = false;
+                }
+
+                if (config.altitudeGain > 0 && haveAltitude && !isnan(_padAltitude) &&
+                    altitude - _padAltitude >= config.altitudeGain) {
+                    trigger(ms);
+                }
+                break;
+
+            case FLIGHT:
+                if (!haveAltitude) {
+                    break;
+                }
+                if (isnan(_landedRefAltitude) || fabsf(altitude - _landedRefAltitude) > config.landedTolerance) {
+                    _landedRefAltitude = altitude;
+                    _landedRefMs = ms;
+                }
+                if (ms - _launchMs >= config.minFlightMs && ms - _landedRefMs >= config.landedHoldMs) {
+                    _state = LANDED;
+                }
+                break;
+
+            case LANDED:
+                break;
+        }
+        return _state != oldState;
+    }
+
+    // Force the launch state, e.g. for ground tests
+    void trigger(uint32_t ms) {
+        if (_state == PAD) {
+            _state = FLIGHT;
+            _launchMs = ms;
+            _landedRefAltitude = NAN;
+        }
+    }
+
+    void reset() {
+        _state = PAD;
+        _accelAbove = false;
+        _padAltitude = NAN;
+    }
+
+    state_e state() { return _state; }
+    uint32_t launchMs() { return _launchMs; }
+    float padAltitude() { return _padAltitude; }
+
+    static const char *stateName(state_e state) {
+        switch (state) {
+            case PAD:       return "pad";
+            case FLIGHT:    return "flight";
+            case LANDED:    return "landed";
+        }
+        return "?";
+    }
+
+    protected:
+    state_e _state = PAD;
+    bool _accelAbove = false;
+    uint32_t _accelAboveSince = 0;
+    float _padAltitude = NAN;
+    uint32_t _padMs = 0;            // time of the last pad altitude sample
+    uint32_t _launchMs = 0;
+    float _landedRefAltitude = NAN;
+    uint32_t _landedRefMs = 0;
+};
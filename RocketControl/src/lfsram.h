@@ -0,0 +1,160 @@
+#pragma once
+
+#include <Arduino.h>
+#include <lfs.h>
+
+// LittleFS (the littlefs library, lfs_*) on a RAM block device with the geometry of the flash partition and the
+// cache sizes of the LittleFS of the Arduino core (esp_littlefs). The block device callbacks count reads, programs
+// and erases (also per block) and charge a NOR flash timing with delayMicroseconds(), so the time spent in lfs_*
+// calls includes the flash time. Programs can only clear bits like on NOR flash.
+// Needs the littlefs library, added with lib_deps in the simulator build (FSBENCH_LFS_RAM). Not for the target: the
+// Arduino core links its own build of littlefs (esp_littlefs, own configuration) for LittleFS.
+class LfsRam {
+    public:
+    static const lfs_size_t BLOCK_SIZE = 4096;      // flash sector, erase unit
+    static const lfs_size_t READ_SIZE = 128;
+    static const lfs_size_t PROG_SIZE = 128;
+    static const lfs_size_t CACHE_SIZE = 512;
+    static const lfs_size_t LOOKAHEAD_SIZE = 128;
+    static const int32_t BLOCK_CYCLES = 512;
+
+    // Typical SPI NOR flash timing (same as the flash model of the simulator), 0 disables the timing
+    typedef struct {
+        uint32_t pageSize = 256;
+        uint32_t pageProgramUs = 700;
+        uint32_t blockEraseUs = 45000;
+    } timing_t;
+
+    typedef struct {
+        uint64_t bytesRead;
+        uint64_t bytesProgrammed;
+        uint32_t blocksErased;
+        uint32_t maxBlockErases;    // erases of the most erased block (wear)
+        uint64_t flashUs;           // charged flash time
+    } stats_t;
+
+    timing_t timing;
+    bool timed = true;              // false: no flash time is charged (e.g. while preparing a run)
+
+    ~LfsRam() { end(); }
+
+    // Allocates the device, formats and mounts it, false if out of memory or lfs failed
+    bool begin(size_t bytes) {
+        end();
+        _blockCount = bytes / BLOCK_SIZE;
+        _data = (uint8_t*)malloc((size_t)_blockCount * BLOCK_SIZE);
+        _erases = (uint32_t*)calloc(_blockCount, sizeof(uint32_t));
+        if (!_data || !_erases || _blockCount < 4) {
+            end();
+            return false;
+        }
+        memset(_data, 0xFF, (size_t)_blockCount * BLOCK_SIZE);
+
+        memset(&_config, 0, sizeof(_config));
+        _config.context = this;
+        _config.read = read;
+        _config.prog = prog;
+        _config.erase = erase;
+        _config.sync = sync;
+        _config.read_size = READ_SIZE;
+        _config.prog_size = PROG_SIZE;
+        _config.block_size = BLOCK_SIZE;
+        _config.block_count = _blockCount;
+        _config.block_cycles = BLOCK_CYCLES;
+        _config.cache_size = CACHE_SIZE;
+        _config.lookahead_size = LOOKAHEAD_SIZE;
+
+        int err = lfs_format(&_lfs, &_config);
+        if (err == LFS_ERR_OK) {
+            err = lfs_mount(&_lfs, &_config);
+        }
+        if (err != LFS_ERR_OK) {
+            Serial.printf("[LfsRam] Error: format / mount failed (%d)\n", err);
+            end();
+            return false;
+        }
+        _mounted = true;
+        resetStats();
+        return true;
+    }
+
+    void end() {
+        if (_mounted) {
+            lfs_unmount(&_lfs);
+        }
+        _mounted = false;
+        free(_data);
+        free(_erases);
+        _data = nullptr;
+        _erases = nullptr;
+        _blockCount = 0;
+    }
+
+    lfs_t *lfs() { return &_lfs; }
+
+    size_t totalBytes() { return (size_t)_blockCount * BLOCK_SIZE; }
+
+    // Blocks in use (lfs_fs_size(), includes the metadata blocks)
+    size_t usedBytes() {
+        lfs_ssize_t blocks = _mounted ? lfs_fs_size(&_lfs) : 0;
+        return blocks > 0 ? (size_t)blocks * BLOCK_SIZE : 0;
+    }
+
+    const stats_t &stats() { return _stats; }
+
+    void resetStats() {
+        _stats = {0};
+        if (_erases) {
+            memset(_erases, 0, _blockCount * sizeof(uint32_t));
+        }
+    }
+
+    protected:
+    struct lfs_config _config;
+    lfs_t _lfs;
+    bool _mounted = false;
+    uint8_t *_data = nullptr;
+    uint32_t *_erases = nullptr;    // per block
+    lfs_size_t _blockCount = 0;
+    stats_t _stats = {0};
+
+    void charge(uint32_t us) {
+        if (timed && us > 0) {
+            _stats.flashUs += us;
+            delayMicroseconds(us);
+        }
+    }
+
+    static int read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size) {
+        LfsRam *self = (LfsRam*)c->context;
+        memcpy(buffer, self->_data + (size_t)block * BLOCK_SIZE + off, size);
+        self->_stats.bytesRead += size;
+        return LFS_ERR_OK;
+    }
+
+    static int prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size) {
+        LfsRam *self = (LfsRam*)c->context;
+        uint8_t *dst = self->_data + (size_t)block * BLOCK_SIZE + off;
+        const uint8_t *src = (const uint8_t*)buffer;
+        for (lfs_size_t i = 0; i < size; i++) {
+            dst[i] &= src[i];       // NOR flash: a program only clears bits
+        }
+        self->_stats.bytesProgrammed += size;
+        const timing_t &t = self->timing;
+        self->charge(t.pageSize ? (uint32_t)((uint64_t)size * t.pageProgramUs / t.pageSize) : 0);
+        return LFS_ERR_OK;
+    }
+
+    static int erase(const struct lfs_config *c, lfs_block_t block) {
+        LfsRam *self = (LfsRam*)c->context;
+        memset(self->_data + (size_t)block * BLOCK_SIZE, 0xFF, BLOCK_SIZE);
+        self->_stats.blocksErased++;
+        self->_stats.maxBlockErases = max(self->_stats.maxBlockErases, ++self->_erases[block]);
+        self->charge(self->timing.blockEraseUs);
+        return LFS_ERR_OK;
+    }
+
+    static int sync(const struct lfs_config *c) {
+        return LFS_ERR_OK;
+    }
+};
@@ -0,0 +1,598 @@
+#pragma once
+
+#include <string.h>
+#include <math.h>
+#include "logformat.h"
+#include "crc32.h"
+
+// Streaming decoder for telemetry log files with a fixed memory budget (about 3 KB, no heap, nothing sized from the file).
+// The file is pulled through a read callback, so the same code reads LittleFS files on the device and files or pipes
+// on the host. The header is validated before anything depends on it, invalid data between blocks is skipped by
+// searching for the next block that passes its CRC. Live streams (beginStream()) work the same way, their schema
+// comes in a BLOCK_HEADER block.
+// No Arduino dependencies, so it can also be used in host tools.
+//
+//     LogDecoder decoder;
+//     if (decoder.begin(readFn, ctx)) {
+//         while (LogDecoder::event_e event = decoder.next()) {
+//             if (event == LogDecoder::EV_RECORD) { decoder.value(decoder.record(), idx, values); ... }
+//         }
+//     }
+class LogDecoder : public LogFormat {
+    public:
+    static const int MAX_ENTRY_DEFS = 32;
+    static const int MAX_RECORD_SIZE = 256;
+    static const int MAX_COLUMNS = MAX_ENTRY_DEFS * 4;
+    static const size_t COLUMN_CHUNK = 128;     // records per pass of decodeColumns(), stays in L1 across the columns
+
+    // Column of the batch decoder: one component of a field, precomputed from the header
+    typedef struct {
+        uint16_t offset;            // byte offset in the record
+        logEntryDef_type_e type;    // scalar type (*_VEC types are split into T_I16 / T_U8 columns)
+        uint8_t field;              // index of the log entry definition
+        float invScale;             // 1 / multiplier
+    } column_t;
+
+    // Reads up to len bytes into buf, returns the number of bytes read (0: end of the file)
+    typedef size_t (*readFn_t)(void *ctx, uint8_t *buf, size_t len);
+
+    enum event_e : uint8_t {
+        EV_END,             // end of the file (or begin() failed)
+        EV_RECORD,          // record() points to the next record
+        EV_TIME,            // time() holds an update of the time mapping
+        EV_SKIPPED,         // skipped() invalid bytes at skippedOffset() were ignored
+        EV_HEADER,          // new schema (stream only), header() / defs() / recordSize() changed
+    };
+
+    enum error_e : uint8_t {
+        ERR_NONE,
+        ERR_TRUNCATED,      // file ends within the header
+        ERR_VERSION,        // unsupported file version
+        ERR_HEADER,         // header size doesn't match the number of log entry definitions
+        ERR_DEFS,           // no or more than MAX_ENTRY_DEFS log entry definitions
+        ERR_TYPE,           // unknown data type
+        ERR_NAME,           // field name not terminated or not printable
+        ERR_RECORD_SIZE,    // record larger than MAX_RECORD_SIZE
+    };
+
+    static const char *errorName(error_e error) {
+        switch (error) {
+            case ERR_NONE:          return "ok";
+            case ERR_TRUNCATED:     return "file too short";
+            case ERR_VERSION:       return "unsupported file version";
+            case ERR_HEADER:        return "invalid header size";
+            case ERR_DEFS:          return "invalid number of log entry definitions";
+            case ERR_TYPE:          return "unknown data type";
+            case ERR_NAME:          return "invalid field name";
+            case ERR_RECORD_SIZE:   return "record size too large";
+        }
+        return "?";
+    }
+
+    // Reads and validates the file header, returns false if the file can't be decoded (see error())
+    bool begin(readFn_t read, void *ctx) {
+        reset();
+        _read = read;
+        _ctx = ctx;
+
+        // files without magic start with the legacy header
+        size_t structSize = sizeof(flashEntryHeader_t);
+        _header = {0};
+        if (!fill(sizeof(_header.magic))) {
+            return fail(ERR_TRUNCATED);
+        }
+        memcpy(&_header.magic, _buf, sizeof(_header.magic));
+        if (_header.magic == LOG_FILE_MAGIC) {
+            if (!fill(sizeof(_header))) {
+                return fail(ERR_TRUNCATED);
+            }
+            memcpy(&_header, _buf, sizeof(_header));
+            if (_header.version == 0 || _header.version > LOG_FILE_VERSION) {
+                return fail(ERR_VERSION);
+            }
+        } else {
+            flashEntryHeaderV0_t legacy;
+            structSize = sizeof(legacy);
+            if (!fill(sizeof(legacy))) {
+                return fail(ERR_TRUNCATED);
+            }
+            memcpy(&legacy, _buf, sizeof(legacy));
+            _header.magic = 0;
+            _header.version = 0;
+            _header.headerSize = legacy.headerSize;
+            _header.numLogEntryDefs = legacy.numLogEntryDefs;
+            if (legacy.headerSize != _header.headerSize) {
+                return fail(ERR_HEADER);
+            }
+        }
+
+        if (!checkHeaderSize(structSize)) {
+            return false;
+        }
+        size_t defsSize = _header.headerSize - structSize;
+        drop(structSize);
+        if (!fill(defsSize)) {
+            return fail(ERR_TRUNCATED);
+        }
+        memcpy(_defs, _buf, defsSize);
+        drop(defsSize);
+        _validEnd = _offset;
+        return validateDefs(_header.numLogEntryDefs);
+    }
+
+    // Decodes a live stream of blocks without file header, records are skipped until the first BLOCK_HEADER block
+    void beginStream(readFn_t read, void *ctx) {
+        reset();
+        _read = read;
+        _ctx = ctx;
+        clearSchema();
+    }
+
+    // Use a known schema without a file, e.g. for records received via radio (record() / next() are not used)
+    bool setDefs(const logEntryDef_t *defs, int num) {
+        reset();
+        if (num <= 0 || num > MAX_ENTRY_DEFS) {
+            return fail(ERR_DEFS);
+        }
+        memcpy(_defs, defs, num * sizeof(logEntryDef_t));
+        _header = {0};
+        _header.numLogEntryDefs = num;
+        return validateDefs(num);
+    }
+
+    // Pulls the next item of the file
+    event_e next() {
+        if (_error != ERR_NONE || !_read) {
+            return EV_END;
+        }
+        if (_pending != EV_END) {
+            event_e event = _pending;
+            _pending = EV_END;
+            return event;
+        }
+        while (true) {
+            if (_recordPos < _recordEnd) {       // _recordEnd is a whole number of records after _recordPos
+                _record = _buf + _recordPos;
+                _recordPos += _recordSize;
+                _records++;
+                return EV_RECORD;
+            }
+            drop(_consume);
+            _consume = _recordPos = _recordEnd = 0;
+
+            // version 0 / 1: plain records, a partial record at the end is reported as skipped
+            if (_header.version < 2) {
+                if (!fill(_recordSize)) {
+                    return skipRest() ? EV_SKIPPED : EV_END;
+                }
+                _recordEnd = _consume = _recordSize;
+                _validEnd = _offset + _recordSize;
+                continue;
+            }
+
+            uint64_t skipOffset = _offset;
+            uint32_t skipped = 0;
+            event_e event = EV_RECORD;
+            switch (readBlock(&skipped)) {
+                case BLOCK_NONE:
+                    event = EV_END;
+                    break;
+                case BLOCK_RECORDS:
+                    if (_recordSize == 0) {
+                        skipped += _consume;    // stream without schema yet
+                        break;
+                    }
+                    _recordPos = sizeof(blockHeader_t);
+                    _recordEnd = _recordPos + _block.length / _recordSize * _recordSize;
+                    break;
+                case BLOCK_TIME:
+                    if (_block.length >= sizeof(timeBlock_t)) {
+                        memcpy(&_time, _buf + sizeof(blockHeader_t), sizeof(_time));
+                        event = EV_TIME;
+                    }
+                    break;
+                case BLOCK_HEADER:
+                    if (loadStreamHeader(_buf + sizeof(blockHeader_t), _block.length)) {
+                        event = EV_HEADER;
+                    } else {
+                        skipped += _consume;
+                    }
+                    break;
+                default:
+                    break;      // block type of a newer firmware, ignored
+            }
+            if (skipped) {
+                _skipped = skipped;
+                _skippedOffset = skipOffset;
+                _skippedTotal += skipped;
+                _pending = event == EV_TIME || event == EV_HEADER ? event : EV_END;
+                return EV_SKIPPED;
+            }
+            if (event != EV_RECORD) {
+                return event;
+            }
+        }
+    }
+
+    error_e error() { return _error; }
+    // Header of the file, legacy headers are returned as version 0 without magic and time mapping
+    const flashEntryHeader_t &header() { return _header; }
+    const logEntryDef_t *defs() { return _defs; }
+    int numDefs() { return _header.numLogEntryDefs; }
+    int recordSize() { return _recordSize; }
+
+    // Current item, valid until the next call of next()
+    const uint8_t *record() { return _record; }
+    const timeBlock_t &time() { return _time; }
+    uint32_t skipped() { return _skipped; }
+    uint64_t skippedOffset() { return _skippedOffset; }
+
+    uint32_t records() { return _records; }             // records returned so far
+    uint32_t blocks() { return _blocks; }               // valid blocks read so far
+    uint64_t skippedTotal() { return _skippedTotal; }
+    uint64_t validEnd() { return _validEnd; }           // file offset after the last valid block / record
+
+    // Index of the field with the given name, -1 if the file doesn't have it
+    int fieldIndex(const char *name) {
+        for (int i = 0; i < _header.numLogEntryDefs; i++) {
+            if (strncmp(_defs[i].name, name, sizeof(_defs[i].name)) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // All components of a field of a record (multiplier applied), returns the number of components
+    int value(const uint8_t *record, int idx, float *values) {
+        if (idx < 0 || idx >= _header.numLogEntryDefs) {
+            return 0;
+        }
+        return decodeValues(record, _defs[idx], _invScale[idx], values);
+    }
+
+    // Batch decoding of whole flights: every component of every field is a column (the order of the CSV columns)
+    int numColumns() { return _numColumns; }
+    const column_t &column(int c) { return _columns[c]; }
+
+    // Column of a component of the field with the given name, -1 if the file doesn't have it
+    int columnIndex(const char *name, int component = 0) {
+        int idx = fieldIndex(name);
+        for (int c = 0; c < _numColumns && idx >= 0; c++) {
+            if (_columns[c].field == idx) {
+                return component < components(_defs[idx].type) ? c + component : -1;
+            }
+        }
+        return -1;
+    }
+
+    // Decodes count records (stride bytes apart, 0: recordSize()) into one array per column, multiplier applied.
+    // columns[c] receives count values of column c, nullptr skips the column.
+    void decodeColumns(const uint8_t *records, size_t count, float *const *columns, size_t stride = 0) {
+        stride = stride ? stride : _recordSize;
+        for (size_t start = 0; start < count; start += COLUMN_CHUNK) {
+            size_t n = count - start < COLUMN_CHUNK ? count - start : COLUMN_CHUNK;
+            for (int c = 0; c < _numColumns; c++) {
+                if (columns[c]) {
+                    decodeColumn<float, true>(records + start * stride, stride, n, _columns[c], columns[c] + start);
+                }
+            }
+        }
+    }
+
+    // Raw values of one column in a native integer type, without multiplier (e.g. uint64_t for time_us)
+    template<typename T>
+    void decodeColumnRaw(const uint8_t *records, size_t count, int column, T *out, size_t stride = 0) {
+        if (column >= 0 && column < _numColumns) {
+            decodeColumn<T, false>(records, stride ? stride : _recordSize, count, _columns[column], out);
+        }
+    }
+
+    void formatCsvHeader(char *line, size_t size, size_t *len) {
+        formatCsvHeader(line, size, len, _defs, _header.numLogEntryDefs);
+    }
+
+    void formatCsvRecord(char *line, size_t size, size_t *len, const uint8_t *record) {
+        formatCsvRecord(line, size, len, _defs, _header.numLogEntryDefs, record);
+    }
+
+    // Formats the header (log entry definitions) in a CSV-compatible representation
+    static void formatCsvHeader(char *line, size_t size, size_t *len, const logEntryDef_t *entryDefs, size_t num) {
+        *len = 0;
+        for (size_t i = 0; i < num; i++) {
+            switch (entryDefs[i].type) {
+                case T_I16_VEC3:
+                    appendf(line, size, len, "%s.x,%s.y,%s.z", entryDefs[i].name, entryDefs[i].name, entryDefs[i].name);
+                    break;
+                case T_U8_VEC4:
+                    appendf(line, size, len, "%s.a,%s.b,%s.c,%s.d", entryDefs[i].name, entryDefs[i].name, entryDefs[i].name, entryDefs[i].name);
+                    break;
+                default:
+                    appendf(line, size, len, "%s", entryDefs[i].name);
+                    break;
+            }
+
+            // Print comma, unless last field name
+            if (i < (num - 1)) {
+                appendf(line, size, len, ",");
+            }
+        }
+        appendf(line, size, len, "\n");
+    }
+
+    // Formats the values of a single log record
+    static void formatCsvRecord(char *line, size_t size, size_t *len, const logEntryDef_t *entryDefs, size_t entryNum, const uint8_t *recordBuf) {
+        *len = 0;
+        for (size_t i = 0; i < entryNum; i++) {
+            float multiplier = entryDefs[i].multiplier;
+            if (multiplier == 0) {
+                multiplier = 1;
+            }
+
+            // Define possible value datatypes as union like this to make handling easier
+            union {
+                uint64_t u64;
+                uint32_t u32;
+                int32_t i32;
+                float f32;
+                uint8_t u8_4[4];
+                int16_t i16_3[3];
+            } __attribute__((packed)) val;
+
+            memset(&val, 0, sizeof(val));   // clear value
+            memcpy(&val, recordBuf + entryDefs[i]._offset, entryDefs[i]._size); // copy raw value from buffer to val
+            if (entryDefs[i].type == T_I8) {
+                val.i32 = (int8_t)val.u32;      // sign extend
+            } else if (entryDefs[i].type == T_I16) {
+                val.i32 = (int16_t)val.u32;
+            }
+
+            // Print value according to datatype
+            switch (entryDefs[i].type) {
+                case T_U8:
+                case T_U16:
+                case T_U32:
+                    if (multiplier <= 1)    appendf(line, size, len, "%8u", (uint32_t)((float)val.u32 / multiplier)); // if resulting number has no decimal point, print as integer
+                    else                    appendf(line, size, len, "%10g", ((float)val.u32 / multiplier));          // else print shortest float representation
+                    break;
+                case T_I8:
+                case T_I16:
+                case T_I32:
+                    if (multiplier <= 1)    appendf(line, size, len, "%8d", (int32_t)((float)val.i32 / multiplier));
+                    else                    appendf(line, size, len, "%10g", ((float)val.i32 / multiplier));
+                    break;
+                case T_U64:
+                    appendf(line, size, len, "%12llu", (unsigned long long)val.u64);
+                    break;
+                case T_FLOAT:
+                    appendf(line, size, len, "%10f", (val.f32 / multiplier));
+                    break;
+                case T_I16_VEC3:
+                    for (int j = 0; j < 3; j++) {
+                        appendf(line, size, len, "%8g%s", (val.i16_3[j] / multiplier), j < 2 ? "," : "");
+                    }
+                    break;
+                case T_U8_VEC4:
+                    for (int j = 0; j < 4; j++) {
+                        appendf(line, size, len, "%5g%s", (val.u8_4[j] / multiplier), j < 3 ? "," : "");
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            // Print comma, unless last field name
+            if (i < (entryNum - 1)) {
+                appendf(line, size, len, ",");
+            }
+        }
+        appendf(line, size, len, "\n");
+    }
+
+    protected:
+    readFn_t _read = nullptr;
+    void *_ctx = nullptr;
+    error_e _error = ERR_NONE;
+    flashEntryHeader_t _header = {0};
+    logEntryDef_t _defs[MAX_ENTRY_DEFS];
+    float _invScale[MAX_ENTRY_DEFS];
+    column_t _columns[MAX_COLUMNS];
+    int _numColumns = 0;
+    int _recordSize = 0;
+
+    // read buffer, holds the current block (or record) at the start
+    uint8_t _buf[BLOCK_MAX];
+    size_t _bufLen = 0;
+    uint64_t _offset = 0;           // file offset of _buf[0]
+    bool _eof = false;
+    size_t _consume = 0;            // size of the current block / record, dropped before reading the next one
+    size_t _recordPos = 0, _recordEnd = 0;
+
+    blockHeader_t _block;
+    const uint8_t *_record = nullptr;
+    timeBlock_t _time = {0};
+    event_e _pending = EV_END;      // time / header block found after skipped data, returned after EV_SKIPPED
+    uint32_t _skipped = 0;
+    uint64_t _skippedOffset = 0, _skippedTotal = 0;
+    uint32_t _records = 0, _blocks = 0;
+    uint64_t _validEnd = 0;
+
+    void reset() {
+        _read = nullptr;
+        _error = ERR_NONE;
+        _recordSize = _numColumns = 0;
+        _bufLen = _consume = _recordPos = _recordEnd = 0;
+        _offset = 0;
+        _eof = false;
+        _pending = EV_END;
+        _skipped = _records = _blocks = 0;
+        _skippedOffset = _skippedTotal = _validEnd = 0;
+    }
+
+    bool fail(error_e error) {
+        _error = error;
+        _header.numLogEntryDefs = 0;
+        _numColumns = 0;
+        return false;
+    }
+
+    // Checks the number of log entry definitions in _header and that they fill the rest of the header
+    bool checkHeaderSize(size_t structSize) {
+        if (_header.numLogEntryDefs == 0 || _header.numLogEntryDefs > MAX_ENTRY_DEFS) {
+            return fail(ERR_DEFS);
+        }
+        if (_header.headerSize != structSize + _header.numLogEntryDefs * sizeof(logEntryDef_t)) {
+            return fail(ERR_HEADER);
+        }
+        return true;
+    }
+
+    // Schema of a BLOCK_HEADER block, an invalid one leaves the stream without schema (not an error of the stream)
+    bool loadStreamHeader(const uint8_t *data, size_t len) {
+        if (len >= sizeof(_header)) {
+            memcpy(&_header, data, sizeof(_header));
+            if (_header.magic == LOG_FILE_MAGIC && _header.version >= 2 && _header.version <= LOG_FILE_VERSION &&
+                checkHeaderSize(sizeof(_header)) && _header.headerSize == len) {
+                memcpy(_defs, data + sizeof(_header), len - sizeof(_header));
+                if (validateDefs(_header.numLogEntryDefs)) {
+                    return true;
+                }
+            }
+        }
+        clearSchema();
+        return false;
+    }
+
+    void clearSchema() {
+        _error = ERR_NONE;
+        _header = {0};
+        _header.version = LOG_FILE_VERSION;
+        _recordSize = _numColumns = 0;
+    }
+
+    // Calculates the record layout from _defs, rejects anything the writer can't have produced
+    bool validateDefs(int num) {
+        _recordSize = 0;
+        _numColumns = 0;
+        for (int i = 0; i < num; i++) {
+            logEntryDef_t &def = _defs[i];
+            if (def.type >= TYPE_COUNT) {
+                return fail(ERR_TYPE);
+            }
+            const char *end = (const char*)memchr(def.name, 0, sizeof(def.name));
+            if (!end || end == def.name) {
+                return fail(ERR_NAME);
+            }
+            for (const char *c = def.name; c < end; c++) {
+                if (*c < 0x20 || *c > 0x7E || *c == ',') {
+                    return fail(ERR_NAME);
+                }
+            }
+            if (!isfinite(def.multiplier) || def.multiplier == 0) {
+                def.multiplier = 1;
+            }
+            _invScale[i] = 1.0f / def.multiplier;
+            def._offset = _recordSize;
+            def._size = logEntryDef_type_size[def.type];
+            _recordSize += def._size;
+        }
+        if (_recordSize > MAX_RECORD_SIZE) {
+            return fail(ERR_RECORD_SIZE);
+        }
+        planColumns(num);
+        return true;
+    }
+
+    void planColumns(int num) {
+        _numColumns = 0;
+        for (int i = 0; i < num; i++) {
+            const logEntryDef_t &def = _defs[i];
+            logEntryDef_type_e type = def.type == T_I16_VEC3 ? T_I16 : def.type == T_U8_VEC4 ? T_U8 : def.type;
+            for (int j = 0; j < components(def.type); j++) {
+                _columns[_numColumns++] = { (uint16_t)(def._offset + j * logEntryDef_type_size[type]), type, (uint8_t)i, _invScale[i] };
+            }
+        }
+    }
+
+    // The type switch is outside of the loops, so the compiler gets one simple strided loop per type
+    template<typename T, bool scaled>
+    static void decodeColumn(const uint8_t *records, size_t stride, size_t count, const column_t &col, T *out) {
+        const uint8_t *src = records + col.offset;
+        switch (col.type) {
+            case T_I8:      convert<int8_t, T, scaled>(src, stride, count, col.invScale, out);     break;
+            case T_U8:      convert<uint8_t, T, scaled>(src, stride, count, col.invScale, out);    break;
+            case T_I16:     convert<int16_t, T, scaled>(src, stride, count, col.invScale, out);    break;
+            case T_U16:     convert<uint16_t, T, scaled>(src, stride, count, col.invScale, out);   break;
+            case T_I32:     convert<int32_t, T, scaled>(src, stride, count, col.invScale, out);    break;
+            case T_U32:     convert<uint32_t, T, scaled>(src, stride, count, col.invScale, out);   break;
+            case T_U64:     convert<uint64_t, T, scaled>(src, stride, count, col.invScale, out);   break;
+            case T_FLOAT:   convert<float, T, scaled>(src, stride, count, col.invScale, out);      break;
+            default:        break;
+        }
+    }
+
+    template<typename S, typename T, bool scaled>
+    static void convert(const uint8_t *src, size_t stride, size_t count, float invScale, T *out) {
+        for (size_t i = 0; i < count; i++) {
+            S v;
+            memcpy(&v, src + i * stride, sizeof(v));    // records are packed, fields are unaligned
+            out[i] = scaled ? (T)(v * invScale) : (T)v;
+        }
+    }
+
+    // Makes sure at least n (<= BLOCK_MAX) bytes are buffered, returns false if the file ends before
+    bool fill(size_t n) {
+        while (_bufLen < n && !_eof) {
+            size_t len = _read(_ctx, _buf + _bufLen, sizeof(_buf) - _bufLen);
+            if (len == 0) {
+                _eof = true;
+            }
+            _bufLen += len;
+        }
+        return _bufLen >= n;
+    }
+
+    void drop(size_t n) {
+        memmove(_buf, _buf + n, _bufLen - n);
+        _bufLen -= n;
+        _offset += n;
+    }
+
+    bool skipRest() {
+        if (_bufLen == 0) {
+            return false;
+        }
+        _skipped = _bufLen;
+        _skippedOffset = _offset;
+        _skippedTotal += _bufLen;
+        drop(_bufLen);
+        return true;
+    }
+
+    // Finds the next block that passes the CRC check and leaves it at the start of _buf, returns its type
+    blockType_e readBlock(uint32_t *skipped) {
+        while (true) {
+            if (!fill(sizeof(blockHeader_t))) {
+                *skipped += _bufLen;
+                drop(_bufLen);
+                return BLOCK_NONE;
+            }
+            memcpy(&_block, _buf, sizeof(_block));
+            size_t total = BLOCK_OVERHEAD + _block.length;
+            if (_block.sync == BLOCK_SYNC && _block.type != BLOCK_NONE && _block.length <= BLOCK_PAYLOAD && fill(total)) {
+                uint32_t crc;
+                memcpy(&crc, _buf + total - sizeof(crc), sizeof(crc));
+                if (crc == Crc32::calc(_buf, total - sizeof(crc))) {
+                    _consume = total;
+                    _validEnd = _offset + total;
+                    _blocks++;
+                    return _block.type;
+                }
+            }
+            // resync: continue at the next byte that could start a sync word
+            const uint8_t *next = (const uint8_t*)memchr(_buf + 1, BLOCK_SYNC & 0xFF, _bufLen - 1);
+            size_t len = next ? next - _buf : _bufLen;
+            *skipped += len;
+            drop(len);
+        }
+    }
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "crc32.h"
+
+// On-flash format of the telemetry log files, shared by the writer (telemetry.h) and the readers (logdecoder.h)
+// No Arduino dependencies, so it can also be used in host tools.
+//
+// File layout (version 2):
+//   flashEntryHeader_t, logEntryDef_t[numLogEntryDefs], then blocks until the end of the file:
+//   blockHeader_t, payload (whole records or a timeBlock_t), CRC-32 of header and payload
+// Version 1 and legacy (0) files have plain records after the header instead of blocks.
+// Live streams (BaseStation binary output) are blocks only, the header is sent in a BLOCK_HEADER block.
+class LogFormat {
+    public:
+    // Available log datatypes
+    // (Need to change size array and get/set/dump functions if implementing more types)
+    enum logEntryDef_type_e : uint8_t {
+        T_I8,           // values:   -128 ..          127
+        T_U8,           //              0 ..          255
+        T_I16,          //        -32,768 ..       32,767
+        T_U16,          //              0 ..       65,535
+        T_I32,          // -2,147,483,648 .. 2,147,483,647
+        T_U32,          //              0 .. 4,294,967,295
+        T_FLOAT,        // 7.5 valid digits, with floating decimal point
+        T_I16_VEC3,     // int16[3]
+        T_U8_VEC4,      // uint8[4]
+        T_U64,          //              0 .. 18,446,744,073,709,551,615 (timestamps, set raw)
+        TYPE_COUNT,     // last element marker, leave at end
+    };
+
+    // Log datatype sizes in bytes, corresponding by index number
+    static constexpr uint8_t logEntryDef_type_size[TYPE_COUNT] = {
+        1, 1, 2, 2, 4, 4, 4, 6, 4, 8
+    };
+
+    // Type definition of a log entry
+    typedef struct {
+        logEntryDef_type_e type;    // data type to store
+        char name[16];              // field name, maximum 16 characters
+        float multiplier;           // values get multiplied by this value before saving
+        uint16_t _size, _offset;    // auto generated
+    } __attribute__((packed)) logEntryDef_t;
+
+    static const uint32_t LOG_FILE_MAGIC = 0x4D4C5452;     // "RTLM"
+    static const uint16_t LOG_FILE_VERSION = 2;     // 2: records in CRC framed blocks (see blockHeader_t)
+
+    enum timeFlags_e : uint16_t {
+        TIME_UTC_VALID = 0x01,      // utcOffsetUs is set
+        TIME_UTC_PPS = 0x02,        // utcOffsetUs was disciplined with the GPS PPS pulse
+    };
+
+    typedef struct {
+        uint32_t magic;                     // LOG_FILE_MAGIC
+        uint16_t version;                   // LOG_FILE_VERSION
+        uint16_t headerSize;                // size of header + logEntryDef[]
+        uint16_t numLogEntryDefs;           // number of log entry definitions
+        uint16_t timeFlags;                 // timeFlags_e
+        int64_t openTimeUs;                 // timebase when the file was created
+        int64_t utcOffsetUs;                // UTC (us since Unix epoch) = time_us + utcOffsetUs
+        // logEntryDef_t logEntryDefs[];    // log entry definitions start here
+    } __attribute__((packed)) flashEntryHeader_t;
+
+    // Payload of a BLOCK_TIME block, replaces the time mapping of the header from there on (version 2+)
+    typedef struct {
+        uint16_t timeFlags;                 // timeFlags_e
+        int64_t utcOffsetUs;
+    } __attribute__((packed)) timeBlock_t;
+
+    // Header of files written before LOG_FILE_MAGIC was introduced (starts with the header size instead)
+    typedef struct {
+        uint32_t headerSize;                // size of header + logEntryDef[] (size_t on the ESP32)
+        uint16_t numLogEntryDefs;
+    } __attribute__((packed)) flashEntryHeaderV0_t;
+
+    // Records are written in blocks: blockHeader_t, payload, CRC-32 of header and payload.
+    // The CRC is the commit marker of a block, a block cut short by a reset or power loss fails the check
+    // and gets cut off by the boot recovery, so it can never shift or corrupt the records around it.
+    static const uint16_t BLOCK_SYNC = 0xB10C;
+    static const size_t BLOCK_PAYLOAD = 1012;       // max payload, a whole block fits in 1 KB
+    static const size_t BLOCK_OVERHEAD = 12;        // header + CRC
+
+    enum blockType_e : uint8_t {
+        BLOCK_NONE,             // no block (end of file)
+        BLOCK_RECORDS,          // whole records
+        BLOCK_TIME,             // update of the time mapping of the file header
+        BLOCK_HEADER,           // flashEntryHeader_t + logEntryDef_t[], schema of a stream (not used in files)
+    };
+
+    typedef struct {
+        uint16_t sync;          // BLOCK_SYNC
+        blockType_e type;
+        uint8_t reserved;
+        uint16_t length;        // payload bytes
+        uint16_t seq;           // block counter of the file, wraps around
+    } __attribute__((packed)) blockHeader_t;
+
+    static const size_t BLOCK_MAX = BLOCK_PAYLOAD + BLOCK_OVERHEAD;
+
+    // Fills in header and CRC of a block with len payload bytes at block + sizeof(blockHeader_t), returns the block size
+    static size_t frameBlock(uint8_t *block, blockType_e type, uint16_t seq, size_t len) {
+        blockHeader_t header = { BLOCK_SYNC, type, 0, (uint16_t)len, seq };
+        memcpy(block, &header, sizeof(header));
+        uint32_t crc = Crc32::calc(block, sizeof(header) + len);
+        memcpy(block + sizeof(header) + len, &crc, sizeof(crc));
+        return len + BLOCK_OVERHEAD;
+    }
+
+    // Number of values of a field (*_VEC types have more than one)
+    static int components(logEntryDef_type_e type) {
+        return type == T_I16_VEC3 ? 3 : type == T_U8_VEC4 ? 4 : 1;
+    }
+
+    // Decodes all components of a field of a record (raw value * invScale), returns the number of components
+    static int decodeValues(const uint8_t *record, const logEntryDef_t &def, float invScale, float *values) {
+        const uint8_t *src = record + def._offset;
+        switch (def.type) {
+            case T_I8:      values[0] = load<int8_t>(src) * invScale;      break;
+            case T_U8:      values[0] = load<uint8_t>(src) * invScale;     break;
+            case T_I16:     values[0] = load<int16_t>(src) * invScale;     break;
+            case T_U16:     values[0] = load<uint16_t>(src) * invScale;    break;
+            case T_I32:     values[0] = load<int32_t>(src) * invScale;     break;
+            case T_U32:     values[0] = load<uint32_t>(src) * invScale;    break;
+            case T_U64:     values[0] = load<uint64_t>(src) * invScale;    break;
+            case T_FLOAT:   values[0] = load<float>(src) * invScale;       break;
+            case T_I16_VEC3:
+                for (int i = 0; i < 3; i++) {
+                    values[i] = load<int16_t>(src + i * sizeof(int16_t)) * invScale;
+                }
+                return 3;
+            case T_U8_VEC4:
+                for (int i = 0; i < 4; i++) {
+                    values[i] = load<uint8_t>(src + i) * invScale;
+                }
+                return 4;
+            default:
+                values[0] = NAN;
+                break;
+        }
+        return 1;
+    }
+
+    template<typename T>
+    static inline float load(const uint8_t *src) {
+        T v;
+        memcpy(&v, src, sizeof(v));     // records are packed, fields are unaligned
+        return v;
+    }
+
+    // Appends formatted text to a line buffer, keeps track of its length and never overflows it
+    __attribute__((format(printf, 4, 5)))
+    static void appendf(char *line, size_t size, size_t *len, const char *fmt, ...) {
+        if (*len >= size) {
+            return;
+        }
+        va_list args;
+        va_start(args, fmt);
+        int ret = vsnprintf(line + *len, size - *len, fmt, args);
+        va_end(args);
+        if (ret > 0) {
+            *len = *len + ret < size - 1 ? *len + ret : size - 1;
+        }
+    }
+};
@@ -1,20 +1,26 @@
 #include <Arduino.h>
-#include <ESP32Servo.h>
 #include <Wire.h>
 // #include <SPI.h>
 
+#include "i2cbus.h"
 #include "imu.h"
 #include "bme.h"
 #include "telemetry.h"
 #include "gps.h"
-#include "console.h"    // needs to be last file to be included
+#include "control.h"
+#include "console.h"
+#include "timebase.h"
+#include "fsbench.h"
 
 const int pinSDA = 17, pinSCL = 18;
 
+// The sensors are not connected on the bench setup, enable via build_flags (always on in the simulator)
+#ifndef SENSORS_CONNECTED
+#define SENSORS_CONNECTED 0
+#endif
 
-const int servoPins[] = {5, 6, 7, 8};
-const int servoNum = sizeof(servoPins) / sizeof(servoPins[0]);
-Servo* servos[servoNum] = {0};
+
+const int servoPins[FinControl::NUM_FINS] = {5, 6, 7, 8};
 
 void setup() {
     // ESP32PWM::allocateTimer(0);
@@ -28,37 +34,66 @@ void setup() {
     delay(5000);
     Serial.println("Hello World");
 
-    for (int i = 0; i < servoNum; i++) {
-        servos[i] = new Servo();
-        servos[i]->attach(servoPins[i]);
-        servos[i]->write(90);
-    }
+    finControl.init(servoPins);
 
-    Wire.setPins(2, 3);
+    i2cBus.init(2, 3);
     
     telemetry.init();
-    // bmeInit();
-    // imuInit();
+    fsBench.registerCommands();
+#if SENSORS_CONNECTED
+    bmeInit();
+    imuInit();
+#endif
+    i2cBus.start();     // all I2C access happens in the bus task from here on
     gpsInit();
 }
 
-unsigned long lastSend = 0;
+unsigned long lastRecord = 0;
 
 void loop() {
-    // bmeLoop();
-    // imuLoop();
     gpsLoop();
     telemetry.loop();
-    consoleLoop();
+    console.loop();
 
-    if (millis() - lastSend > 100) {
-        lastSend = millis();
+    if (micros() - lastRecord >= telemetry.recordIntervalUs()) {
+        lastRecord = micros();
 
         uint32_t ms = millis();
+        int64_t now = Timebase::nowUs();
         // telemetryWriteRaw((uint8_t*)&data, sizeof(data));
-        int16_t height = 123;
         telemetry.set("millis", ms);
-        telemetry.set("height", &height);
+        telemetry.set("time_us", &now);
+
+        bmeData_t baro;
+        bmeGetData(&baro);
+        if (!isnan(baro.altitude)) {
+            telemetry.set("height", baro.altitude);
+            telemetry.set("temp_c", baro.temperature);
+            int32_t baroDt = baro.timestampUs - now;
+            telemetry.set("baro_dt_us", &baroDt);
+        }
+
+        imuData_t imu;
+        imuGetData(&imu);
+        telemetry.set("accel", imu.accel[0], imu.accel[1], imu.accel[2]);
+        telemetry.set("gyro", imu.gyro[0], imu.gyro[1], imu.gyro[2]);
+        telemetry.set("magn", imu.magn[0], imu.magn[1], imu.magn[2]);
+        telemetry.set("rotation", imu.ypr.yaw, imu.ypr.pitch, imu.ypr.roll);
+        int32_t imuDt = imu.accelUs ? imu.accelUs - now : 0;
+        telemetry.set("imu_dt_us", &imuDt);
+
+        if (gps.location.isValid()) {
+            telemetry.set("gps_lat", gps.location.lat());
+            telemetry.set("gps_lon", gps.location.lng());
+            telemetry.set("gps_alt", gps.altitude.meters());
+            telemetry.set("gps_SV", gps.satellites.value());
+            int32_t gpsDt = gpsFixTimeUs() - now;
+            telemetry.set("gps_dt_us", &gpsDt);
+        }
+
+        uint8_t finPos[FinControl::NUM_FINS];
+        finControl.getPositions(finPos);
+        telemetry.set("finServoPos", finPos);
 
         telemetry.commit();
     }
@@ -5,6 +5,17 @@
 #include <esp_wifi.h>
 #include <esp_now.h>
 #include <queue>
+#include "fec.h"
+#include "console.h"
+
+// Forward error correction group layout, K data frames followed by M parity frames (M = 0: FEC off)
+// Override via build_flags. The receiver detects FEC frames by their header and reads K and M from them
+#ifndef RADIO_FEC_K
+#define RADIO_FEC_K     8
+#endif
+#ifndef RADIO_FEC_M
+#define RADIO_FEC_M     2
+#endif
 
 class Radio {
     protected:
@@ -51,9 +62,37 @@ class Radio {
                 return;
             }
         }
+
+        setFec(RADIO_FEC_K, RADIO_FEC_M);
+        registerCommands();
+    }
+
+    // Configure forward error correction, m = 0 disables it (packets are sent as they are)
+    bool setFec(uint8_t k, uint8_t m) {
+        if (m == 0) {
+            _fecEnabled = false;
+            return true;
+        }
+        _fecEnabled = _fecEncoder.configure(k, m);
+        if (!_fecEnabled) {
+            Serial.printf("[Radio] Invalid FEC configuration K=%d M=%d\n", k, m);
+        }
+        return _fecEnabled;
     }
 
     bool send(uint8_t *buf, size_t len) {
+        if (_fecEnabled) {
+            _sendOk = true;
+            bool success = _fecEncoder.encode(buf, len, [](const uint8_t *frame, size_t frameLen, void *ctx) {
+                Radio *self = (Radio*)ctx;
+                self->_sendOk &= self->sendRaw(frame, frameLen);
+            }, this);
+            return success && _sendOk;
+        }
+        return sendRaw(buf, len);
+    }
+
+    bool sendRaw(const uint8_t *buf, size_t len) {
         esp_err_t result = esp_now_send(ADDRESS, buf, len);
         if (result != ESP_OK) {
             Serial.printf("[Radio] Send failure: %X\n", result);
@@ -76,15 +115,19 @@ class Radio {
         return nullPacket;
     }
 
+    Fec::stats_t fecStats() {
+        return _fecDecoder.stats();
+    }
+
     static void OnDataRecv(const uint8_t * mac, const uint8_t *incomingData, int len) {
-        rcvPacket_t pkt = {0};
-        memcpy(pkt.mac, mac, sizeof(pkt.mac));
-        memcpy(pkt.data, incomingData, min(len, (int)sizeof(rcvPacket_t::data)));
-        pkt.dataLen = len;
-        
         // workaround needed for C-type callback (as long as only one class instance exists)
         extern Radio radio;
-        radio._rcvQueue.push(pkt);
+        memcpy(radio._lastMac, mac, sizeof(radio._lastMac));
+
+        // Packets without valid FEC header are passed through as they are (transmitter without FEC)
+        if (!radio._fecDecoder.push(incomingData, len, queuePacket, &radio)) {
+            queuePacket(incomingData, len, &radio);
+        }
     }
 
     std::queue<rcvPacket_t> _rcvQueue;
@@ -92,6 +135,39 @@ class Radio {
     protected:
     esp_now_peer_info_t _peer;
 
+    void registerCommands() {
+        console.addCommand({ "radio", "", "prints radio link statistics", 0, [](int argc, char **argv) {
+            extern Radio radio;
+            Fec::stats_t stats = radio.fecStats();
+            CONSOLE_UART.printf("FEC: %s, received: %u, recovered: %u, lost: %u, groups: %u\n",
+                radio._fecEnabled ? "on" : "off", stats.received, stats.recovered, stats.lost, stats.groups);
+        }});
+        console.addCommand({ "fec", "<k> <m>", "sets FEC group layout (m = 0: off)", 2, [](int argc, char **argv) {
+            extern Radio radio;
+            int32_t k, m;
+            // range check before narrowing to uint8_t, e.g. 264 would become 8
+            if (!Console::parseInt(argv[1], &k) || !Console::parseInt(argv[2], &m) || k < 1 || k > Fec::MAX_K ||
+                m < 0 || m > Fec::MAX_M || !radio.setFec(k, m)) {
+                CONSOLE_UART.println("Invalid FEC configuration");
+            }
+        }});
+    }
+
+    bool _fecEnabled = false;
+    bool _sendOk = true;
+    Fec::Encoder _fecEncoder;
+    Fec::Decoder _fecDecoder;
+    uint8_t _lastMac[6] = {0};
+
+    static void queuePacket(const uint8_t *data, size_t len, void *ctx) {
+        Radio *self = (Radio*)ctx;
+        rcvPacket_t pkt = {0};
+        memcpy(pkt.mac, self->_lastMac, sizeof(pkt.mac));
+        memcpy(pkt.data, data, min(len, sizeof(rcvPacket_t::data)));
+        pkt.dataLen = len;
+        self->_rcvQueue.push(pkt);
+    }
+
 
 };
 
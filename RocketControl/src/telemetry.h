@@ -2,19 +2,56 @@
 
 #include <FS.h>
 #include <LittleFS.h>
+#include <unistd.h>
+#include <limits>
 #include "radio.h"
+#include "console.h"
+#include "launch.h"
+#include "timebase.h"
+#include "logdecoder.h"
 
-class TelemetryFS {
+#ifndef LITTLEFS_VFS_PATH
+#define LITTLEFS_VFS_PATH   "/littlefs"     // mount point of LittleFS.begin()
+#endif
+
+class TelemetryFS : public LogFormat {
     protected: 
     #define FOLDER_NAME     "/telem"
     #define FILE_FORMAT     "%04d.bin"
+    #define PROBE_FILE      "/arm_probe.tmp"
+    const size_t PROBE_BYTES = 16 * 1024;       // data written by prepare() to measure the write latency
 
     public:
+    // Retention policy, applied on boot before the new telemetry file gets opened and by prepare()
+    typedef struct {
+        int keepFiles;          // max number of telemetry files to keep, including the new one (0: unlimited)
+        size_t minFreeBytes;    // delete the oldest files until at least this much space is free
+    } retention_t;
+
+    retention_t retention = { 20, 256 * 1024 };
+
+    typedef struct {
+        uint32_t writes, flushes;
+        uint32_t writeMaxUs, flushMaxUs;    // worst-case latency of write() / flush()
+    } writeStats_t;
+
+    typedef struct {
+        uint32_t blocks;        // valid blocks
+        uint32_t skippedBytes;  // invalid data between valid blocks (kept)
+        size_t validBytes;      // end of the last valid block
+        size_t cutBytes;        // torn tail that was cut off
+    } recovery_t;
+
     void init() {
         LittleFS.begin(true);
-        Serial.printf("LittleFS Free Bytes: %d\n", LittleFS.totalBytes() - LittleFS.usedBytes());
+        Serial.printf("LittleFS Free Bytes: %zu\n", freeBytes());
 
         // listDir(LittleFS, "/", 1);
+        // only the file count on boot: the newest file may be an unrecovered flight, space is freed by prepare()
+        applyRetention(0);
+        if (freeBytes() < retention.minFreeBytes) {
+            Serial.printf("[TelemFS] Warning: only %zu bytes free, \"arm\" deletes old files\n", freeBytes());
+        }
         openNextTelemFile();
     }
 
@@ -25,11 +62,11 @@ class TelemetryFS {
                 printf("%1X  ", i);
             }
         }
-        printf("\n%08X  ", viewOffset);
+        printf("\n%08zX  ", viewOffset);
         for(size_t i = 0; i < size; i++) {
             printf("%02X ", buf[i]);
             if(i % 16 == 15 && i != size-1) {
-                printf("\n%08X  ", viewOffset + i + 1);
+                printf("\n%08zX  ", viewOffset + i + 1);
             }
         }
         // printf("\n");
@@ -66,6 +103,112 @@ class TelemetryFS {
         }
     }
 
+    size_t freeBytes() {
+        size_t total = LittleFS.totalBytes(), used = LittleFS.usedBytes();
+        return used < total ? total - used : 0;
+    }
+
+    // Returns the lowest (oldest) telemetry file ID or -1 if there is none, num is set to the number of files
+    int getOldestFileID(int *num) {
+        *num = 0;
+        int oldest = -1;
+        File dir = LittleFS.open(FOLDER_NAME);
+        if (!dir) {
+            return -1;
+        }
+        File file = dir.openNextFile();
+        while (file) {
+            int fileNum = 0;
+            if (!file.isDirectory() && sscanf(file.name(), FILE_FORMAT, &fileNum) == 1) {
+                (*num)++;
+                if (oldest < 0 || fileNum < oldest) {
+                    oldest = fileNum;
+                }
+            }
+            file = dir.openNextFile();
+        }
+        return oldest;
+    }
+
+    // Deletes the oldest telemetry files until the retention policy is met and minFree bytes are free
+    // The currently open telemetry file is never deleted, and without one (boot) neither is the newest file.
+    // Returns the number of deleted files.
+    int applyRetention(size_t minFree) {
+        int deleted = 0;
+        while (true) {
+            int num;
+            int oldest = getOldestFileID(&num);
+            if (oldest < 0 || oldest == _telemFileId || (_telemFileId < 0 && num <= 1)) {
+                break;
+            }
+            // a new file gets created after retention on boot, so keep one slot free in that case
+            int maxFiles = retention.keepFiles - (_telemFileId < 0 ? 1 : 0);
+            bool tooMany = retention.keepFiles > 0 && num > maxFiles;
+            if (!tooMany && freeBytes() >= minFree) {
+                break;
+            }
+            if (!deleteFile(oldest)) {
+                break;
+            }
+            Serial.printf("[TelemFS] Retention: deleted file %d\n", oldest);
+            deleted++;
+        }
+        return deleted;
+    }
+
+    // Prepare the flash for a flight ("arm"):
+    // - deletes old files until expectedBytes (plus the retention minimum) are free
+    // - does one allocation cycle (probe file) so the block allocator scan of LittleFS happens now and not in flight
+    // - measures the write latency with the probe and resets the write statistics
+    // This does not remove the erase stalls: LittleFS erases a block when a file grows into it, also blocks freed
+    // by a truncated file, so the flight write path still blocks for one block erase (tens of ms) every 4 KB.
+    // There is no API for pre-erasing or preallocating space.
+    bool prepare(size_t expectedBytes, size_t recordSize) {
+        writeStats_t before = _stats;
+        Serial.printf("[TelemFS] Before arming: max write %u us, max flush %u us (%u writes)\n",
+            before.writeMaxUs, before.flushMaxUs, before.writes);
+
+        applyRetention(expectedBytes + retention.minFreeBytes);
+        bool enoughSpace = freeBytes() >= expectedBytes;
+        if (!enoughSpace) {
+            Serial.printf("[TelemFS] Warning: only %zu bytes free, %zu expected for the flight\n", freeBytes(), expectedBytes);
+        }
+
+        // Probe with the telemetry write pattern: record sized writes, regular flushes
+        uint8_t buf[256] = {0};
+        recordSize = constrain(recordSize, (size_t)1, sizeof(buf));
+        uint32_t probeWriteMax = 0, probeFlushMax = 0;
+        File probe = LittleFS.open(PROBE_FILE, FILE_WRITE);
+        if (probe) {
+            for (size_t written = 0; written < PROBE_BYTES; written += recordSize) {
+                uint32_t start = micros();
+                probe.write(buf, recordSize);
+                probeWriteMax = max(probeWriteMax, (uint32_t)(micros() - start));
+                if (written % 4096 < recordSize) {
+                    start = micros();
+                    probe.flush();
+                    probeFlushMax = max(probeFlushMax, (uint32_t)(micros() - start));
+                }
+            }
+            probe.close();
+            LittleFS.remove(PROBE_FILE);
+        }
+        flush();
+        resetStats();
+
+        Serial.printf("[TelemFS] After arming: max write %u us, max flush %u us (probe), %zu bytes free\n",
+            probeWriteMax, probeFlushMax, freeBytes());
+        return enoughSpace;
+    }
+
+    writeStats_t stats() {
+        return _stats;
+    }
+
+    void resetStats() {
+        _stats = {0};
+    }
+
     int getNextFileID() {
         if (!LittleFS.exists(FOLDER_NAME)) {
             LittleFS.mkdir(FOLDER_NAME);
@@ -90,35 +233,114 @@ class TelemetryFS {
         int id = getNextFileID();
         char fileToCreate[32] = {0};
         snprintf(fileToCreate, sizeof(fileToCreate), FOLDER_NAME "/" FILE_FORMAT, id);
-        _telemFile = LittleFS.open(fileToCreate, FILE_APPEND);
+        openFile(fileToCreate);
+        _telemFileId = _telemFile ? id : -1;
 
         return &_telemFile;
     }
 
+    // Opens any file for the block writer (e.g. the storage benchmark), fileId() stays -1
+    bool openFile(const char *path, const char *mode = FILE_APPEND) {
+        _telemFile = LittleFS.open(path, mode);
+        _telemFileId = -1;
+        _blockLen = 0;
+        _blockSeq = 0;
+        return (bool)_telemFile;
+    }
+
     void close() {
         if (_telemFile) {
+            commitBlock();
             _telemFile.close();
         }
+        _telemFileId = -1;
+    }
+
+    // ID of the open telemetry file (-1: none)
+    int fileId() {
+        return _telemFileId;
     }
 
+    // Writes the pending record block and commits the file to flash
     void flush() {
         if (_telemFile) {
+            commitBlock();
+            uint32_t start = micros();
             _telemFile.flush();
+            uint32_t duration = micros() - start;
+            _stats.flushes++;
+            _stats.flushMaxUs = max(_stats.flushMaxUs, duration);
         }
     }
 
     bool write(uint8_t *data, size_t len) {
         if (_telemFile) {
+            uint32_t start = micros();
             _telemFile.write(data, len);
+            uint32_t duration = micros() - start;
+            _stats.writes++;
+            _stats.writeMaxUs = max(_stats.writeMaxUs, duration);
             return true;
         }
         return false;
     }
 
-    void format() {
-        if (_telemFile) {
-            _telemFile.close();
+    // Adds a record to the pending block, the block gets written when full or on flush()
+    bool writeRecord(const uint8_t *data, size_t len) {
+        if (!_telemFile || len > BLOCK_PAYLOAD) {
+            return false;
+        }
+        if (_blockLen + len > BLOCK_PAYLOAD) {
+            commitBlock();
         }
+        memcpy(_block + sizeof(blockHeader_t) + _blockLen, data, len);
+        _blockLen += len;
+        return true;
+    }
+
+    // Writes a block with the given payload right away (after the pending records)
+    bool writeBlock(blockType_e type, const uint8_t *data, size_t len) {
+        if (!_telemFile || len > BLOCK_PAYLOAD) {
+            return false;
+        }
+        commitBlock();
+        memcpy(_block + sizeof(blockHeader_t), data, len);
+        _blockLen = len;
+        return commitBlock(type);
+    }
+
+    // Boot recovery of a file written in blocks (version 2+): finds the end of the last complete block and cuts off
+    // the torn tail after it, so dump() and later readers see a clean file. Invalid data between valid blocks is kept,
+    // readers skip it (same for the tail if it can't be cut off). decoder: only used during the call.
+    bool recover(int id, LogDecoder &decoder, recovery_t *result) {
+        *result = {0};
+        File file = open(id);
+        if (!file || !decoder.begin(fileReader, &file) || decoder.header().version < 2) {
+            return false;
+        }
+        size_t fileSize = file.size();
+        while (decoder.next() != LogDecoder::EV_END) {
+        }
+        file.close();
+
+        result->blocks = decoder.blocks();
+        result->skippedBytes = decoder.skippedTotal() - (fileSize - decoder.validEnd());
+        result->validBytes = decoder.validEnd();
+        result->cutBytes = fileSize - result->validBytes;
+        if (result->cutBytes == 0) {
+            return true;
+        }
+        return truncateFile(id, result->validBytes);
+    }
+
+    // LogDecoder::readFn_t for Arduino files
+    static size_t fileReader(void *ctx, uint8_t *buf, size_t len) {
+        return ((File*)ctx)->read(buf, len);
+    }
+
+    void format() {
+        close();
+        _blockLen = 0;
 
         LittleFS.format();
         openNextTelemFile();
@@ -133,24 +355,93 @@ class TelemetryFS {
         return false;
     }
 
-    bool hexdump(int id) {
-        char path[32] = {0};
-        snprintf(path, sizeof(path), FOLDER_NAME "/" FILE_FORMAT, id);
-        if (LittleFS.exists(path)) {
-            File readFile = LittleFS.open(path, FILE_READ);
-            if (readFile) {
-                char buf[256];
-                size_t readLen;
-                do {
-                    size_t fileOffset = readFile.position();
-                    readLen = readFile.readBytes(buf, sizeof(buf));
-                    printHex((uint8_t*)buf, readLen, fileOffset);
-                } while (readLen == sizeof(buf));
-                readFile.close();
-                return true;
+    // Start a hexdump of the given file, output lines are fetched with hexdumpNextLine()
+    bool hexdumpBegin(int id) {
+        _jobFile.close();
+        _jobFile = open(id);
+        _jobLineNum = 0;
+        return (bool)_jobFile;
+    }
+
+    // Writes the next hexdump line (16 bytes) into line, returns false when done
+    bool hexdumpNextLine(char *line, size_t size, size_t *len) {
+        *len = 0;
+        if (!_jobFile) {
+            return false;
+        }
+        if (_jobLineNum++ == 0) {
+            appendf(line, size, len, "          ");
+            for(uint8_t i = 0; i < 16; i++) {
+                appendf(line, size, len, " %1X ", i);
             }
+            appendf(line, size, len, "\n");
+            return true;
         }
-        return false;
+
+        size_t fileOffset = _jobFile.position();
+        uint8_t buf[16];
+        size_t readLen = _jobFile.read(buf, sizeof(buf));
+        if (readLen == 0) {
+            _jobFile.close();
+            return false;
+        }
+        appendf(line, size, len, "%08zX  ", fileOffset);
+        for(size_t i = 0; i < readLen; i++) {
+            appendf(line, size, len, "%02X ", buf[i]);
+        }
+        appendf(line, size, len, "\n");
+        return true;
+    }
+
+    // Start listing the flash content (root folder and one level of sub folders)
+    bool listBegin() {
+        _jobFile.close();
+        _jobSubDir.close();
+        _jobFile = LittleFS.open("/");
+        _jobLineNum = 0;
+        return _jobFile && _jobFile.isDirectory();
+    }
+
+    // Writes the next directory listing line into line, returns false when done
+    bool listNextLine(char *line, size_t size, size_t *len) {
+        *len = 0;
+        if (!_jobFile) {
+            return false;
+        }
+        if (_jobLineNum++ == 0) {
+            appendf(line, size, len, "Listing directory: /\n");
+            return true;
+        }
+
+        // finish the currently listed sub folder first
+        File file = _jobSubDir ? _jobSubDir.openNextFile() : File();
+        const char *indent = "    ";
+        if (!file) {
+            _jobSubDir.close();
+            file = _jobFile.openNextFile();
+            indent = "";
+        }
+        if (!file) {
+            _jobFile.close();
+            return false;
+        }
+
+        if (file.isDirectory()) {
+            appendf(line, size, len, "%s  DIR : %s\n", indent, file.name());
+            if (!_jobSubDir) {
+                _jobSubDir = LittleFS.open(file.path());
+            }
+        } else {
+            appendf(line, size, len, "%s  FILE: %s\tSIZE: %zu\n", indent, file.name(), file.size());
+        }
+        file.close();
+        return true;
+    }
+
+    // Abort a running hexdump / listing
+    void jobEnd() {
+        _jobFile.close();
+        _jobSubDir.close();
     }
 
     // Opens file with given numeric id from telemetry folder
@@ -165,46 +456,49 @@ class TelemetryFS {
 
     protected:
     File _telemFile;
+    int _telemFileId = -1;
+    uint8_t _block[BLOCK_MAX];      // pending block, header and CRC get filled in by commitBlock()
+    size_t _blockLen = 0;           // payload bytes in _block
+    uint16_t _blockSeq = 0;
+
+    // Frames and writes the pending block
+    bool commitBlock(blockType_e type = BLOCK_RECORDS) {
+        if (_blockLen == 0) {
+            return true;
+        }
+        size_t len = frameBlock(_block, type, _blockSeq++, _blockLen);
+        _blockLen = 0;
+        return write(_block, len);
+    }
+
+    // The Arduino FS API has no truncate, use the one of the VFS (LittleFS only updates the file metadata)
+    bool truncateFile(int id, size_t size) {
+        char path[64] = {0};
+        snprintf(path, sizeof(path), "%s" FOLDER_NAME "/" FILE_FORMAT, LITTLEFS_VFS_PATH, id);
+        return ::truncate(path, size) == 0;
+    }
+    writeStats_t _stats = {0};
+    File _jobFile, _jobSubDir;      // state of the running hexdump / listing
+    uint32_t _jobLineNum = 0;
 };
 
-class Telemetry {
+class Telemetry : public LogFormat {
     protected:
-    const int FILE_FLUSH_INTERVAL = 500;    // ms, interval in which the log file gets written to flash, handled in loop()
+    const uint32_t FILE_FLUSH_INTERVAL = 2000;          // ms, interval in which the log file gets committed to flash, handled in loop()
+    const uint32_t RADIO_SEND_INTERVAL = 100;           // ms, min interval between records sent via radio
+    const uint32_t NORMAL_RECORD_INTERVAL_US = 100000;  // record interval if capture mode is disabled
+    const int CAPTURE_DRAIN_RECORDS = 4;                // max records written from the capture ring to flash per commit() / loop()
+    const uint32_t CAPTURE_MAX_PRE_TRIGGER_MS = 60000;  // limits of the capture settings (console)
+    const uint32_t CAPTURE_MAX_RATE_HZ = 1000;
+    const uint32_t CAPTURE_MAX_RING_BYTES = 128 * 1024; // RAM of the capture ring buffer
 
     public:
-    // Available log datatypes
-    // (Need to change size array and get/set/dump functions if implementing more types)
-    enum logEntryDef_type_e : uint8_t {
-        T_I8,           // values:   -128 ..          127
-        T_U8,           //              0 ..          255
-        T_I16,          //        -32,768 ..       32,767
-        T_U16,          //              0 ..       65,535
-        T_I32,          // -2,147,483,648 .. 2,147,483,647
-        T_U32,          //              0 .. 4,294,967,295
-        T_FLOAT,        // 7.5 valid digits, with floating decimal point
-        T_I16_VEC3,     // int16[3]
-        T_U8_VEC4,      // uint8[4]
-        TYPE_COUNT,     // last element marker, leave at end
-    };
-
-    // Log datatype sizes in bytes, corresponding by index number
-    uint8_t logEntryDef_type_size[TYPE_COUNT] = {
-        1, 1, 2, 2, 4, 4, 4, 6, 4
-    };
-
-    // Type definition of a log entry
-    typedef struct {
-        logEntryDef_type_e type;    // data type to store
-        char name[16];              // field name, maximum 16 characters
-        float multiplier;           // values get multiplied by this value before saving
-        uint16_t _size, _offset;    // auto generated
-    } __attribute__((packed)) logEntryDef_t;
-
     // Definition for the available telemetry log entries
     // TODO: ability do define this outside this class, but just make changes here for now
     inline static logEntryDef_t logEntryDef[] = {
         // type         | name (len: 16) | multiplier (optional)
         { T_U32,        "millis",                   },
+        { T_U64,        "time_us",                  },  // timebase (us since boot) of the record
         { T_I16,        "height",           10,     },
         { T_I8,         "temp_c",                   },
         { T_I16_VEC3,   "accel",            100,    },
@@ -217,17 +511,15 @@ class Telemetry {
         { T_FLOAT,      "gps_lon",                  },
         { T_I16,        "gps_alt",          10,     },
         { T_U8,         "gps_SV",                   },
+        { T_I32,        "imu_dt_us",                },  // sample time - record time (accel sample)
+        { T_I32,        "baro_dt_us",               },
+        { T_I32,        "gps_dt_us",                },
     };
     
     const int logEntryDef_num = sizeof(logEntryDef)/sizeof(logEntryDef[0]);     // Number of log entry definitions
+    static_assert(sizeof(logEntryDef)/sizeof(logEntryDef[0]) <= 32, "clipped() bitmask holds 32 fields");
     int logEntryBufSize = 0;                                                    // auto generated, size in bytes of single log record
 
-    typedef struct {
-        size_t headerSize;                  // size of header + logEntryDef[]
-        uint16_t numLogEntryDefs;           // number of log entry definitions
-        // logEntryDef_t logEntryDefs[];    // log entry definitions start here
-    } __attribute__((packed)) flashEntryHeader_t;
-
     // Constructor, initialize auto generated values and other stuff
     Telemetry() {
         int offset = 0;
@@ -243,6 +535,102 @@ class Telemetry {
         logEntryBufSize = offset;
         logEntryBuf = (uint8_t*)malloc(logEntryBufSize);    // allocate buffer for a log record
         memset(logEntryBuf, 0, logEntryBufSize);
+
+        _codec = (fieldCodec_t*)malloc(logEntryDef_num * sizeof(fieldCodec_t));
+        for (int i = 0; i < logEntryDef_num; i++) {
+            logEntryDef_type_e type = logEntryDef[i].type;
+            _codec[i].scale = logEntryDef[i].multiplier;
+            _codec[i].invScale = 1.0f / logEntryDef[i].multiplier;
+            _codec[i].components = components(type);
+            _numValues += _codec[i].components;
+        }
+
+        _accelIdx = getIndex("accel");
+        _heightIdx = getIndex("height");
+    }
+
+    // Capture mode: records are kept at full rate in a RAM ring buffer holding the last preTriggerMs.
+    // Nothing is written to flash until the launch detector triggers, then the pre-trigger window
+    // gets written out first, followed by the live records. After landing the record rate drops to lowRateHz.
+    typedef struct {
+        bool enabled;
+        uint32_t preTriggerMs;      // length of the pre-trigger window kept in RAM
+        uint32_t highRateHz;        // record rate on the pad and during flight
+        uint32_t lowRateHz;         // record rate after landing
+    } captureConfig_t;
+
+    captureConfig_t capture = { false, 2000, 200, 1 };
+    LaunchDetector launchDetector;
+
+    // (Re)configure capture mode with the values in capture, allocates the ring buffer
+    bool captureBegin() {
+        free(_ring);
+        _ring = nullptr;
+        _ringCount = _ringHead = 0;
+        _ringDropped = 0;
+        launchDetector.reset();
+        if (!capture.enabled) {
+            return true;
+        }
+
+        uint64_t ringBytes = captureRingRecords(capture) * logEntryBufSize;
+        if (ringBytes > CAPTURE_MAX_RING_BYTES) {
+            Serial.printf("[Telem] Capture Error: %u ms at %u Hz needs more than %u bytes for the ring buffer\n",
+                capture.preTriggerMs, capture.highRateHz, CAPTURE_MAX_RING_BYTES);
+            capture.enabled = false;
+            return false;
+        }
+        _ringCapacity = captureRingRecords(capture);
+        _ring = (uint8_t*)malloc((size_t)ringBytes);
+        if (!_ring) {
+            Serial.printf("[Telem] Capture Error: can't allocate %zu bytes for the ring buffer\n", (size_t)ringBytes);
+            capture.enabled = false;
+            return false;
+        }
+        return true;
+    }
+
+    // Changes the pre-trigger window and record rate, refused (settings unchanged) if the ring buffer gets too large
+    bool captureSet(uint32_t preTriggerMs, uint32_t highRateHz) {
+        captureConfig_t config = capture;
+        config.preTriggerMs = preTriggerMs;
+        config.highRateHz = highRateHz;
+        uint64_t ringBytes = captureRingRecords(config) * logEntryBufSize;
+        if (ringBytes > CAPTURE_MAX_RING_BYTES) {
+            Serial.printf("[Telem] Capture Error: %u ms at %u Hz needs %u records (%llu bytes), the ring buffer is limited to %u bytes\n",
+                preTriggerMs, highRateHz, (uint32_t)captureRingRecords(config), (unsigned long long)ringBytes, CAPTURE_MAX_RING_BYTES);
+            return false;
+        }
+        capture = config;
+        return captureBegin();
+    }
+
+    // Records in the ring buffer for the pre-trigger window, in 64 bit as the product of the settings can overflow
+    static uint64_t captureRingRecords(const captureConfig_t &config) {
+        return max((uint64_t)1, (uint64_t)config.preTriggerMs * config.highRateHz / 1000);
+    }
+
+    // Prepare the flash for a flight of the given duration at the current record rate (see TelemetryFS::prepare())
+    bool arm(uint32_t flightSeconds) {
+        size_t expectedBytes = (uint64_t)flightSeconds * logEntryBufSize * 1000000 / recordIntervalUs();
+        Serial.printf("[Telem] Arming for %u s flight, %zu bytes expected\n", flightSeconds, expectedBytes);
+        return fs.prepare(expectedBytes, logEntryBufSize);
+    }
+
+    // Records that were lost because the capture ring overflowed after the launch
+    uint32_t captureDropped() {
+        return _ringDropped;
+    }
+
+    // Interval in which the main loop should commit records
+    uint32_t recordIntervalUs() {
+        if (!capture.enabled) {
+            return NORMAL_RECORD_INTERVAL_US;
+        }
+        if (launchDetector.state() == LaunchDetector::LANDED) {
+            return 1000000 / max(capture.lowRateHz, (uint32_t)1);
+        }
+        return 1000000 / max(capture.highRateHz, (uint32_t)1);
     }
 
     // Set raw telemetry buffer value by index (normally not called manually, because indices might change. No multiplier handling)
@@ -252,9 +640,12 @@ class Telemetry {
             return false;
         }
 
-        logEntryDef_t logEntry = logEntryDef[idx];
+        const logEntryDef_t &logEntry = logEntryDef[idx];
 
         memcpy(logEntryBuf + logEntry._offset, value, logEntry._size);
+        if (idx == _heightIdx) {
+            _heightValid = true;
+        }
         return true;
     }
 
@@ -274,49 +665,21 @@ class Telemetry {
             return false;
         }
 
-        logEntryDef_t logEntry = logEntryDef[idx];
-
-        uint8_t valueBuf[16];
-        void *valuePtr;
-        int multiplier = logEntry.multiplier;
-
-        // Multiply value in place
-        val1 *= multiplier;
-        val2 *= multiplier;
-        val3 *= multiplier;
-        val4 *= multiplier;
-
-        switch(logEntry.type) {
-            case T_I8:      *(int8_t*)&valueBuf = val1;    break;
-            case T_I16:     *(int16_t*)&valueBuf = val1;   break;
-            case T_I32:     *(int32_t*)&valueBuf = val1;   break;
-            case T_U8:      *(uint8_t*)&valueBuf = val1;   break;
-            case T_U16:     *(uint16_t*)&valueBuf = val1;  break;
-            case T_U32:     *(uint32_t*)&valueBuf = val1;  break;
-            case T_FLOAT:   *(float*)&valueBuf = val1;     break;
-            case T_I16_VEC3:
-                ((int16_t*)&valueBuf)[0] = val1;
-                ((int16_t*)&valueBuf)[1] = val2;
-                ((int16_t*)&valueBuf)[2] = val3;
-                break;
-            case T_U8_VEC4:
-                ((uint8_t*)&valueBuf)[0] = val1;
-                ((uint8_t*)&valueBuf)[1] = val2;
-                ((uint8_t*)&valueBuf)[2] = val3;
-                ((uint8_t*)&valueBuf)[3] = val4;
-                break;
-            default:        
-                Serial.printf("[Telem] Error: No converter for type %d defined.\n", logEntry.type); 
-                return false;
+        float values[4] = { val1, val2, val3, val4 };
+        if (encodeField(idx, values, logEntryBuf)) {
+            _clipped |= 1UL << idx;
         }
-
-        return set(idx, valueBuf); 
+        if (idx == _heightIdx) {
+            _heightValid = true;
+        }
+        return true;
     }
 
     // Set a telemetry value by field name (e.g. telemetry.set("millis", 1234))
     // You need to pay attention to the data type in logEntryDef[], *_VEC3 / *_VEC4 expect 3 and 4 values respectively
-    // It automatically handles the conversion from a float to the more compact data type representation
-    // But it will overflow the target data type without checks, so you need to set the multiplier in logEntryDef[] so your data will fit.
+    // It automatically handles the conversion from a float to the more compact data type representation.
+    // Values get rounded to the nearest step and saturate at the limits of the data type, clipped fields are
+    // reported by clipped(). Set the multiplier in logEntryDef[] so your data will fit.
     bool set(const char *fieldName, float val1, float val2 = 0, float val3 = 0, float val4 = 0) {
         int idx = getIndex(fieldName);
         if (idx >= 0) {
@@ -325,38 +688,56 @@ class Telemetry {
         return false;
     }
 
-    float get(uint8_t* buf, int idx) {
-        // Check if index is in valid range
-        if (idx < 0 || idx >= logEntryDef_num) {
-            return false;
+    // Set all fields of the current record in one pass. values holds the components of every field in logEntryDef[]
+    // order (numValues() floats, *_VEC types take 3 / 4). T_U64 fields lose precision, set those raw afterwards.
+    void setRecord(const float *values) {
+        _clipped |= encode(values, logEntryBuf);
+        _heightValid = _heightIdx >= 0;
+    }
+
+    // Quantize a whole record from values (see setRecord()) into buf, returns a bitmask of the clipped fields
+    uint32_t encode(const float *values, uint8_t *buf) {
+        uint32_t clipped = 0;
+        for (int i = 0; i < logEntryDef_num; i++) {
+            if (encodeField(i, values, buf)) {
+                clipped |= 1UL << i;
+            }
+            values += _codec[i].components;
         }
+        return clipped;
+    }
 
+    // Decode a whole record from buf into values (numValues() floats)
+    void decode(const uint8_t *buf, float *values) {
+        for (int i = 0; i < logEntryDef_num; i++) {
+            values += decodeField(buf, i, values);
+        }
+    }
 
-        logEntryDef_t logEntry = logEntryDef[idx];
-        int multiplier = logEntry.multiplier;
+    // Number of float values of a whole record (for setRecord(), encode() and decode())
+    int numValues() {
+        return _numValues;
+    }
 
-        float val = NAN;
+    // Bitmask of the fields (bit = index in logEntryDef[]) that saturated since the last clearClipped()
+    uint32_t clipped() {
+        return _clipped;
+    }
 
-        void *bufPtr = buf + logEntry._offset;
+    void clearClipped() {
+        _clipped = 0;
+        _clipReported = 0;
+    }
 
-        switch(logEntry.type) {
-            case T_I8:      val = *(int8_t*)bufPtr;     break;
-            case T_I16:     val = *(int16_t*)bufPtr;    break;
-            case T_I32:     val = *(int32_t*)bufPtr;    break;
-            case T_U8:      val = *(uint8_t*)bufPtr;    break;
-            case T_U16:     val = *(uint16_t*)bufPtr;   break;
-            case T_U32:     val = *(uint32_t*)bufPtr;   break;
-            case T_FLOAT:   val = *(float*)bufPtr;      break;
-            default:        
-                Serial.printf("[Telem] Error: No converter for type %d defined.\n", logEntry.type); 
-                return false;
+    // Get a telemetry value by field index (first component of *_VEC types, see get(buf, idx, values))
+    float get(uint8_t* buf, int idx) {
+        // Check if index is in valid range
+        if (idx < 0 || idx >= logEntryDef_num) {
+            return NAN;
         }
-        // Serial.printf(" %d: %08X, %f\n", idx, *(uint32_t*)bufPtr, val);
-
-        // Multiply value in place
-        val /= multiplier;
-
-        return val; 
+        float values[4];
+        decodeField(buf, idx, values);
+        return values[0];
     }
 
     float get(uint8_t* buf, const char *fieldName) {
@@ -367,117 +748,101 @@ class Telemetry {
         return NAN;
     }
 
-    // Prints the header (log entry definitions) in a CSV-compatible representation
-    void printCsvHeader(logEntryDef_t *entryDefs, size_t num) {
-        for (int i = 0; i < num; i++) {
-            switch (entryDefs[i].type) {
-                case T_I16_VEC3:
-                    Serial.printf("%s.x,%s.y,%s.z", entryDefs[i].name, entryDefs[i].name, entryDefs[i].name);
-                    break;
-                case T_U8_VEC4:
-                    Serial.printf("%s.a,%s.b,%s.c,%s.d", entryDefs[i].name, entryDefs[i].name, entryDefs[i].name, entryDefs[i].name);
-                    break;
-                default:
-                    Serial.printf("%s", entryDefs[i].name);                    
-                    break;
-            }
-
-            // Print comma, unless last field name
-            if (i < (num - 1)) {
-                Serial.printf(",");
-            }
+    // Get all components of a telemetry value (also *_VEC types), returns the number of components written to values
+    int get(uint8_t* buf, int idx, float *values) {
+        if (idx < 0 || idx >= logEntryDef_num) {
+            return 0;
         }
-        Serial.printf("\n");
+        return decodeField(buf, idx, values);
     }
 
-    // Prints the values of a single log record
-    void printCsvRecord(logEntryDef_t *entryDefs, size_t entryNum, const char *recordBuf) {
-        for (int i = 0; i < entryNum; i++) {
-            float multiplier = entryDefs[i].multiplier;
-            if (multiplier == 0) {
-                multiplier = 1;
-            }
-
-            // Define possible value datatypes as union like this to make handling easier
-            // TODO: maybe put definition somewhere else? Idk if it has a performance impact
-            union {
-                uint32_t u32;
-                int32_t i32;
-                float f32;
-                uint8_t u8_4[4];
-                int16_t i16_3[3];
-            } __attribute__((packed)) val;
-
-            memset(&val, 0, sizeof(val));   // clear value
-            memcpy(&val, recordBuf + entryDefs[i]._offset, entryDefs[i]._size); // copy raw value from buffer to val
-
-            // Print value according to datatype
-            switch (entryDefs[i].type) {
-                case T_U8:
-                case T_U16:
-                case T_U32:
-                    if (multiplier <= 1)    Serial.printf("%8u", (uint32_t)((float)val.u32 / multiplier)); // if resulting number has no decimal point, print as integer
-                    else                    Serial.printf("%10g", ((float)val.u32 / multiplier));          // else print shortest float representation
-                    break;
-                case T_I8:
-                case T_I16:
-                case T_I32:
-                    if (multiplier <= 1)    Serial.printf("%8d", (int32_t)((float)val.i32 / multiplier));
-                    else                    Serial.printf("%10g", ((float)val.i32 / multiplier));
-                    break;
-                case T_FLOAT:   
-                    Serial.printf("%10f", (val.f32 / multiplier)); 
-                    break;
-                case T_I16_VEC3:
-                    for (int j = 0; j < 3; j++) {
-                        Serial.printf("%8g%s", (val.i16_3[j] / multiplier), j < 2 ? "," : "");
-                    }
-                    break;
-                case T_U8_VEC4:
-                    for (int j = 0; j < 4; j++) {
-                        Serial.printf("%5g%s", (val.u8_4[j] / multiplier), j < 3 ? "," : "");
-                    }
-                    break;
-            }
+    static const int CSV_LINE_SIZE = 512;
 
-            // Print comma, unless last field name
-            if (i < (entryNum - 1)) {
-                Serial.printf(",");
-            }
-        }
-        Serial.printf("\n");
+    // Prints the header (log entry definitions) in a CSV-compatible representation
+    void printCsvHeader(const logEntryDef_t *entryDefs, size_t num) {
+        char line[CSV_LINE_SIZE];
+        size_t len;
+        LogDecoder::formatCsvHeader(line, sizeof(line), &len, entryDefs, num);
+        Serial.write((uint8_t*)line, len);
     }
 
-    // Prints a CSV-compatible representation of a stored log file
-    void dump(int id) {
-        File file = fs.open(id);
-        if (file) {
-            flashEntryHeader_t header;
-            file.readBytes((char*)&header, sizeof(header));
+    // Prints the values of a single log record
+    void printCsvRecord(const logEntryDef_t *entryDefs, size_t entryNum, const uint8_t *recordBuf) {
+        char line[CSV_LINE_SIZE];
+        size_t len;
+        LogDecoder::formatCsvRecord(line, sizeof(line), &len, entryDefs, entryNum, recordBuf);
+        Serial.write((uint8_t*)line, len);
+    }
 
-            size_t logEntryDefSize = header.headerSize - sizeof(flashEntryHeader_t);
+    // Opens a stored log file for dumping, the CSV lines are fetched with dumpNextLine()
+    bool dumpBegin(int id) {
+        dumpEnd();
+        _dumpFile = fs.open(id);
+        if (!_dumpFile) {
+            return false;
+        }
+        if (!_decoder.begin(TelemetryFS::fileReader, &_dumpFile)) {
+            Serial.printf("[Telem] Dump Error: %s!\n", LogDecoder::errorName(_decoder.error()));
+            dumpEnd();
+            return false;
+        }
+        _dumpHeaderDone = false;
+        return true;
+    }
 
-            if (logEntryDefSize / header.numLogEntryDefs != sizeof(logEntryDef_t)) {
-                Serial.printf("[Telem] Dump Error: incompatible log entry definition format!\n");
-                return;
+    // Writes the next CSV line (header first, then one line per record) into line, returns false when done
+    // Time mapping updates and skipped invalid data show up as comment lines.
+    bool dumpNextLine(char *line, size_t size, size_t *len) {
+        *len = 0;
+        if (!_dumpFile) {
+            return false;
+        }
+        if (!_dumpHeaderDone) {
+            _dumpHeaderDone = true;
+            // time mapping as comment line before the CSV header (version 1+)
+            const flashEntryHeader_t &header = _decoder.header();
+            if (header.version >= 1) {
+                appendf(line, size, len, "# version %u, opened at %lld us, utc offset: ", header.version, (long long)header.openTimeUs);
+                if (header.timeFlags & TIME_UTC_VALID) {
+                    appendf(line, size, len, "%lld us (%s)\n", (long long)header.utcOffsetUs, header.timeFlags & TIME_UTC_PPS ? "pps" : "nmea");
+                } else {
+                    appendf(line, size, len, "none\n");
+                }
             }
+            size_t headerLen;
+            _decoder.formatCsvHeader(line + *len, size - *len, &headerLen);
+            *len += headerLen;
+            return true;
+        }
 
-            logEntryDef_t fileLogEntryDefs[header.numLogEntryDefs];
-            file.readBytes((char*)fileLogEntryDefs, logEntryDefSize);
-            printCsvHeader(fileLogEntryDefs, header.numLogEntryDefs);
+        switch (_decoder.next()) {
+            case LogDecoder::EV_RECORD:
+                _decoder.formatCsvRecord(line, size, len, _decoder.record());
+                return true;
+            case LogDecoder::EV_TIME:
+                appendf(line, size, len, "# time mapping updated, utc offset: %lld us (%s)\n", (long long)_decoder.time().utcOffsetUs,
+                    _decoder.time().timeFlags & TIME_UTC_PPS ? "pps" : "nmea");
+                return true;
+            case LogDecoder::EV_SKIPPED:
+                appendf(line, size, len, "# skipped %u invalid bytes at offset %llu\n", _decoder.skipped(), (unsigned long long)_decoder.skippedOffset());
+                return true;
+            default:
+                dumpEnd();
+                return false;
+        }
+    }
 
-            // calculate metadata of log entries based on the read header.
-            int logEntryRecordSize = 0;
-            for (int i = 0; i < header.numLogEntryDefs; i++) {
-                fileLogEntryDefs[i]._offset = logEntryRecordSize;
-                fileLogEntryDefs[i]._size = logEntryDef_type_size[fileLogEntryDefs[i].type];
-                logEntryRecordSize += fileLogEntryDefs[i]._size;
-            }
+    void dumpEnd() {
+        _dumpFile.close();
+    }
 
-            char buf[logEntryRecordSize];
-            while (file.available() >= logEntryRecordSize) {
-                file.readBytes(buf, logEntryRecordSize);
-                printCsvRecord(fileLogEntryDefs, header.numLogEntryDefs, buf);
+    // Prints a CSV-compatible representation of a stored log file (blocking, see dumpBegin() for the resumable variant)
+    void dump(int id) {
+        if (dumpBegin(id)) {
+            char line[CSV_LINE_SIZE];
+            size_t len;
+            while (dumpNextLine(line, sizeof(line), &len)) {
+                Serial.write((uint8_t*)line, len);
             }
         }
     }
@@ -485,36 +850,85 @@ class Telemetry {
     // Call this after setting all telemetry values via set()
     // It saves the values to the flash and sends them via the ESP-NOW radio link
     bool commit() {
-        radio.send(logEntryBuf, logEntryBufSize);
-        bool success = fs.write(logEntryBuf, logEntryBufSize);
-        if (success) {
-            // memset(logEntryBuf, 0, logEntryBufSize);
+        uint32_t now = millis();
+        if (now - lastRadioSend >= RADIO_SEND_INTERVAL) {
+            lastRadioSend = now;
+            radio.send(logEntryBuf, logEntryBufSize);
+        }
 
+        if (!capture.enabled) {
+            return fs.writeRecord(logEntryBuf, logEntryBufSize);
         }
-        return success;
+
+        // push before the detector update, on the trigger sample the ring is still full of pre-trigger records
+        ringPush(logEntryBuf);
+        updateLaunchDetector(now);
+        captureDrain(CAPTURE_DRAIN_RECORDS);
+        return true;
     }
 
     // Call this in your setup() to initialize the telemetry functionality
     // Probably leads to weird errors, if not called.
     void init(bool receiver = false) {
         fs.init();
+        recoverFile(fs.fileId() - 1);
+        registerCommands();
+        writeHeader();
 
-        flashEntryHeader_t header = {
-            .headerSize = sizeof(flashEntryHeader_t) + sizeof(logEntryDef),
-            .numLogEntryDefs = (uint16_t)logEntryDef_num,
-        };
+        radio.init(receiver);
+    }
+
+    // Writes the file header and the log entry definitions to a newly opened telemetry file
+    void writeHeader() {
+        _fileOpenUs = Timebase::nowUs();
+        flashEntryHeader_t header = makeHeader();
         fs.write((uint8_t*)&header, sizeof(header));
         fs.write((uint8_t*)&logEntryDef, sizeof(logEntryDef));
+        fs.flush();
+    }
 
-        radio.init(receiver);
+    // Boot recovery of the file that was open before the reset (see TelemetryFS::recover())
+    bool recoverFile(int id) {
+        uint32_t start = millis();
+        TelemetryFS::recovery_t result;
+        bool ok = fs.recover(id, _decoder, &result);
+        if (result.cutBytes || result.skippedBytes || (!ok && result.blocks)) {
+            Serial.printf("[Telem] Recovery: file %d, %u blocks (%zu bytes) valid, %zu bytes torn tail %s, %u bytes skipped (%u ms)\n",
+                id, result.blocks, result.validBytes, result.cutBytes, ok ? "cut off" : "NOT cut off", result.skippedBytes, (unsigned)(millis() - start));
+        }
+        return ok;
     }
 
     // Call this repeatedly in your main loop()
     void loop() {
+        if (capture.enabled) {
+            captureDrain(CAPTURE_DRAIN_RECORDS);
+        }
         if (millis() - lastTelemFlush >= FILE_FLUSH_INTERVAL) {
             lastTelemFlush = millis();
             fs.flush();
         }
+
+        // warn once per field about saturated values (the multiplier in logEntryDef[] is too large)
+        if (_clipped != _clipReported) {
+            for (int i = 0; i < logEntryDef_num; i++) {
+                if ((_clipped & ~_clipReported) & (1UL << i)) {
+                    Serial.printf("[Telem] Warning: values of '%s' clipped (multiplier %g)\n", logEntryDef[i].name, logEntryDef[i].multiplier);
+                }
+            }
+            _clipReported = _clipped;
+        }
+
+        // the GPS usually gets its time after the file was opened, append the time mapping once
+        // (and again if the PPS pulse becomes available)
+        uint16_t flags = timeFlags();
+        if (flags != _headerTimeFlags) {
+            _headerTimeFlags = flags;
+            timeBlock_t time = { flags, timebase.utcOffsetUs() };
+            if (fs.writeBlock(TelemetryFS::BLOCK_TIME, (uint8_t*)&time, sizeof(time))) {
+                Serial.printf("[Telem] Time mapping updated, utc offset: %lld us\n", (long long)time.utcOffsetUs);
+            }
+        }
     }
 
 
@@ -523,6 +937,278 @@ class Telemetry {
     protected:
     uint8_t *logEntryBuf = nullptr;
     uint32_t lastTelemFlush = 0;
+    int64_t _fileOpenUs = 0;
+    uint16_t _headerTimeFlags = 0;      // time flags of the header in the open file
+    uint32_t lastRadioSend = 0;
+
+    // capture ring buffer (FIFO of records)
+    uint8_t *_ring = nullptr;
+    uint32_t _ringCapacity = 0, _ringCount = 0, _ringHead = 0;     // head: index of the oldest record
+    uint32_t _ringDropped = 0;                                      // records overwritten after the launch
+    int _accelIdx = -1, _heightIdx = -1;
+    bool _heightValid = false;
+
+    // Precomputed float <-> storage conversion of a field (from logEntryDef[] in the constructor)
+    typedef struct {
+        float scale;            // multiplier
+        float invScale;         // 1 / multiplier
+        uint8_t components;     // number of floats (*_VEC types)
+    } fieldCodec_t;
+
+    fieldCodec_t *_codec = nullptr;
+    int _numValues = 0;
+    uint32_t _clipped = 0;              // fields that saturated (bit = index)
+    uint32_t _clipReported = 0;         // fields that got a warning already
+
+    // Round half up to an integer and saturate to the range of T, NaN stores 0. Sets clipped if x did not fit.
+    template<typename T>
+    static inline T quantize(float x, bool &clipped) {
+        const float lo = (float)std::numeric_limits<T>::min();                                 // exact (0 or -2^n)
+        const float hiExcl = ((uint64_t)std::numeric_limits<T>::max() / 2 + 1) * 2.0f;         // max + 1, exact (2^n)
+        float r = x;
+        if (fabsf(x) < 8388608.0f) {        // from 2^23 on floats are whole numbers
+            // x - floor(x) is exact, x + 0.5f isn't (0.49999997f + 0.5f rounds to 1, 8388609.5f to even)
+            float f = (float)(int32_t)x;    // truncates towards zero
+            if (f > x) {
+                f -= 1;                     // floor for the negative values
+            }
+            r = x - f >= 0.5f ? f + 1 : f;
+        }
+        if (r >= lo && r < hiExcl) {
+            return (T)r;
+        }
+        clipped = true;
+        if (r != r) {
+            return 0;
+        }
+        return r < lo ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+    }
+
+    template<typename T>
+    static inline void store(uint8_t *dst, float x, bool &clipped) {
+        T v = quantize<T>(x, clipped);
+        memcpy(dst, &v, sizeof(v));     // records are packed, fields are unaligned
+    }
+
+    // Quantize the components of field idx from values into buf, returns true if a component was clipped
+    bool encodeField(int idx, const float *values, uint8_t *buf) {
+        const float scale = _codec[idx].scale;
+        uint8_t *dst = buf + logEntryDef[idx]._offset;
+        bool clipped = false;
+        switch (logEntryDef[idx].type) {
+            case T_I8:      store<int8_t>(dst, values[0] * scale, clipped);     break;
+            case T_U8:      store<uint8_t>(dst, values[0] * scale, clipped);    break;
+            case T_I16:     store<int16_t>(dst, values[0] * scale, clipped);    break;
+            case T_U16:     store<uint16_t>(dst, values[0] * scale, clipped);   break;
+            case T_I32:     store<int32_t>(dst, values[0] * scale, clipped);    break;
+            case T_U32:     store<uint32_t>(dst, values[0] * scale, clipped);   break;
+            case T_U64:     store<uint64_t>(dst, values[0] * scale, clipped);   break;
+            case T_FLOAT: {
+                float v = values[0] * scale;
+                memcpy(dst, &v, sizeof(v));
+                break;
+            }
+            case T_I16_VEC3:
+                for (int i = 0; i < 3; i++) {
+                    store<int16_t>(dst + i * sizeof(int16_t), values[i] * scale, clipped);
+                }
+                break;
+            case T_U8_VEC4:
+                for (int i = 0; i < 4; i++) {
+                    store<uint8_t>(dst + i, values[i] * scale, clipped);
+                }
+                break;
+            default:
+                break;
+        }
+        return clipped;
+    }
+
+    // Decode all components of field idx from buf, returns the number of components
+    int decodeField(const uint8_t *buf, int idx, float *values) {
+        return decodeValues(buf, logEntryDef[idx], _codec[idx].invScale, values);
+    }
+
+    void ringPush(const uint8_t *record) {
+        if (_ringCount == _ringCapacity) {
+            // overwrite oldest record, expected on the pad, data loss in flight
+            if (launchDetector.state() != LaunchDetector::PAD) {
+                _ringDropped++;
+            }
+            _ringHead = (_ringHead + 1) % _ringCapacity;
+            _ringCount--;
+        }
+        uint32_t tail = (_ringHead + _ringCount) % _ringCapacity;
+        memcpy(_ring + tail * logEntryBufSize, record, logEntryBufSize);
+        _ringCount++;
+    }
+
+    // Write up to maxRecords of the oldest records to flash, only after launch
+    void captureDrain(int maxRecords) {
+        if (launchDetector.state() == LaunchDetector::PAD) {
+            return;
+        }
+        for (int i = 0; i < maxRecords && _ringCount > 0; i++) {
+            fs.writeRecord(_ring + _ringHead * logEntryBufSize, logEntryBufSize);
+            _ringHead = (_ringHead + 1) % _ringCapacity;
+            _ringCount--;
+        }
+    }
+
+    void updateLaunchDetector(uint32_t now) {
+        float accel[3] = {0};
+        float accelMag = 0;
+        if (get(logEntryBuf, _accelIdx, accel) == 3) {
+            accelMag = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+        }
+        // the height field reads 0 until the baro delivered its first value, that must not count as pad altitude
+        float height = _heightValid ? get(logEntryBuf, _heightIdx) : NAN;
+
+        if (launchDetector.update(now, accelMag, height)) {
+            Serial.printf("[Telem] Capture: %s detected at %u ms\n", LaunchDetector::stateName(launchDetector.state()), now);
+            // commit what is written so far right away instead of waiting for the flush interval
+            fs.flush();
+            lastTelemFlush = millis();
+        }
+    }
+
+    uint16_t timeFlags() {
+        switch (timebase.source()) {
+            case Timebase::SYNC_GPS_PPS:    return TIME_UTC_VALID | TIME_UTC_PPS;
+            case Timebase::SYNC_GPS_NMEA:   return TIME_UTC_VALID;
+            default:                        return 0;
+        }
+    }
+
+    flashEntryHeader_t makeHeader() {
+        _headerTimeFlags = timeFlags();
+        return {
+            .magic = LOG_FILE_MAGIC,
+            .version = LOG_FILE_VERSION,
+            .headerSize = (uint16_t)(sizeof(flashEntryHeader_t) + sizeof(logEntryDef)),
+            .numLogEntryDefs = (uint16_t)logEntryDef_num,
+            .timeFlags = _headerTimeFlags,
+            .openTimeUs = _fileOpenUs,
+            .utcOffsetUs = _headerTimeFlags ? timebase.utcOffsetUs() : 0,
+        };
+    }
+
+    // state of the running dump, the decoder is also used by the boot recovery
+    LogDecoder _decoder;
+    File _dumpFile;
+    bool _dumpHeaderDone = false;
+
+    // Console commands for accessing the stored telemetry files
+    void registerCommands() {
+        console.addCommand({ "ls", "", "list files in flash", 0, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            if (telemetry.fs.listBegin()) {
+                console.startJob([](char *line, size_t size, size_t *len) { return telemetry.fs.listNextLine(line, size, len); },
+                                 []() { telemetry.fs.jobEnd(); });
+            }
+        }});
+        console.addCommand({ "dump", "<id>", "dumps the telemetry file with the given ID as CSV", 1, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            int32_t id;
+            if (Console::parseInt(argv[1], &id) && telemetry.dumpBegin(id)) {
+                console.startJob([](char *line, size_t size, size_t *len) { return telemetry.dumpNextLine(line, size, len); },
+                                 []() { telemetry.dumpEnd(); });
+            }
+        }});
+        console.addCommand({ "hexdump", "<id>", "dumps a telemetry file as hex", 1, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            int32_t id;
+            if (Console::parseInt(argv[1], &id) && telemetry.fs.hexdumpBegin(id)) {
+                console.startJob([](char *line, size_t size, size_t *len) { return telemetry.fs.hexdumpNextLine(line, size, len); },
+                                 []() { telemetry.fs.jobEnd(); });
+            }
+        }});
+        console.addCommand({ "delete", "<id>", "delete telemetry file", 1, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            int32_t id;
+            if (Console::parseInt(argv[1], &id)) {
+                telemetry.fs.deleteFile(id);
+            }
+        }});
+        console.addCommand({ "capture", "[on|off|trigger|pre <ms>|rate <hz>|accel <m/s2>|alt <m>]", "launch capture mode settings", 0, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            int32_t val = 0;
+            float fval = 0;
+            bool hasVal = argc >= 3 && Console::parseInt(argv[2], &val) && val >= 0;
+            bool hasFval = argc >= 3 && Console::parseFloat(argv[2], &fval);
+            if (argc >= 2) {
+                const char *opt = argv[1];
+                if (strcmp(opt, "on") == 0 || strcmp(opt, "off") == 0) {
+                    telemetry.capture.enabled = strcmp(opt, "on") == 0;
+                    telemetry.captureBegin();
+                }
+                else if (strcmp(opt, "trigger") == 0) {
+                    telemetry.launchDetector.trigger(millis());
+                }
+                else if (strcmp(opt, "pre") == 0 && hasVal && (uint32_t)val <= telemetry.CAPTURE_MAX_PRE_TRIGGER_MS) {
+                    telemetry.captureSet(val, telemetry.capture.highRateHz);
+                }
+                else if (strcmp(opt, "rate") == 0 && hasVal && val > 0 && (uint32_t)val <= telemetry.CAPTURE_MAX_RATE_HZ) {
+                    telemetry.captureSet(telemetry.capture.preTriggerMs, val);
+                }
+                else if (strcmp(opt, "accel") == 0 && hasFval) {
+                    telemetry.launchDetector.config.accelThreshold = fval;
+                }
+                else if (strcmp(opt, "alt") == 0 && hasFval) {
+                    telemetry.launchDetector.config.altitudeGain = fval;
+                }
+                else {
+                    CONSOLE_UART.println("Invalid arguments");
+                    return;
+                }
+            }
+            CONSOLE_UART.printf("Capture: %s, state: %s, pre-trigger: %u ms, rate: %u Hz (landed: %u Hz)\n",
+                telemetry.capture.enabled ? "on" : "off", LaunchDetector::stateName(telemetry.launchDetector.state()),
+                telemetry.capture.preTriggerMs, telemetry.capture.highRateHz, telemetry.capture.lowRateHz);
+            CONSOLE_UART.printf("Trigger: accel >= %.1f m/s^2, altitude gain >= %.1f m (pad: %.1f m)\n",
+                telemetry.launchDetector.config.accelThreshold, telemetry.launchDetector.config.altitudeGain,
+                telemetry.launchDetector.padAltitude());
+            CONSOLE_UART.printf("Ring: %u / %u records, dropped: %u\n", telemetry._ringCount, telemetry._ringCapacity, telemetry._ringDropped);
+        }});
+        console.addCommand({ "arm", "[seconds]", "prepares flash for a flight (default 300 s)", 0, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            int32_t seconds = 300;
+            if (argc >= 2 && (!Console::parseInt(argv[1], &seconds) || seconds <= 0)) {
+                CONSOLE_UART.println("Invalid duration");
+                return;
+            }
+            telemetry.arm(seconds);
+        }});
+        console.addCommand({ "fsstat", "[reset]", "flash usage and write latency statistics", 0, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+                telemetry.fs.resetStats();
+            }
+            int numFiles;
+            telemetry.fs.getOldestFileID(&numFiles);
+            TelemetryFS::writeStats_t stats = telemetry.fs.stats();
+            CONSOLE_UART.printf("Free: %zu bytes, files: %d, retention: keep %d files, min %zu bytes free\n",
+                telemetry.fs.freeBytes(), numFiles, telemetry.fs.retention.keepFiles, telemetry.fs.retention.minFreeBytes);
+            CONSOLE_UART.printf("Writes: %u, max %u us, flushes: %u, max %u us\n",
+                stats.writes, stats.writeMaxUs, stats.flushes, stats.flushMaxUs);
+        }});
+        console.addCommand({ "retain", "<files> <min free KB>", "sets the retention policy (file count on boot, both on arm)", 2, [](int argc, char **argv) {
+            extern Telemetry telemetry;
+            int32_t files, minFreeKB;
+            if (!Console::parseInt(argv[1], &files) || !Console::parseInt(argv[2], &minFreeKB) || files < 0 || minFreeKB < 0) {
+                CONSOLE_UART.println("Invalid arguments");
+                return;
+            }
+            telemetry.fs.retention = { files, (size_t)minFreeKB * 1024 };
+        }});
+        console.addCommand({ "format", "", "deletes all telemetry files (use with caution)", 0, [](int argc, char **argv) {
+            console.confirm("This will format all data stored in Flash! Are you sure?", []() {
+                extern Telemetry telemetry;
+                telemetry.fs.format();
+                telemetry.writeHeader();
+            });
+        }});
+    }
 
     // Get the log entry index from a field name, returns -1 if not found
     int getIndex(const char *fieldName) {
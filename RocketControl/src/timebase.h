@@ -0,0 +1,150 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "console.h"
+
+// Monotonic 64 bit microsecond timebase shared by all modules (esp_timer, does not wrap).
+// Can be disciplined to UTC by the GPS: with a PPS pin the pulse edge is captured in an interrupt
+// and the following NMEA time marks the start of that second (accuracy in the us range),
+// without PPS the NMEA time and its age are used (accuracy in the 10 ms range).
+class Timebase {
+    public:
+    enum source_e : uint8_t {
+        SYNC_NONE,          // no UTC mapping available
+        SYNC_GPS_NMEA,      // mapped from NMEA sentences
+        SYNC_GPS_PPS,       // mapped from the PPS pulse
+    };
+
+    const int64_t PPS_MAX_AGE_US = 1000000;     // a PPS pulse is only matched with NMEA time within one second
+
+    // Microseconds since boot
+    static int64_t nowUs() {
+        return esp_timer_get_time();
+    }
+
+    // Convert a 32 bit micros() timestamp (e.g. from a driver) into the timebase
+    // Only valid for timestamps less than ~71 minutes in the past
+    static int64_t fromMicros32(uint32_t us) {
+        int64_t now = nowUs();
+        return now - (uint32_t)((uint32_t)now - us);
+    }
+
+    // Capture the GPS PPS pulse (rising edge) on the given pin
+    void attachPps(int pin) {
+        pinMode(pin, INPUT);
+        attachInterrupt(digitalPinToInterrupt(pin), ppsIsr, RISING);
+    }
+
+    // Feed a decoded GPS time, utcUs: UTC in us since the Unix epoch, ageUs: time since the sentence was received
+    void updateGps(int64_t utcUs, uint32_t ageUs) {
+        int64_t now = nowUs();
+        int64_t receivedUs = now - ageUs;
+
+        portENTER_CRITICAL(&_mux);
+        int64_t lastPpsUs = _lastPpsUs;
+        portEXIT_CRITICAL(&_mux);
+
+        int64_t offset;
+        source_e source;
+        if (lastPpsUs != 0 && receivedUs >= lastPpsUs && receivedUs - lastPpsUs < PPS_MAX_AGE_US) {
+            // the time sentence after the pulse describes the second that started with the pulse
+            int64_t secondUs = utcUs - (utcUs % 1000000);
+            offset = secondUs - lastPpsUs;
+            source = SYNC_GPS_PPS;
+        } else {
+            offset = utcUs - receivedUs;
+            source = SYNC_GPS_NMEA;
+        }
+
+        portENTER_CRITICAL(&_mux);
+        _utcOffsetUs = offset;
+        _source = source;
+        _lastSyncUs = now;
+        _syncCount++;
+        portEXIT_CRITICAL(&_mux);
+    }
+
+    bool utcValid() {
+        return _source != SYNC_NONE;
+    }
+
+    source_e source() {
+        return _source;
+    }
+
+    // UTC (us since Unix epoch) = timebase + utcOffsetUs()
+    int64_t utcOffsetUs() {
+        portENTER_CRITICAL(&_mux);
+        int64_t offset = _utcOffsetUs;
+        portEXIT_CRITICAL(&_mux);
+        return offset;
+    }
+
+    int64_t toUtcUs(int64_t monoUs) {
+        return monoUs + utcOffsetUs();
+    }
+
+    // Convert a calendar date / time (UTC) to us since the Unix epoch
+    static int64_t utcFromDate(int year, int month, int day, int hour, int minute, int second, int centisecond) {
+        // days from civil, see http://howardhinnant.github.io/date_algorithms.html
+        year -= month <= 2;
+        int era = (year >= 0 ? year : year - 399) / 400;
+        int yoe = year - era * 400;
+        int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        int64_t days = (int64_t)era * 146097 + doe - 719468;
+
+        int64_t seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+        return seconds * 1000000 + centisecond * 10000;
+    }
+
+    static const char *sourceName(source_e source) {
+        switch (source) {
+            case SYNC_NONE:     return "none";
+            case SYNC_GPS_NMEA: return "gps nmea";
+            case SYNC_GPS_PPS:  return "gps pps";
+        }
+        return "?";
+    }
+
+    void printStatus() {
+        int64_t now = nowUs();
+        CONSOLE_UART.printf("Timebase: %lld us, sync: %s, PPS pulses: %u, syncs: %u\n",
+            (long long)now, sourceName(_source), _ppsCount, _syncCount);
+        if (utcValid()) {
+            int64_t utc = toUtcUs(now);
+            int64_t secOfDay = (utc / 1000000) % 86400;
+            CONSOLE_UART.printf("UTC offset: %lld us, UTC: %02d:%02d:%02d.%06d, last sync %lld ms ago\n",
+                (long long)utcOffsetUs(), (int)(secOfDay / 3600), (int)(secOfDay / 60 % 60), (int)(secOfDay % 60),
+                (int)(utc % 1000000), (long long)((now - _lastSyncUs) / 1000));
+        }
+    }
+
+    void registerCommands() {
+        console.addCommand({ "time", "", "timebase and GPS time sync status", 0, [](int argc, char **argv) {
+            extern Timebase timebase;
+            timebase.printStatus();
+        }});
+    }
+
+    protected:
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    volatile int64_t _lastPpsUs = 0;
+    volatile uint32_t _ppsCount = 0;
+    int64_t _utcOffsetUs = 0;
+    int64_t _lastSyncUs = 0;
+    uint32_t _syncCount = 0;
+    source_e _source = SYNC_NONE;
+
+    static void IRAM_ATTR ppsIsr() {
+        extern Timebase timebase;
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL_ISR(&timebase._mux);
+        timebase._lastPpsUs = now;
+        timebase._ppsCount++;
+        portEXIT_CRITICAL_ISR(&timebase._mux);
+    }
+};
+
+inline Timebase timebase;